@@ -20,8 +20,10 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace umf {
@@ -50,7 +52,34 @@ using provider_unique_handle_t =
         }                                                                      \
     }
 
+// Assigns the op only if type implements it, sets it to NULL otherwise.
+// Requires UMF_DEFINE_HAS_OP(func) to be used first.
+#define UMF_ASSIGN_OP_OPTIONAL(ops, type, func, default_return)                \
+    if constexpr (detail::has_##func<type>::value) {                           \
+        UMF_ASSIGN_OP(ops, type, func, default_return);                        \
+    } else {                                                                   \
+        ops.func = nullptr;                                                    \
+    }
+
+#define UMF_DEFINE_HAS_OP(func)                                                \
+    template <typename T, typename = void>                                     \
+    struct has_##func : std::false_type {};                                    \
+    template <typename T>                                                      \
+    struct has_##func<T, std::void_t<decltype(&T::func)>> : std::true_type {}
+
 namespace detail {
+UMF_DEFINE_HAS_OP(trim);
+UMF_DEFINE_HAS_OP(reset);
+UMF_DEFINE_HAS_OP(malloc_batch);
+UMF_DEFINE_HAS_OP(free_batch);
+UMF_DEFINE_HAS_OP(allocation_split);
+UMF_DEFINE_HAS_OP(allocation_merge);
+UMF_DEFINE_HAS_OP(get_ipc_handle_size);
+UMF_DEFINE_HAS_OP(get_ipc_handle);
+UMF_DEFINE_HAS_OP(put_ipc_handle);
+UMF_DEFINE_HAS_OP(open_ipc_handle);
+UMF_DEFINE_HAS_OP(close_ipc_handle);
+
 template <typename T, typename ArgsTuple>
 umf_result_t initialize(T *obj, ArgsTuple &&args) {
     try {
@@ -94,6 +123,10 @@ umf_memory_pool_ops_t poolMakeUniqueOps() {
     UMF_ASSIGN_OP(ops, T, malloc_usable_size, ((size_t)0));
     UMF_ASSIGN_OP(ops, T, free, UMF_RESULT_SUCCESS);
     UMF_ASSIGN_OP(ops, T, get_last_allocation_error, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, trim, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, reset, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, malloc_batch, ((size_t)0));
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, free_batch, UMF_RESULT_ERROR_UNKNOWN);
 
     return ops;
 }
@@ -131,6 +164,14 @@ auto memoryProviderMakeUnique(Args &&...args) {
     UMF_ASSIGN_OP(ops, T, purge_lazy, UMF_RESULT_ERROR_UNKNOWN);
     UMF_ASSIGN_OP(ops, T, purge_force, UMF_RESULT_ERROR_UNKNOWN);
     UMF_ASSIGN_OP(ops, T, get_name, "");
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, allocation_split, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, allocation_merge, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, get_ipc_handle_size,
+                           UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, get_ipc_handle, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, put_ipc_handle, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, open_ipc_handle, UMF_RESULT_ERROR_UNKNOWN);
+    UMF_ASSIGN_OP_OPTIONAL(ops, T, close_ipc_handle, UMF_RESULT_ERROR_UNKNOWN);
 
     umf_memory_provider_handle_t hProvider = nullptr;
     auto ret = umfMemoryProviderCreate(&ops, &argsTuple, &hProvider);
@@ -184,6 +225,44 @@ auto poolMakeUnique(std::array<provider_unique_handle_t, N> providers,
         ret, pool_unique_handle_t(hPool, std::move(poolDestructor))};
 }
 
+/// @brief constructs objects of type T in memory allocated from a pool.
+/// Meant for pools of objects of a single size, such as usm::FixedSizePool
+/// configured with FixedSizePoolConfig::forType<T>(). The pool must outlive
+/// this object and the objects created from it.
+template <typename T> class object_pool {
+  public:
+    explicit object_pool(umf_memory_pool_handle_t hPool) : hPool(hPool) {}
+
+    /// @brief returns a new object constructed from args, or nullptr if the
+    /// allocation fails. Exceptions thrown by the constructor are propagated.
+    template <typename... Args> T *create(Args &&...args) {
+        void *ptr = umfPoolAlignedMalloc(hPool, sizeof(T), alignof(T));
+        if (!ptr) {
+            return nullptr;
+        }
+
+        try {
+            return new (ptr) T(std::forward<Args>(args)...);
+        } catch (...) {
+            umfPoolFree(hPool, ptr);
+            throw;
+        }
+    }
+
+    /// @brief destroys an object returned by create, nullptr is ignored
+    void destroy(T *obj) {
+        if (obj) {
+            obj->~T();
+            umfPoolFree(hPool, obj);
+        }
+    }
+
+    umf_memory_pool_handle_t get() const { return hPool; }
+
+  private:
+    umf_memory_pool_handle_t hPool;
+};
+
 template <typename Type> umf_result_t &getPoolLastStatusRef() {
     static thread_local umf_result_t last_status = UMF_RESULT_SUCCESS;
     return last_status;
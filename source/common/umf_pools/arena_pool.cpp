@@ -0,0 +1,201 @@
+//===---------- arena_pool.cpp - Bump allocator for USM memory ------------===//
+//
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include "arena_pool.hpp"
+
+namespace usm {
+
+// Alignment of allocations made with malloc and calloc
+static constexpr size_t MinAlignment = alignof(std::max_align_t);
+
+umf_result_t ArenaPool::initialize(umf_memory_provider_handle_t *providers,
+                                   size_t numProviders,
+                                   ArenaPoolConfig parameters) {
+    if (numProviders != 1 || !providers[0] || !parameters.ChunkSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    MemHandle = providers[0];
+    params = parameters;
+    return UMF_RESULT_SUCCESS;
+}
+
+ArenaPool::~ArenaPool() {
+    reset();
+    trim();
+}
+
+void *ArenaPool::bump(Chunk &C, size_t Size, size_t Alignment) {
+    auto Base = reinterpret_cast<uintptr_t>(C.Base);
+    size_t Offset = C.Offset.load(std::memory_order_relaxed);
+    size_t Begin;
+    do {
+        Begin = ((Base + Offset + Alignment - 1) & ~(Alignment - 1)) - Base;
+        if (Begin > C.Size || Size > C.Size - Begin) {
+            return nullptr;
+        }
+    } while (!C.Offset.compare_exchange_weak(Offset, Begin + Size,
+                                             std::memory_order_relaxed));
+    return C.Base + Begin;
+}
+
+ArenaPool::Chunk *ArenaPool::newChunk(size_t Size, size_t Alignment) {
+    auto *C = new (std::nothrow) Chunk;
+    if (!C) {
+        umf::getPoolLastStatusRef<ArenaPool>() =
+            UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        return nullptr;
+    }
+
+    void *Ptr;
+    auto Ret = umfMemoryProviderAlloc(MemHandle, Size, Alignment, &Ptr);
+    if (Ret != UMF_RESULT_SUCCESS) {
+        delete C;
+        umf::getPoolLastStatusRef<ArenaPool>() = Ret;
+        return nullptr;
+    }
+
+    C->Base = static_cast<char *>(Ptr);
+    C->Size = Size;
+    return C;
+}
+
+void ArenaPool::freeChunk(Chunk *C) {
+    // The allocations are gone already, there is nobody to report the error
+    // to
+    umfMemoryProviderFree(MemHandle, C->Base, C->Size);
+    delete C;
+}
+
+void *ArenaPool::allocateSlow(size_t Size, size_t Alignment) {
+    std::lock_guard<std::mutex> Lg(Lock);
+
+    // A chunk which would not fit the allocation with the worst case padding
+    // is allocated just for it, leaving the current chunk in place.
+    if (Size > params.ChunkSize || Alignment - 1 > params.ChunkSize - Size) {
+        Chunk *C = newChunk(Size, Alignment > MinAlignment ? Alignment : 0);
+        if (!C) {
+            return nullptr;
+        }
+        C->Offset.store(Size, std::memory_order_relaxed);
+        C->Next = Chunks;
+        Chunks = C;
+        return C->Base;
+    }
+
+    // Another thread may have replaced the chunk in the meantime
+    if (Chunk *C = Current.load(std::memory_order_relaxed)) {
+        if (void *Ptr = bump(*C, Size, Alignment)) {
+            return Ptr;
+        }
+    }
+
+    Chunk *C = Retained;
+    if (C) {
+        Retained = C->Next;
+        --NumRetained;
+    } else if (!(C = newChunk(params.ChunkSize, 0))) {
+        return nullptr;
+    }
+    C->Next = Chunks;
+    Chunks = C;
+
+    void *Ptr = bump(*C, Size, Alignment);
+    assert(Ptr);
+    Current.store(C, std::memory_order_release);
+    return Ptr;
+}
+
+void *ArenaPool::aligned_malloc(size_t size, size_t alignment) {
+    if (alignment & (alignment - 1)) {
+        umf::getPoolLastStatusRef<ArenaPool>() =
+            UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+        return nullptr;
+    }
+    if (size == 0) {
+        return nullptr;
+    }
+    if (alignment < MinAlignment) {
+        alignment = MinAlignment;
+    }
+
+    if (Chunk *C = Current.load(std::memory_order_acquire)) {
+        if (void *Ptr = bump(*C, size, alignment)) {
+            return Ptr;
+        }
+    }
+    return allocateSlow(size, alignment);
+}
+
+void *ArenaPool::malloc(size_t size) { return aligned_malloc(size, 0); }
+
+void *ArenaPool::calloc(size_t num, size_t size) {
+    if (size && num > std::numeric_limits<size_t>::max() / size) {
+        umf::getPoolLastStatusRef<ArenaPool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
+    }
+
+    // Chunks kept by reset() are not cleared
+    void *Ptr = malloc(num * size);
+    if (Ptr) {
+        std::memset(Ptr, 0, num * size);
+    }
+    return Ptr;
+}
+
+void *ArenaPool::realloc(void *, size_t) {
+    umf::getPoolLastStatusRef<ArenaPool>() = UMF_RESULT_ERROR_NOT_SUPPORTED;
+    return nullptr;
+}
+
+size_t ArenaPool::malloc_usable_size(void *) { return 0; }
+
+enum umf_result_t ArenaPool::free(void *) { return UMF_RESULT_SUCCESS; }
+
+enum umf_result_t ArenaPool::get_last_allocation_error() {
+    return umf::getPoolLastStatusRef<ArenaPool>();
+}
+
+enum umf_result_t ArenaPool::trim() {
+    std::lock_guard<std::mutex> Lg(Lock);
+    while (Chunk *C = Retained) {
+        Retained = C->Next;
+        freeChunk(C);
+    }
+    NumRetained = 0;
+    return UMF_RESULT_SUCCESS;
+}
+
+enum umf_result_t ArenaPool::reset() {
+    std::lock_guard<std::mutex> Lg(Lock);
+    Current.store(nullptr, std::memory_order_relaxed);
+    while (Chunk *C = Chunks) {
+        Chunks = C->Next;
+        if (C->Size != params.ChunkSize ||
+            NumRetained >= params.MaxRetainedChunks) {
+            freeChunk(C);
+            continue;
+        }
+
+        C->Offset.store(0, std::memory_order_relaxed);
+        C->Next = Retained;
+        Retained = C;
+        ++NumRetained;
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+} // namespace usm
@@ -0,0 +1,103 @@
+//===---------- arena_pool.hpp - Bump allocator for USM memory ------------===//
+//
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef USM_ARENA_ALLOCATOR
+#define USM_ARENA_ALLOCATOR
+
+#include <atomic>
+#include <mutex>
+
+#include "../umf_helpers.hpp"
+
+namespace usm {
+
+// Configuration for specific arena allocator instance
+class ArenaPoolConfig {
+  public:
+    // Size of the chunks requested from the memory provider. Allocations
+    // which do not fit in a chunk get a chunk of their own.
+    size_t ChunkSize = 1024 * 1024;
+
+    // Maximum number of chunks kept by reset() for the following
+    // allocations, the others are returned to the memory provider.
+    size_t MaxRetainedChunks = 4;
+};
+
+// Allocator for memory which is freed all at once. Allocations are carved
+// from the current chunk by advancing its offset, with no record kept of
+// them, so free() does nothing and the memory is only returned by reset().
+// Space left at the end of a chunk that cannot fit the next allocation is
+// not reused until then.
+class ArenaPool {
+  public:
+    using Config = ArenaPoolConfig;
+
+    umf_result_t initialize(umf_memory_provider_handle_t *providers,
+                            size_t numProviders, ArenaPoolConfig parameters);
+    void *malloc(size_t size);
+    // calloc accesses the memory from the host, so it must only be used with
+    // host-accessible memory
+    void *calloc(size_t, size_t);
+    // Not supported, the size of the allocations is not known
+    void *realloc(void *, size_t);
+    void *aligned_malloc(size_t size, size_t alignment);
+    // Always 0, the size of the allocations is not known
+    size_t malloc_usable_size(void *);
+    enum umf_result_t free(void *ptr);
+    enum umf_result_t get_last_allocation_error();
+
+    // Return the chunks kept by reset() to the memory provider
+    enum umf_result_t trim();
+
+    // Free all allocations. Chunks of ChunkSize are rewound and kept, up to
+    // MaxRetainedChunks, the others are returned to the memory provider.
+    // Must not be called concurrently with allocations.
+    enum umf_result_t reset();
+
+    ArenaPool() = default;
+    ~ArenaPool();
+
+  private:
+    struct Chunk {
+        char *Base;
+        size_t Size;
+
+        // Bytes handed out from the beginning of the chunk
+        std::atomic<size_t> Offset{0};
+
+        Chunk *Next = nullptr;
+    };
+
+    // Take Size bytes aligned to Alignment from the chunk, nullptr if they
+    // do not fit.
+    static void *bump(Chunk &C, size_t Size, size_t Alignment);
+
+    // Allocate from a new chunk once the current one is full
+    void *allocateSlow(size_t Size, size_t Alignment);
+
+    Chunk *newChunk(size_t Size, size_t Alignment);
+    void freeChunk(Chunk *C);
+
+    umf_memory_provider_handle_t MemHandle = nullptr;
+
+    ArenaPoolConfig params;
+
+    // Chunk allocations are bumped in without taking the lock
+    std::atomic<Chunk *> Current{nullptr};
+
+    // All chunks allocations were made from, and the rewound chunks kept by
+    // reset(), protected by Lock
+    Chunk *Chunks = nullptr;
+    Chunk *Retained = nullptr;
+    size_t NumRetained = 0;
+    std::mutex Lock;
+};
+
+} // namespace usm
+
+#endif
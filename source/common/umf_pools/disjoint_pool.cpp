@@ -11,21 +11,34 @@
 #include <bitset>
 #include <cassert>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <functional>
 #include <iomanip>
 #include <limits>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 // TODO: replace with logger?
 #include <iostream>
 
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
 #include "disjoint_pool.hpp"
+#include "disjoint_pool_config_parser.hpp"
 
 namespace usm {
 
@@ -69,11 +82,37 @@ static void *AlignPtrUp(void *Ptr, const size_t Alignment) {
 
 // Aligns the value up to the specified alignment
 // (e.g. returns 16 for Size = 13, Alignment = 8)
-static size_t AlignUp(size_t Val, size_t Alignment) {
+static constexpr size_t AlignUp(size_t Val, size_t Alignment) {
     assert(Alignment > 0);
     return (Val + Alignment - 1) & (~(Alignment - 1));
 }
 
+// Returns the position of the most significant set bit
+// (e.g. returns 3 for Num = 13)
+static size_t getLeftmostSetBitPos(size_t Num) {
+    assert(Num > 0);
+#ifdef _WIN32
+    unsigned long Pos;
+    _BitScanReverse64(&Pos, Num);
+    return Pos;
+#else
+    return 63 - __builtin_clzll(static_cast<unsigned long long>(Num));
+#endif
+}
+
+// Returns the position of the least significant set bit
+// (e.g. returns 2 for Num = 12)
+static size_t getRightmostSetBitPos(uint64_t Num) {
+    assert(Num > 0);
+#ifdef _WIN32
+    unsigned long Pos;
+    _BitScanForward64(&Pos, Num);
+    return Pos;
+#else
+    return __builtin_ctzll(static_cast<unsigned long long>(Num));
+#endif
+}
+
 struct MemoryProviderError {
     umf_result_t code;
 };
@@ -83,6 +122,34 @@ DisjointPoolConfig::DisjointPoolConfig()
 
 class Bucket;
 
+// State of the deferred frees of a slab. It is stored in the slab arena in
+// front of the slab object, because the record may still be linked in the
+// list of its bucket after the slab is destroyed.
+struct DeferredFreeLink {
+    enum : uint8_t {
+        // Not in the list of the bucket
+        Idle,
+        // In the list of the bucket, or about to be added to it
+        Queued,
+        // In the list of the bucket, but the slab is destroyed already
+        Dead
+    };
+
+    std::atomic<uint8_t> State{Idle};
+    DeferredFreeLink *Next = nullptr;
+
+    // Number of frees which have updated State but not marked their chunk
+    // yet. The owner waits for them before scanning the marks, since a free
+    // which found the slab already queued relies on that scan.
+    std::atomic<uint32_t> Pending{0};
+
+    void waitPendingFrees() const {
+        while (Pending.load()) {
+            std::this_thread::yield();
+        }
+    }
+};
+
 // Represents the allocated memory block of size 'SlabMinSize'
 // Internally, it splits the memory block into chunks. The number of
 // chunks depends of the size of a Bucket which created the Slab.
@@ -93,10 +160,23 @@ class Slab {
     // Pointer to the allocated memory of SlabMinSize bytes
     void *MemPtr;
 
-    // Represents the current state of each chunk:
-    // if the bit is set then the chunk is allocated
-    // the chunk is free for allocation otherwise
-    std::vector<bool> Chunks;
+    // The memory provider MemPtr was obtained from
+    umf_memory_provider_handle_t MemHandle;
+
+    // Represents the current state of each chunk, packed into 64-bit words:
+    // if the bit is set then the chunk is free for allocation
+    // the chunk is allocated otherwise. Bits past the last chunk are never set.
+    // The words are stored right after the slab object by the slab arena.
+    uint64_t *const FreeChunksMask;
+    const size_t NumMaskWords;
+
+    // Chunks freed without the bucket lock which are still marked as
+    // allocated in FreeChunksMask, in the same layout. Stored after it.
+    std::atomic<uint64_t> *const DeferredFreeMask;
+    DeferredFreeLink &DeferredLink;
+
+    // Number of chunks the slab is split into
+    size_t NumChunks = 0;
 
     // Total number of allocated chunks at the moment.
     size_t NumAllocated = 0;
@@ -104,44 +184,77 @@ class Slab {
     // The bucket which the slab belongs to
     Bucket &bucket;
 
-    using ListIter = std::list<std::unique_ptr<Slab>>::iterator;
+    // Links of the avail/unavail list of the bucket the slab is in
+    Slab *Prev = nullptr;
+    Slab *Next = nullptr;
+    friend class SlabList;
+
+    // Hints which word of FreeChunksMask to start search for free chunk in,
+    // no word before it has a free chunk
+    size_t FirstFreeWordIdx = 0;
+
+    // Number of chunks at the beginning of the slab which were handed out at
+    // least once. Free chunks are always taken from the lowest index, so the
+    // chunks past it were not used since the slab was allocated.
+    size_t NumChunksUsed = 0;
+
+    // Whether the chunk was not used since the slab was allocated and the
+    // provider returns zeroed memory. Marks the chunk as used.
+    bool takeChunkZeroed(size_t ChunkIdx);
 
-    // Store iterator to the corresponding node in avail/unavail list
-    // to achieve O(1) removal
-    ListIter SlabListIter;
+    // When the slab was last put in the pool, set only if decay is enabled
+    std::chrono::steady_clock::time_point PooledSince;
 
-    // Hints where to start search for free chunk in a slab
-    size_t FirstFreeChunkIdx = 0;
+    // Whether the pages of the pooled slab were purged already
+    bool Purged = false;
 
     // Return the index of the first available chunk, SIZE_MAX otherwise
     size_t FindFirstAvailableChunkIdx() const;
 
-    // Register/Unregister the slab in the global slab address map.
+    // Register/Unregister the slab in the slab page map of the pool.
     void regSlab(Slab &);
     void unregSlab(Slab &);
-    static void regSlabByAddr(void *, Slab &);
-    static void unregSlabByAddr(void *, Slab &);
 
   public:
-    Slab(Bucket &);
+    // Mask and DeferredMask must point to the storage of the number of words
+    // returned by getNumMaskWords for the bucket.
+    Slab(Bucket &Bkt, uint64_t *Mask, std::atomic<uint64_t> *DeferredMask,
+         DeferredFreeLink &Link);
     ~Slab();
 
-    void setIterator(ListIter It) { SlabListIter = It; }
-    ListIter getIterator() const { return SlabListIter; }
+    // Number of words of the chunk mask of slabs split into chunks of
+    // ChunkSize bytes
+    static size_t getNumMaskWords(size_t SlabMinSize, size_t ChunkSize);
+
+    // Next slab in the list the slab is in, nullptr if it is the last one
+    Slab *getNext() const { return Next; }
+
+    // Note that the slab has just been put in the pool.
+    void setPooled();
+
+    // Purge or return to the provider a pooled slab which is idle for too
+    // long. Return true if the slab has to be released.
+    bool decay(std::chrono::steady_clock::time_point Now,
+               std::chrono::milliseconds Decay);
 
     size_t getNumAllocated() const { return NumAllocated; }
 
-    // Get pointer to allocation that is one piece of this slab.
-    void *getChunk();
+    // Get pointer to allocation that is one piece of this slab. Zeroed is set
+    // if the chunk is known to contain only zeros.
+    void *getChunk(bool &Zeroed);
+
+    // Get pointer to allocation that is this entire slab. Zeroed is set if the
+    // slab is known to contain only zeros.
+    void *getSlab(bool &Zeroed);
 
-    // Get pointer to allocation that is this entire slab.
-    void *getSlab();
+    // Get pointer to the beginning of the chunk which contains Ptr.
+    void *getChunkStart(void *Ptr) const;
 
     void *getPtr() const { return MemPtr; }
     void *getEnd() const;
 
     size_t getChunkSize() const;
-    size_t getNumChunks() const { return Chunks.size(); }
+    size_t getNumChunks() const { return NumChunks; }
 
     bool hasAvail();
 
@@ -149,16 +262,159 @@ class Slab {
     const Bucket &getBucket() const;
 
     void freeChunk(void *Ptr);
+
+    // Mark the chunk containing Ptr as freed without modifying the state
+    // used by allocations, may be called without the bucket lock.
+    void deferFreeChunk(void *Ptr);
+
+    // Take the deferred frees of the WordIdx-th word of the chunk mask
+    uint64_t takeDeferredFrees(size_t WordIdx);
+
+    size_t getNumMaskWords() const { return NumMaskWords; }
+    DeferredFreeLink &getDeferredLink() { return DeferredLink; }
+};
+
+// Intrusive list of slabs. The links are stored in the slabs themselves, so
+// moving a slab between lists never allocates memory.
+class SlabList {
+    Slab *Head = nullptr;
+    Slab *Tail = nullptr;
+    size_t Count = 0;
+
+  public:
+    void pushFront(Slab &S);
+    void pushBack(Slab &S);
+    void remove(Slab &S);
+
+    Slab *front() const { return Head; }
+    bool empty() const { return Count == 0; }
+    size_t size() const { return Count; }
+};
+
+// Storage for the slab objects of a bucket, each preceded by its deferred
+// free link and followed by its chunk masks. The records are carved from
+// blocks which are allocated on demand and kept until the bucket is
+// destroyed, and freed records are reused through a free list. Protected by
+// the lock of the owning bucket.
+class SlabArena {
+    static constexpr size_t LinkSize =
+        AlignUp(sizeof(DeferredFreeLink), alignof(std::max_align_t));
+    static constexpr size_t SlabSize =
+        AlignUp(sizeof(Slab), alignof(std::max_align_t));
+
+    const size_t NumMaskWords;
+    const size_t RecordSize;
+    const size_t RecordsPerBlock;
+
+    std::vector<std::unique_ptr<char[]>> Blocks;
+
+    // Number of records of the last block handed out at least once
+    size_t NumUsedInBlock;
+
+    // Freed records, linked through their first bytes
+    void *FreeList = nullptr;
+
+  public:
+    SlabArena(size_t NumMaskWords);
+
+    void *allocate();
+    void deallocate(void *Record);
+
+    // Parts of a record
+    static DeferredFreeLink *getLink(void *Record);
+    static Slab *getSlab(void *Record);
+    static uint64_t *getMask(void *Record);
+    std::atomic<uint64_t> *getDeferredMask(void *Record) const;
+
+    // Record of a link or of a slab
+    static void *getRecord(DeferredFreeLink *Link) { return Link; }
+    static void *getRecord(Slab *S);
+};
+
+// Map from SlabMinSize-aligned pages to the slabs an address in the page may
+// belong to. A slab covers [getPtr(), getPtr() + SlabMinSize), so besides the
+// one slab which may start in a page, there may be one more slab which
+// started in the previous page and extends into this one. Those are kept in
+// the Head and Tail entries of the page respectively.
+// The pages are stored in a radix tree whose nodes are created on demand and
+// released only together with the map, so lookups do not take any locks.
+// Registration of different slabs may happen concurrently, as slabs are
+// created under the lock of their own bucket.
+class SlabPageMap {
+    struct Entry {
+        // Start address of the slab, 0 if the entry is empty
+        std::atomic<uintptr_t> Begin{0};
+        std::atomic<Slab *> Owner{nullptr};
+    };
+
+    struct PageEntry {
+        Entry Head;
+        Entry Tail;
+    };
+
+    static constexpr size_t LeafBits = 8;
+    static constexpr size_t NodeBits = 10;
+
+    struct Leaf {
+        std::array<PageEntry, (size_t)1 << LeafBits> Pages;
+    };
+
+    struct Node {
+        std::array<std::atomic<void *>, (size_t)1 << NodeBits> Children{};
+    };
+
+    // log2 of SlabMinSize
+    const size_t PageShift;
+
+    // Number of levels of interior nodes, including the root
+    const size_t NumLevels;
+
+    Node Root;
+
+    PageEntry *getPage(uintptr_t PageIdx, bool Create);
+    void freeNode(Node *N, size_t Level);
+
+    static void setEntry(Entry &E, Slab *S, uintptr_t Begin);
+
+  public:
+    SlabPageMap(size_t PageSize);
+    ~SlabPageMap();
+
+    void insert(Slab &S);
+    void remove(Slab &S);
+
+    // Return the slab which contains Ptr, nullptr if there is none.
+    Slab *find(void *Ptr);
+};
+
+// A chunk held by a thread cache together with the slab it belongs to, so
+// that returning it to the bucket does not require a slab lookup.
+struct CachedChunk {
+    void *Ptr;
+    Slab *Owner;
+
+    // Whether the chunk is known to contain only zeros
+    bool Zeroed;
 };
 
 class Bucket {
     const size_t Size;
 
+    // Alignment of the slabs requested from the memory provider, 0 for the
+    // provider's default
+    const size_t Alignment;
+
+    // Maximum number of slabs in the pool, see Capacity()
+    const size_t SlabCapacity;
+
+    // Storage of the slab objects of this bucket
+    SlabArena Arena;
+
     // List of slabs which have at least 1 available chunk.
-    std::list<std::unique_ptr<Slab>> AvailableSlabs;
+    SlabList AvailableSlabs;
 
     // List of slabs with 0 available chunk.
-    std::list<std::unique_ptr<Slab>> UnavailableSlabs;
+    SlabList UnavailableSlabs;
 
     // Protects the bucket and all the corresponding slabs
     std::mutex BucketLock;
@@ -186,41 +442,75 @@ class Bucket {
     // if a slab in this bucket is already pooled.
     size_t chunkedSlabsInPool;
 
-    // Statistics
-    size_t allocPoolCount;
-    size_t freeCount;
-    size_t currSlabsInUse;
-    size_t currSlabsInPool;
-    size_t maxSlabsInPool;
+    // Statistics. They are only modified with the bucket lock held, but may
+    // be read at any time.
+    std::atomic<size_t> allocCount{0};
+    std::atomic<size_t> allocPoolCount{0};
+    std::atomic<size_t> freeCount{0};
+    std::atomic<size_t> chunksInUse{0};
+    std::atomic<size_t> currSlabsInUse{0};
+    std::atomic<size_t> currSlabsInPool{0};
+    std::atomic<size_t> maxSlabsInUse{0};
+    std::atomic<size_t> maxSlabsInPool{0};
+
+    // Slabs with chunks freed by freeChunkDeferred which are not applied yet.
+    // Pushed to without the bucket lock, taken as a whole with it held.
+    std::atomic<DeferredFreeLink *> DeferredFreeSlabs{nullptr};
 
   public:
-    // Statistics
-    size_t allocCount;
-    size_t maxSlabsInUse;
-
-    Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx)
-        : Size{Sz}, OwnAllocCtx{AllocCtx}, chunkedSlabsInPool(0),
-          allocPoolCount(0), freeCount(0), currSlabsInUse(0),
-          currSlabsInPool(0), maxSlabsInPool(0), allocCount(0),
-          maxSlabsInUse(0) {}
+    Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx, size_t Align = 0);
+    ~Bucket();
 
     // Get pointer to allocation that is one piece of an available slab in this
     // bucket.
-    void *getChunk(bool &FromPool);
+    void *getChunk(bool &FromPool, bool &Zeroed);
 
     // Get pointer to allocation that is a full slab in this bucket.
-    void *getSlab(bool &FromPool);
+    void *getSlab(bool &FromPool, bool &Zeroed);
+
+    // Append up to Count chunks of available slabs in this bucket to Chunks,
+    // taking the bucket lock only once.
+    void getChunks(std::vector<CachedChunk> &Chunks, size_t Count,
+                   bool &FromPool);
 
     // Return the allocation size of this bucket.
     size_t getSize() const { return Size; }
 
+    // Return the alignment of the slabs of this bucket, 0 if unspecified.
+    size_t getAlignment() const { return Alignment; }
+
     // Free an allocation that is one piece of a slab in this bucket.
     void freeChunk(void *Ptr, Slab &Slab, bool &ToPool);
 
     // Free an allocation that is a full slab in this bucket.
     void freeSlab(Slab &Slab, bool &ToPool);
 
-    umf_memory_provider_handle_t getMemHandle();
+    // Free a batch of chunks of this bucket, taking the bucket lock only once.
+    void freeChunks(const CachedChunk *Chunks, size_t Count);
+
+    // Allocate Count chunks or full slabs of this bucket into Ptrs, taking the
+    // bucket lock only once. Return the number of allocations made, which is
+    // less than Count only if the memory provider failed.
+    size_t allocateBatch(void **Ptrs, size_t Count);
+
+    // Free a batch of allocations of this bucket, chunks or full slabs
+    // depending on the bucket size, taking the bucket lock only once. Unlike
+    // freeChunks, the frees are counted in the bucket statistics.
+    void freeBatch(const CachedChunk *Allocs, size_t Count);
+
+    // Free an allocation that is one piece of a slab in this bucket without
+    // taking the bucket lock. The free takes effect with the next allocation
+    // from the bucket or the next decay.
+    void freeChunkDeferred(void *Ptr, Slab &Slab);
+
+    // Allocate a new slab from the memory provider and put it in the pool, as
+    // if it was allocated and freed. Return false if the pool is full.
+    bool prewarm();
+
+    // Purge pooled slabs idle for longer than Decay and return those idle for
+    // longer than twice Decay to the memory provider.
+    void decay(std::chrono::steady_clock::time_point Now,
+               std::chrono::milliseconds Decay);
 
     DisjointPool::AllocImpl &getAllocCtx() { return OwnAllocCtx; }
 
@@ -242,6 +532,10 @@ class Bucket {
     // The maximum allocation size subject to pooling.
     size_t MaxPoolableSize();
 
+    // Get the current statistics of the bucket
+    DisjointPoolBucketStats getStats() const;
+
+  private:
     // Update allocation count
     void countAlloc(bool FromPool);
 
@@ -251,75 +545,340 @@ class Bucket {
     // Update statistics of Available/Unavailable
     void updateStats(int InUse, int InPool);
 
-    // Print bucket statistics
-    void printStats(bool &TitlePrinted, const std::string &Label);
-
-  private:
     void onFreeChunk(Slab &, bool &ToPool);
 
+    // Put a full slab which was freed in the pool or destroy it. The lock
+    // must be held.
+    void onFreeSlab(Slab &, bool &ToPool);
+
+    // Apply the frees made by freeChunkDeferred. The lock must be held.
+    void applyDeferredFrees();
+
     // Update statistics of pool usage, and indicate that an allocation was made
     // from the pool.
     void decrementPool(bool &FromPool);
 
     // Get a slab to be used for chunked allocations.
-    decltype(AvailableSlabs.begin()) getAvailSlab(bool &FromPool);
+    Slab &getAvailSlab(bool &FromPool);
 
     // Get a slab that will be used as a whole for a single allocation.
-    decltype(AvailableSlabs.begin()) getAvailFullSlab(bool &FromPool);
+    Slab &getAvailFullSlab(bool &FromPool);
+
+    // Allocate a new slab, which is not in any list yet.
+    Slab &createSlab();
+
+    // Release a slab which was already removed from its list.
+    void destroySlab(Slab &S);
+};
+
+// Counters of the allocations served through a single bin of a thread cache
+struct ThreadCacheBinStats {
+    std::atomic<size_t> AllocCount{0};
+    std::atomic<size_t> AllocPoolCount{0};
+    std::atomic<size_t> FreeCount{0};
+};
+
+// Chunks cached by a single thread for a single pool instance, one bin per
+// bucket. Only the owning thread touches the bins; the counters may also be
+// read by other threads collecting statistics.
+class ThreadCache {
+  public:
+    ThreadCache(size_t NumBuckets) : Bins(NumBuckets), BinStats(NumBuckets) {}
+
+    std::vector<std::vector<CachedChunk>> Bins;
+    std::vector<ThreadCacheBinStats> BinStats;
+
+    std::atomic<size_t> Hits{0};
+    std::atomic<size_t> Misses{0};
+    std::atomic<size_t> Flushes{0};
+};
+
+// Keeps track of all thread caches of a pool instance. It is shared by the
+// pool and by the thread-local cache handles, so whichever goes away last
+// can still safely access it.
+struct ThreadCacheRegistry {
+    std::mutex Lock;
+
+    // Set to nullptr when the pool is destroyed
+    std::atomic<DisjointPool::AllocImpl *> Owner;
+
+    std::unordered_set<ThreadCache *> Caches;
+
+    // Counters of the caches of threads which already exited
+    DisjointPoolThreadCacheStats Retired;
+    std::vector<DisjointPoolBucketStats> RetiredBins;
+};
+
+// Owns a thread cache on behalf of a thread. On thread exit the cached chunks
+// are returned to the pool, if it still exists.
+class ThreadCacheHandle {
+    std::shared_ptr<ThreadCacheRegistry> Registry;
+    ThreadCache Cache;
+
+  public:
+    ThreadCacheHandle(std::shared_ptr<ThreadCacheRegistry> Reg,
+                      size_t NumBuckets);
+    ~ThreadCacheHandle();
+
+    ThreadCache &getCache() { return Cache; }
+    bool isOwnerAlive() const { return Registry->Owner.load() != nullptr; }
+};
+
+// Cache of the memory of freed allocations which bypass the buckets. The
+// memory is obtained from the provider in origins, which can only be
+// returned to the provider as a whole. Free ranges of origins, extents, are
+// kept ordered by size for a best-fit search and by address for coalescing
+// with their free neighbours of the same origin. Allocations are carved from
+// the front of an extent, leaving the rest in the cache, but only from origins
+// at most twice their size. The free part of an origin in use is therefore
+// never larger than the part in use, and only the entirely free origins,
+// idle ones, count towards the limit of the cache.
+// The cache is not thread-safe.
+class LargeExtentCache {
+    using Clock = std::chrono::steady_clock;
+
+    struct Origin {
+        size_t Size;
+
+        // Bytes of the origin in free extents
+        size_t FreeBytes;
+
+        // When the entire origin became free
+        Clock::time_point FreeSince;
+
+        // Position in IdleOrigins while the entire origin is free
+        std::list<uintptr_t>::iterator IdleIt;
+    };
+
+    // Origins by base address
+    std::map<uintptr_t, Origin> Origins;
+
+    // Free extents by begin address, with their sizes
+    std::map<uintptr_t, size_t> FreeByAddr;
+
+    // Free extents by size and begin address
+    std::set<std::pair<size_t, uintptr_t>> FreeBySize;
+
+    // Total size of the free extents
+    size_t CachedBytes = 0;
+
+    // Base addresses of the idle origins, least recently freed first
+    std::list<uintptr_t> IdleOrigins;
+
+    // Total size of the idle origins
+    size_t IdleBytes = 0;
+
+    std::map<uintptr_t, Origin>::iterator findOrigin(uintptr_t Addr);
+    void insertFree(uintptr_t Begin, size_t Size);
+    void eraseFree(std::map<uintptr_t, size_t>::iterator It);
+
+  public:
+    // Track memory obtained from the provider, which is in use entirely
+    void addOrigin(void *Ptr, size_t Size);
+
+    // Take Size bytes aligned to Alignment from a free extent of an origin
+    // of at most 2 * Size bytes, nullptr if none fits.
+    void *get(size_t Size, size_t Alignment);
+
+    // Return memory taken with get or added with addOrigin.
+    void put(void *Ptr, size_t Size);
+
+    // Remove the idle origins which have been free since FreeBefore and,
+    // least recently freed first, as many others as needed to bring the size
+    // of the idle origins down to MaxBytes. They are appended to Released to
+    // be returned to the provider.
+    void release(size_t MaxBytes, Clock::time_point FreeBefore,
+                 std::vector<std::pair<void *, size_t>> &Released);
+
+    size_t getCachedBytes() const { return CachedBytes; }
+    size_t getIdleBytes() const { return IdleBytes; }
 };
 
 class DisjointPool::AllocImpl {
     // It's important for the map to be destroyed last after buckets and their
     // slabs This is because slab's destructor removes the object from the map.
-    std::unordered_multimap<void *, Slab &> KnownSlabs;
-    std::shared_timed_mutex KnownSlabsMapLock;
+    SlabPageMap KnownSlabs;
 
-    // Handle to the memory provider
-    umf_memory_provider_handle_t MemHandle;
+    // Handles to the memory providers
+    std::vector<umf_memory_provider_handle_t> MemHandles;
+
+    // Provider of the next slab for the Stripe policy
+    std::atomic<size_t> NextProvider{0};
 
     // Store as unique_ptrs since Bucket is not Movable(because of std::mutex)
-    std::vector<std::unique_ptr<Bucket>> Buckets;
+    using BucketList = std::vector<std::unique_ptr<Bucket>>;
+
+    // Identical sets of buckets, one per shard. Each thread allocates from
+    // the shard it is assigned to, while chunks and slabs are always freed to
+    // the bucket which owns their slab.
+    std::vector<BucketList> Shards;
+
+    // Buckets for alignments larger than ProviderMinPageSize, whose slabs are
+    // aligned by the memory provider. They are indexed by log2 of the
+    // alignment, created on first use and kept until the pool is destroyed.
+    std::array<std::atomic<BucketList *>, 64> AlignedBuckets{};
+    std::list<BucketList> AlignedBucketLists;
+    std::mutex AlignedBucketsLock;
 
     // Configuration for this instance
     DisjointPoolConfig params;
 
-    // Coarse-grain allocation min alignment
+    // Coarse-grain allocation min alignment, the smallest of all providers
     size_t ProviderMinPageSize;
 
+    struct LargeAlloc {
+        size_t Size;
+        size_t ProviderIdx;
+    };
+
+    // Allocations which bypass the buckets and are served directly by the
+    // memory providers
+    std::unordered_map<void *, LargeAlloc> LargeAllocs;
+    std::mutex LargeAllocsLock;
+
+    // Freed memory of allocations which bypass the buckets, one cache per
+    // provider, used only if MaxLargeCacheSize is set. The limit applies to
+    // all caches together. Protected by LargeAllocsLock.
+    std::vector<LargeExtentCache> LargeCaches;
+
+    // Statistics of allocations which bypass the buckets, protected by
+    // LargeAllocsLock
+    size_t LargeAllocCount = 0;
+    size_t LargeAllocPoolCount = 0;
+    size_t LargeFreeCount = 0;
+    size_t LargeAllocBytes = 0;
+
+    // Bytes currently allocated from the memory provider, and the peak value
+    std::atomic<size_t> ResidentBytes{0};
+    std::atomic<size_t> PeakResidentBytes{0};
+
+    // Position of the most significant bit of MinBucketSize, used to compute
+    // the bucket index directly from the allocation size
+    size_t MinBucketSizeExp;
+
+    // Whether the default buckets include ExtraBucketSizes, in which case the
+    // bucket index has to be searched for
+    bool HasExtraBuckets = false;
+
+    // Number of allocations of each size range, see getSizeHistogramBin
+    static constexpr size_t SizeHistogramSubBins = 4;
+    std::array<std::atomic<size_t>, 64 * SizeHistogramSubBins> SizeHistogram{};
+    std::atomic<size_t> SizeHistogramCount{0};
+
+    // Unique id of this instance, used to find the thread caches of the pool
+    const uint64_t PoolId;
+
+    std::shared_ptr<ThreadCacheRegistry> CacheRegistry;
+
+    // Background thread applying the decay of pooled slabs
+    std::thread PurgeThread;
+    std::mutex PurgeLock;
+    std::condition_variable PurgeCv;
+    bool StopPurge = false;
+
+    // Background thread pre-allocating slabs, if requested
+    std::thread PrewarmThread;
+    std::atomic<bool> StopPrewarm{false};
+
   public:
-    AllocImpl(umf_memory_provider_handle_t hProvider, DisjointPoolConfig params)
-        : MemHandle{hProvider}, params(params) {
+    AllocImpl(std::vector<umf_memory_provider_handle_t> hProviders,
+              DisjointPoolConfig params)
+        : KnownSlabs(params.SlabMinSize), MemHandles(std::move(hProviders)),
+          params(params), LargeCaches(MemHandles.size()),
+          PoolId(NextPoolId++),
+          CacheRegistry(std::make_shared<ThreadCacheRegistry>()) {
+        CacheRegistry->Owner = this;
+
+        Shards.resize(std::max<size_t>(params.NumShards, 1));
+        for (auto &Buckets : Shards) {
+            createBuckets(Buckets, params.MinBucketSize, 0);
+        }
+        MinBucketSizeExp = getLeftmostSetBitPos(params.MinBucketSize);
+
+        ProviderMinPageSize = std::numeric_limits<size_t>::max();
+        for (auto hProvider : MemHandles) {
+            size_t PageSize;
+            auto ret = umfMemoryProviderGetMinPageSize(hProvider, nullptr,
+                                                       &PageSize);
+            if (ret != UMF_RESULT_SUCCESS) {
+                PageSize = 0;
+            }
+            ProviderMinPageSize = std::min(ProviderMinPageSize, PageSize);
+        }
 
-        // Generate buckets sized such as: 64, 96, 128, 192, ..., CutOff.
-        // Powers of 2 and the value halfway between the powers of 2.
-        auto Size1 = params.MinBucketSize;
-        auto Size2 = Size1 + Size1 / 2;
-        for (; Size2 < CutOff; Size1 *= 2, Size2 *= 2) {
-            Buckets.push_back(std::make_unique<Bucket>(Size1, *this));
-            Buckets.push_back(std::make_unique<Bucket>(Size2, *this));
+        if (params.PurgeDecayMs && params.PurgeThread) {
+            PurgeThread = std::thread([this] { purgeThreadMain(); });
         }
-        Buckets.push_back(std::make_unique<Bucket>(CutOff, *this));
 
-        auto ret = umfMemoryProviderGetMinPageSize(hProvider, nullptr,
-                                                   &ProviderMinPageSize);
-        if (ret != UMF_RESULT_SUCCESS) {
-            ProviderMinPageSize = 0;
+        if (params.PrewarmSlabs || params.PrewarmSize) {
+            if (params.PrewarmAsync) {
+                PrewarmThread = std::thread([this] { prewarm(); });
+            } else {
+                prewarm();
+            }
         }
     }
 
+    ~AllocImpl();
+
     void *allocate(size_t Size, size_t Alignment, bool &FromPool);
-    void *allocate(size_t Size, bool &FromPool);
-    void deallocate(void *Ptr, bool &ToPool);
+    void *allocate(size_t Size, bool &FromPool, bool &Zeroed);
+    void *allocate(size_t Size, bool &FromPool) {
+        bool Zeroed;
+        return allocate(Size, FromPool, Zeroed);
+    }
+    void *reallocate(void *Ptr, size_t Size);
 
-    umf_memory_provider_handle_t getMemHandle() { return MemHandle; }
+    // Size, if not 0, is the size Ptr was allocated with. It lets allocations
+    // which bypass the buckets skip the slab lookup.
+    void deallocate(void *Ptr, size_t Size, bool &ToPool);
+    void deallocate(void *Ptr, bool &ToPool) { deallocate(Ptr, 0, ToPool); }
 
-    std::shared_timed_mutex &getKnownSlabsMapLock() {
-        return KnownSlabsMapLock;
-    }
-    std::unordered_multimap<void *, Slab &> &getKnownSlabs() {
-        return KnownSlabs;
+    // Allocate Count blocks of Size bytes into Ptrs, taking the lock of the
+    // bucket serving them only once. Return the number of blocks allocated.
+    size_t allocateBatch(size_t Size, size_t Count, void **Ptrs);
+
+    // Free Count allocations of any size, taking the lock of each bucket
+    // involved only once. Return the first error of the memory provider, if
+    // any, after freeing all of them.
+    umf_result_t deallocateBatch(void **Ptrs, size_t Count);
+
+    // Return the number of bytes usable from Ptr to the end of its
+    // allocation, 0 if Ptr was not allocated from this pool.
+    size_t getUsableSize(void *Ptr);
+
+    // Return all chunks held by the thread cache to their buckets.
+    void flushThreadCache(ThreadCache &Cache);
+
+    // Purge pooled slabs idle for longer than Decay and return those idle for
+    // longer than twice Decay to the memory provider.
+    void decay(std::chrono::milliseconds Decay);
+
+    // Apply the decay now, returning all pooled slabs if it is disabled.
+    void trim();
+
+    DisjointPoolThreadCacheStats getThreadCacheStats();
+
+    DisjointPoolStats getStats();
+
+    DisjointPoolConfig getTunedConfig(size_t MaxExtraBuckets);
+
+    // Account for memory allocated from or returned to the memory provider
+    void trackProviderAlloc(size_t Size);
+    void trackProviderFree(size_t Size);
+
+    umf_memory_provider_handle_t getMemHandle(size_t ProviderIdx) {
+        return MemHandles[ProviderIdx];
     }
 
+    // Allocate from the provider chosen by the provider policy for the given
+    // size, or from the others in turn if it fails. ProviderIdx is set to the
+    // provider the memory was obtained from.
+    void *providerAlloc(size_t Size, size_t Alignment, size_t RoutingSize,
+                        size_t &ProviderIdx);
+
+    SlabPageMap &getKnownSlabs() { return KnownSlabs; }
+
     size_t SlabMinSize() { return params.SlabMinSize; };
 
     DisjointPoolConfig &getParams() { return params; }
@@ -328,9 +887,94 @@ class DisjointPool::AllocImpl {
                     size_t &HighPeakSlabsInUse, const std::string &Label);
 
   private:
-    Bucket &findBucket(size_t Size);
+    // Add the counters of thread cache bins to the statistics of the default
+    // buckets, indexed the same way.
+    void addThreadCacheStats(std::vector<DisjointPoolBucketStats> &Stats);
+
+    // Statistics of the default buckets with the shards merged, indexed the
+    // same way as the buckets
+    std::vector<DisjointPoolBucketStats> getDefaultBucketStats();
+
+    // Record the size of an allocation in the size histogram, if enabled and
+    // not full yet.
+    void recordSize(size_t Size);
+
+    static std::atomic<uint64_t> NextPoolId;
+
+    size_t findBucketIdx(size_t Size);
+
+    // Get the buckets of the shard the calling thread is assigned to.
+    BucketList &getShard();
+
+    // Fill List with buckets of slabs with the given alignment, starting from
+    // MinSize. The default buckets also include ExtraBucketSizes.
+    void createBuckets(BucketList &List, size_t MinSize, size_t Alignment);
+
+    // Get the buckets for an alignment larger than ProviderMinPageSize,
+    // creating them if needed.
+    BucketList &getAlignedBuckets(size_t Alignment);
+
+    void purgeThreadMain();
+
+    // Fill the pool with slabs according to the PrewarmSlabs and PrewarmSize
+    // parameters.
+    void prewarm();
+
+    // Index of the provider to try first for the given size
+    size_t firstProvider(size_t RoutingSize);
+
+    // Get a chunk of the bucket, through the thread cache if enabled.
+    void *getChunk(size_t BucketIdx, bool &FromPool, bool &Zeroed);
+
+    // Allocate from the large extent cache or directly from the memory
+    // provider, bypassing the buckets.
+    void *allocateLarge(size_t Size, size_t Alignment, bool &FromPool,
+                        bool &Zeroed);
+
+    // Free an allocation made by allocateLarge.
+    void deallocateLarge(void *Ptr);
+
+    // Return memory removed from a large extent cache to its provider.
+    void releaseExtents(size_t ProviderIdx,
+                        const std::vector<std::pair<void *, size_t>> &Extents);
+
+    // Return entirely free origins of the large extent caches which have been
+    // free since FreeBefore, or as needed to meet the size limit.
+    void releaseLargeCache(std::chrono::steady_clock::time_point FreeBefore);
+
+    // Free a chunk of the slab, through the thread cache if enabled.
+    void freeChunk(void *Ptr, Slab &Slab, bool &ToPool);
+
+    // Get the calling thread's cache for this pool, creating it if needed.
+    ThreadCache &getThreadCache();
 };
 
+std::atomic<uint64_t> DisjointPool::AllocImpl::NextPoolId{1};
+
+// Thread caches of the calling thread, keyed by the id of the pool they
+// belong to. Pool ids are never reused, so an entry left behind by a destroyed
+// pool cannot be mistaken for the cache of a live one.
+static thread_local std::unordered_map<uint64_t,
+                                       std::unique_ptr<ThreadCacheHandle>>
+    ThreadCaches;
+
+// The most recently used entry of ThreadCaches, to skip the map lookup when a
+// thread keeps allocating from the same pool.
+static thread_local uint64_t LastThreadCachePoolId = 0;
+static thread_local ThreadCache *LastThreadCache = nullptr;
+
+// Counters of a thread cache are only modified by the owning thread, and
+// counters of a bucket only with the bucket lock held, so there is no need for
+// an atomic read-modify-write.
+static void addToCounter(std::atomic<size_t> &Counter, size_t Delta) {
+    Counter.store(Counter.load(std::memory_order_relaxed) + Delta,
+                  std::memory_order_relaxed);
+}
+
+static void incrementCounter(std::atomic<size_t> &Counter) {
+    addToCounter(Counter, 1);
+}
+
 static void *memoryProviderAlloc(umf_memory_provider_handle_t hProvider,
                                  size_t size, size_t alignment = 0) {
     void *ptr;
@@ -342,8 +986,8 @@ static void *memoryProviderAlloc(umf_memory_provider_handle_t hProvider,
 }
 
 static void memoryProviderFree(umf_memory_provider_handle_t hProvider,
-                               void *ptr) {
-    auto ret = umfMemoryProviderFree(hProvider, ptr, 0);
+                               void *ptr, size_t size) {
+    auto ret = umfMemoryProviderFree(hProvider, ptr, size);
     if (ret != UMF_RESULT_SUCCESS) {
         throw MemoryProviderError{ret};
     }
@@ -359,13 +1003,31 @@ std::ostream &operator<<(std::ostream &Os, const Slab &Slab) {
     return Os;
 }
 
-Slab::Slab(Bucket &Bkt)
-    : // In case bucket size is not a multiple of SlabMinSize, we would have
+Slab::Slab(Bucket &Bkt, uint64_t *Mask, std::atomic<uint64_t> *DeferredMask,
+           DeferredFreeLink &Link)
+    : FreeChunksMask(Mask),
+      NumMaskWords(getNumMaskWords(Bkt.SlabMinSize(), Bkt.getSize())),
+      DeferredFreeMask(DeferredMask), DeferredLink(Link),
+      // In case bucket size is not a multiple of SlabMinSize, we would have
       // some padding at the end of the slab.
-      Chunks(Bkt.SlabMinSize() / Bkt.getSize()), NumAllocated{0},
-      bucket(Bkt), SlabListIter{}, FirstFreeChunkIdx{0} {
+      NumChunks(Bkt.SlabMinSize() / Bkt.getSize()), NumAllocated{0},
+      bucket(Bkt), FirstFreeWordIdx{0} {
+    // All chunks are free initially
+    std::fill_n(FreeChunksMask, NumMaskWords, ~uint64_t(0));
+    if (NumChunks % 64) {
+        FreeChunksMask[NumMaskWords - 1] =
+            (uint64_t(1) << (NumChunks % 64)) - 1;
+    }
+    for (size_t i = 0; i < NumMaskWords; i++) {
+        new (&DeferredFreeMask[i]) std::atomic<uint64_t>(0);
+    }
+
     auto SlabSize = Bkt.SlabAllocSize();
-    MemPtr = memoryProviderAlloc(Bkt.getMemHandle(), SlabSize);
+    size_t ProviderIdx;
+    MemPtr = Bkt.getAllocCtx().providerAlloc(SlabSize, Bkt.getAlignment(),
+                                             Bkt.getSize(), ProviderIdx);
+    MemHandle = Bkt.getAllocCtx().getMemHandle(ProviderIdx);
+    Bkt.getAllocCtx().trackProviderAlloc(SlabSize);
     regSlab(*this);
 }
 
@@ -376,93 +1038,173 @@ Slab::~Slab() {
         std::cout << "DisjointPool: unexpected error: " << e.what() << "\n";
     }
 
+    bucket.getAllocCtx().trackProviderFree(bucket.SlabAllocSize());
     try {
-        memoryProviderFree(bucket.getMemHandle(), MemPtr);
+        memoryProviderFree(MemHandle, MemPtr, bucket.SlabAllocSize());
     } catch (MemoryProviderError &e) {
         std::cout << "DisjointPool: error from memory provider: " << e.code
                   << "\n";
     }
 }
 
+size_t Slab::getNumMaskWords(size_t SlabMinSize, size_t ChunkSize) {
+    return (SlabMinSize / ChunkSize + 63) / 64;
+}
+
+void SlabList::pushFront(Slab &S) {
+    S.Prev = nullptr;
+    S.Next = Head;
+    if (Head) {
+        Head->Prev = &S;
+    } else {
+        Tail = &S;
+    }
+    Head = &S;
+    ++Count;
+}
+
+void SlabList::pushBack(Slab &S) {
+    S.Prev = Tail;
+    S.Next = nullptr;
+    if (Tail) {
+        Tail->Next = &S;
+    } else {
+        Head = &S;
+    }
+    Tail = &S;
+    ++Count;
+}
+
+void SlabList::remove(Slab &S) {
+    assert(Count > 0 && (S.Prev || Head == &S) && "Slab is not in the list");
+    if (S.Prev) {
+        S.Prev->Next = S.Next;
+    } else {
+        Head = S.Next;
+    }
+    if (S.Next) {
+        S.Next->Prev = S.Prev;
+    } else {
+        Tail = S.Prev;
+    }
+    S.Prev = S.Next = nullptr;
+    --Count;
+}
+
+SlabArena::SlabArena(size_t NumMaskWords)
+    : NumMaskWords(NumMaskWords),
+      RecordSize(LinkSize + SlabSize +
+                 NumMaskWords *
+                     (sizeof(uint64_t) + sizeof(std::atomic<uint64_t>))),
+      // Blocks of about a page, unless a single record is larger
+      RecordsPerBlock(std::max<size_t>(4096 / RecordSize, 1)),
+      NumUsedInBlock(RecordsPerBlock) {}
+
+void *SlabArena::allocate() {
+    if (FreeList) {
+        void *Record = FreeList;
+        FreeList = *static_cast<void **>(Record);
+        return Record;
+    }
+
+    if (NumUsedInBlock == RecordsPerBlock) {
+        Blocks.emplace_back(new char[RecordSize * RecordsPerBlock]);
+        NumUsedInBlock = 0;
+    }
+    return Blocks.back().get() + RecordSize * NumUsedInBlock++;
+}
+
+void SlabArena::deallocate(void *Record) {
+    *static_cast<void **>(Record) = FreeList;
+    FreeList = Record;
+}
+
+DeferredFreeLink *SlabArena::getLink(void *Record) {
+    return static_cast<DeferredFreeLink *>(Record);
+}
+
+Slab *SlabArena::getSlab(void *Record) {
+    return reinterpret_cast<Slab *>(static_cast<char *>(Record) + LinkSize);
+}
+
+uint64_t *SlabArena::getMask(void *Record) {
+    return reinterpret_cast<uint64_t *>(static_cast<char *>(Record) +
+                                        LinkSize + SlabSize);
+}
+
+std::atomic<uint64_t> *SlabArena::getDeferredMask(void *Record) const {
+    return reinterpret_cast<std::atomic<uint64_t> *>(getMask(Record) +
+                                                     NumMaskWords);
+}
+
+void *SlabArena::getRecord(Slab *S) {
+    return reinterpret_cast<char *>(S) - LinkSize;
+}
+
 // Return the index of the first available chunk, SIZE_MAX otherwise
 size_t Slab::FindFirstAvailableChunkIdx() const {
-    // Use the first free chunk index as a hint for the search.
-    auto It = std::find_if(Chunks.begin() + FirstFreeChunkIdx, Chunks.end(),
-                           [](auto x) { return !x; });
-    if (It != Chunks.end()) {
-        return It - Chunks.begin();
+    // Use the first free word index as a hint for the search and skip
+    // 64 allocated chunks at a time.
+    for (size_t WordIdx = FirstFreeWordIdx; WordIdx < NumMaskWords; ++WordIdx) {
+        if (FreeChunksMask[WordIdx]) {
+            return WordIdx * 64 +
+                   getRightmostSetBitPos(FreeChunksMask[WordIdx]);
+        }
     }
 
     return std::numeric_limits<size_t>::max();
 }
 
-void *Slab::getChunk() {
+bool Slab::takeChunkZeroed(size_t ChunkIdx) {
+    bool Zeroed = ChunkIdx >= NumChunksUsed &&
+                  bucket.getAllocCtx().getParams().ZeroedProviderMemory;
+    NumChunksUsed = std::max(NumChunksUsed, ChunkIdx + 1);
+    return Zeroed;
+}
+
+void *Slab::getChunk(bool &Zeroed) {
     // assert(NumAllocated != Chunks.size());
 
     const size_t ChunkIdx = FindFirstAvailableChunkIdx();
     // Free chunk must exist, otherwise we would have allocated another slab
     assert(ChunkIdx != (std::numeric_limits<size_t>::max()));
 
+    Zeroed = takeChunkZeroed(ChunkIdx);
+
     void *const FreeChunk =
         (static_cast<uint8_t *>(getPtr())) + ChunkIdx * getChunkSize();
-    Chunks[ChunkIdx] = true;
+    FreeChunksMask[ChunkIdx / 64] &= ~(uint64_t(1) << (ChunkIdx % 64));
     NumAllocated += 1;
 
-    // Use the found index as the next hint
-    FirstFreeChunkIdx = ChunkIdx;
+    // Use the word of the found index as the next hint
+    FirstFreeWordIdx = ChunkIdx / 64;
 
     return FreeChunk;
 }
 
-void *Slab::getSlab() { return getPtr(); }
+void *Slab::getSlab(bool &Zeroed) {
+    // The whole slab is treated as its only chunk
+    Zeroed = takeChunkZeroed(0);
+    return getPtr();
+}
+
+void *Slab::getChunkStart(void *Ptr) const {
+    auto ChunkIdx = (static_cast<char *>(Ptr) - static_cast<char *>(MemPtr)) /
+                    getChunkSize();
+    return static_cast<char *>(MemPtr) + ChunkIdx * getChunkSize();
+}
 
 Bucket &Slab::getBucket() { return bucket; }
 const Bucket &Slab::getBucket() const { return bucket; }
 
 size_t Slab::getChunkSize() const { return bucket.getSize(); }
 
-void Slab::regSlabByAddr(void *Addr, Slab &Slab) {
-    auto &Lock = Slab.getBucket().getAllocCtx().getKnownSlabsMapLock();
-    auto &Map = Slab.getBucket().getAllocCtx().getKnownSlabs();
-
-    std::lock_guard<std::shared_timed_mutex> Lg(Lock);
-    Map.insert({Addr, Slab});
-}
-
-void Slab::unregSlabByAddr(void *Addr, Slab &Slab) {
-    auto &Lock = Slab.getBucket().getAllocCtx().getKnownSlabsMapLock();
-    auto &Map = Slab.getBucket().getAllocCtx().getKnownSlabs();
-
-    std::lock_guard<std::shared_timed_mutex> Lg(Lock);
-
-    auto Slabs = Map.equal_range(Addr);
-    // At least the must get the current slab from the map.
-    assert(Slabs.first != Slabs.second && "Slab is not found");
-
-    for (auto It = Slabs.first; It != Slabs.second; ++It) {
-        if (It->second == Slab) {
-            Map.erase(It);
-            return;
-        }
-    }
-
-    assert(false && "Slab is not found");
-}
-
 void Slab::regSlab(Slab &Slab) {
-    void *StartAddr = AlignPtrDown(Slab.getPtr(), bucket.SlabMinSize());
-    void *EndAddr = static_cast<char *>(StartAddr) + bucket.SlabMinSize();
-
-    regSlabByAddr(StartAddr, Slab);
-    regSlabByAddr(EndAddr, Slab);
+    Slab.getBucket().getAllocCtx().getKnownSlabs().insert(Slab);
 }
 
 void Slab::unregSlab(Slab &Slab) {
-    void *StartAddr = AlignPtrDown(Slab.getPtr(), bucket.SlabMinSize());
-    void *EndAddr = static_cast<char *>(StartAddr) + bucket.SlabMinSize();
-
-    unregSlabByAddr(StartAddr, Slab);
-    unregSlabByAddr(EndAddr, Slab);
+    Slab.getBucket().getAllocCtx().getKnownSlabs().remove(Slab);
 }
 
 void Slab::freeChunk(void *Ptr) {
@@ -478,83 +1220,434 @@ void Slab::freeChunk(void *Ptr) {
                     getChunkSize();
 
     // Make sure that the chunk was allocated
-    assert(Chunks[ChunkIdx] && "double free detected");
+    assert(!(FreeChunksMask[ChunkIdx / 64] &
+             (uint64_t(1) << (ChunkIdx % 64))) &&
+           "double free detected");
 
-    Chunks[ChunkIdx] = false;
+    FreeChunksMask[ChunkIdx / 64] |= uint64_t(1) << (ChunkIdx % 64);
     NumAllocated -= 1;
 
-    if (ChunkIdx < FirstFreeChunkIdx) {
-        FirstFreeChunkIdx = ChunkIdx;
+    if (ChunkIdx / 64 < FirstFreeWordIdx) {
+        FirstFreeWordIdx = ChunkIdx / 64;
     }
 }
 
-void *Slab::getEnd() const {
-    return static_cast<char *>(getPtr()) + bucket.SlabMinSize();
-}
-
-bool Slab::hasAvail() { return NumAllocated != getNumChunks(); }
+void Slab::deferFreeChunk(void *Ptr) {
+    assert(Ptr >= getPtr() && Ptr < getEnd());
+    auto ChunkIdx = (static_cast<char *>(Ptr) - static_cast<char *>(MemPtr)) /
+                    getChunkSize();
 
-// If a slab was available in the pool then note that the current pooled
-// size has reduced by the size of a slab in this bucket.
-void Bucket::decrementPool(bool &FromPool) {
-    FromPool = true;
-    updateStats(1, -1);
-    OwnAllocCtx.getParams().limits->TotalSize -= SlabAllocSize();
+    // Release, so that the owner applying the free sees the chunk is no
+    // longer accessed by this thread.
+    auto Old = DeferredFreeMask[ChunkIdx / 64].fetch_or(
+        uint64_t(1) << (ChunkIdx % 64), std::memory_order_release);
+    (void)Old;
+    assert(!(Old & (uint64_t(1) << (ChunkIdx % 64))) && "double free detected");
 }
 
-auto Bucket::getAvailFullSlab(bool &FromPool)
-    -> decltype(AvailableSlabs.begin()) {
-    // Return a slab that will be used for a single allocation.
-    if (AvailableSlabs.size() == 0) {
-        auto It = AvailableSlabs.insert(AvailableSlabs.begin(),
-                                        std::make_unique<Slab>(*this));
-        (*It)->setIterator(It);
-        FromPool = false;
-        updateStats(1, 0);
-    } else {
-        decrementPool(FromPool);
+uint64_t Slab::takeDeferredFrees(size_t WordIdx) {
+    if (!DeferredFreeMask[WordIdx].load(std::memory_order_relaxed)) {
+        return 0;
     }
+    return DeferredFreeMask[WordIdx].exchange(0, std::memory_order_acquire);
+}
 
-    return AvailableSlabs.begin();
+void Slab::setPooled() {
+    Purged = false;
+    if (bucket.getAllocCtx().getParams().PurgeDecayMs) {
+        PooledSince = std::chrono::steady_clock::now();
+    }
 }
 
-void *Bucket::getSlab(bool &FromPool) {
-    std::lock_guard<std::mutex> Lg(BucketLock);
+bool Slab::decay(std::chrono::steady_clock::time_point Now,
+                 std::chrono::milliseconds Decay) {
+    auto Idle = Now - PooledSince;
+    if (!Decay.count() || Idle >= 2 * Decay) {
+        return true;
+    }
 
-    auto SlabIt = getAvailFullSlab(FromPool);
-    auto *FreeSlab = (*SlabIt)->getSlab();
-    auto It =
-        UnavailableSlabs.insert(UnavailableSlabs.begin(), std::move(*SlabIt));
-    AvailableSlabs.erase(SlabIt);
-    (*It)->setIterator(It);
-    return FreeSlab;
+    if (!Purged && Idle >= Decay) {
+        // Purging is only a hint, the slab stays usable even if it fails.
+        umfMemoryProviderPurgeLazy(MemHandle, getPtr(), bucket.SlabAllocSize());
+        Purged = true;
+    }
+    return false;
+}
+
+void *Slab::getEnd() const {
+    return static_cast<char *>(getPtr()) + bucket.SlabMinSize();
+}
+
+bool Slab::hasAvail() { return NumAllocated != getNumChunks(); }
+
+SlabPageMap::SlabPageMap(size_t PageSize)
+    : PageShift(getLeftmostSetBitPos(PageSize)),
+      NumLevels(std::max<size_t>(
+          (64 - PageShift - LeafBits + NodeBits - 1) / NodeBits, 1)) {
+    assert((PageSize & (PageSize - 1)) == 0 &&
+           "SlabMinSize must be a power of 2");
+}
+
+SlabPageMap::~SlabPageMap() { freeNode(&Root, NumLevels); }
+
+void SlabPageMap::freeNode(Node *N, size_t Level) {
+    for (auto &Child : N->Children) {
+        void *Ptr = Child.load(std::memory_order_relaxed);
+        if (!Ptr) {
+            continue;
+        }
+
+        if (Level > 1) {
+            freeNode(static_cast<Node *>(Ptr), Level - 1);
+            delete static_cast<Node *>(Ptr);
+        } else {
+            delete static_cast<Leaf *>(Ptr);
+        }
+    }
+}
+
+SlabPageMap::PageEntry *SlabPageMap::getPage(uintptr_t PageIdx, bool Create) {
+    Node *N = &Root;
+    for (size_t Level = NumLevels; Level > 0; --Level) {
+        auto Shift = LeafBits + (Level - 1) * NodeBits;
+        auto &Child = N->Children[(PageIdx >> Shift) &
+                                  (((size_t)1 << NodeBits) - 1)];
+
+        void *Next = Child.load(std::memory_order_acquire);
+        if (!Next) {
+            if (!Create) {
+                return nullptr;
+            }
+
+            // Another thread may be creating the same node, the loser of the
+            // race frees its copy and uses the winner's one.
+            void *NewNode = Level > 1 ? static_cast<void *>(new Node())
+                                      : static_cast<void *>(new Leaf());
+            if (Child.compare_exchange_strong(Next, NewNode,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+                Next = NewNode;
+            } else if (Level > 1) {
+                delete static_cast<Node *>(NewNode);
+            } else {
+                delete static_cast<Leaf *>(NewNode);
+            }
+        }
+
+        if (Level == 1) {
+            return &static_cast<Leaf *>(Next)
+                        ->Pages[PageIdx & (((size_t)1 << LeafBits) - 1)];
+        }
+        N = static_cast<Node *>(Next);
+    }
+
+    assert(false && "unreachable");
+    return nullptr;
+}
+
+void SlabPageMap::setEntry(Entry &E, Slab *S, uintptr_t Begin) {
+    // The owner has to be visible before the range which lookups match on.
+    if (Begin) {
+        E.Owner.store(S, std::memory_order_relaxed);
+        E.Begin.store(Begin, std::memory_order_release);
+    } else {
+        E.Begin.store(0, std::memory_order_release);
+        E.Owner.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void SlabPageMap::insert(Slab &S) {
+    auto Begin = reinterpret_cast<uintptr_t>(S.getPtr());
+    auto PageIdx = Begin >> PageShift;
+
+    auto &Head = getPage(PageIdx, true)->Head;
+    assert(Head.Begin.load() == 0 && "Slab already registered");
+    setEntry(Head, &S, Begin);
+
+    // Unless the slab starts at the page boundary, it extends into the next
+    // page
+    if (Begin & (((uintptr_t)1 << PageShift) - 1)) {
+        auto &Tail = getPage(PageIdx + 1, true)->Tail;
+        assert(Tail.Begin.load() == 0 && "Slab already registered");
+        setEntry(Tail, &S, Begin);
+    }
+}
+
+void SlabPageMap::remove(Slab &S) {
+    auto Begin = reinterpret_cast<uintptr_t>(S.getPtr());
+    auto PageIdx = Begin >> PageShift;
+
+    auto &Head = getPage(PageIdx, false)->Head;
+    assert(Head.Owner.load() == &S && "Slab is not found");
+    setEntry(Head, nullptr, 0);
+
+    if (Begin & (((uintptr_t)1 << PageShift) - 1)) {
+        auto &Tail = getPage(PageIdx + 1, false)->Tail;
+        assert(Tail.Owner.load() == &S && "Slab is not found");
+        setEntry(Tail, nullptr, 0);
+    }
+}
+
+Slab *SlabPageMap::find(void *Ptr) {
+    auto Addr = reinterpret_cast<uintptr_t>(Ptr);
+    auto *Page = getPage(Addr >> PageShift, false);
+    if (!Page) {
+        return nullptr;
+    }
+
+    // An entry may concurrently change only if it belongs to a different
+    // slab than the one containing Ptr, whose range never contains Ptr.
+    // So once the range matches, the owner is the slab containing Ptr and it
+    // cannot go away while Ptr is still allocated.
+    for (auto *E : {&Page->Head, &Page->Tail}) {
+        auto Begin = E->Begin.load(std::memory_order_acquire);
+        if (Begin && Addr >= Begin && Addr - Begin < ((size_t)1 << PageShift)) {
+            return E->Owner.load(std::memory_order_relaxed);
+        }
+    }
+
+    return nullptr;
+}
+
+std::map<uintptr_t, LargeExtentCache::Origin>::iterator
+LargeExtentCache::findOrigin(uintptr_t Addr) {
+    auto It = Origins.upper_bound(Addr);
+    assert(It != Origins.begin() && "Origin is not found");
+    --It;
+    assert(Addr - It->first < It->second.Size && "Origin is not found");
+    return It;
+}
+
+void LargeExtentCache::insertFree(uintptr_t Begin, size_t Size) {
+    FreeByAddr.emplace(Begin, Size);
+    FreeBySize.emplace(Size, Begin);
+    CachedBytes += Size;
+}
+
+void LargeExtentCache::eraseFree(std::map<uintptr_t, size_t>::iterator It) {
+    FreeBySize.erase({It->second, It->first});
+    CachedBytes -= It->second;
+    FreeByAddr.erase(It);
+}
+
+void LargeExtentCache::addOrigin(void *Ptr, size_t Size) {
+    Origins.emplace(reinterpret_cast<uintptr_t>(Ptr),
+                    Origin{Size, 0, Clock::time_point{}, IdleOrigins.end()});
+}
+
+void *LargeExtentCache::get(size_t Size, size_t Alignment) {
+    if (Alignment == 0) {
+        Alignment = 1;
+    }
+
+    // Best fit: the smallest extent which can hold an aligned range of Size.
+    // Neither the extent nor its origin may be larger than twice the size,
+    // so that a small allocation cannot pin a much larger origin.
+    size_t MaxOriginSize = Size <= std::numeric_limits<size_t>::max() / 2
+                               ? 2 * Size
+                               : std::numeric_limits<size_t>::max();
+    auto Last = FreeBySize.upper_bound(
+        {MaxOriginSize, std::numeric_limits<uintptr_t>::max()});
+    for (auto It = FreeBySize.lower_bound({Size, 0}); It != Last; ++It) {
+        auto [ExtentSize, Begin] = *It;
+        auto AlignedBegin = AlignUp(Begin, Alignment);
+        if (AlignedBegin - Begin + Size > ExtentSize) {
+            continue;
+        }
+
+        auto &Org = findOrigin(Begin)->second;
+        if (Org.Size > MaxOriginSize) {
+            continue;
+        }
+
+        if (Org.FreeBytes == Org.Size) {
+            IdleOrigins.erase(Org.IdleIt);
+            Org.IdleIt = IdleOrigins.end();
+            IdleBytes -= Org.Size;
+        }
+
+        eraseFree(FreeByAddr.find(Begin));
+        if (AlignedBegin > Begin) {
+            insertFree(Begin, AlignedBegin - Begin);
+        }
+        auto End = Begin + ExtentSize;
+        if (AlignedBegin + Size < End) {
+            insertFree(AlignedBegin + Size, End - AlignedBegin - Size);
+        }
+
+        Org.FreeBytes -= Size;
+        return reinterpret_cast<void *>(AlignedBegin);
+    }
+
+    return nullptr;
+}
+
+void LargeExtentCache::put(void *Ptr, size_t Size) {
+    auto Begin = reinterpret_cast<uintptr_t>(Ptr);
+    auto OriginIt = findOrigin(Begin);
+    auto OriginBegin = OriginIt->first;
+    auto &Org = OriginIt->second;
+    Org.FreeBytes += Size;
+
+    // Merge with the free neighbours within the same origin
+    auto Next = FreeByAddr.lower_bound(Begin);
+    if (Next != FreeByAddr.end() && Next->first == Begin + Size &&
+        Next->first < OriginBegin + Org.Size) {
+        Size += Next->second;
+        Next = std::next(Next);
+        eraseFree(std::prev(Next));
+    }
+
+    if (Next != FreeByAddr.begin()) {
+        auto Prev = std::prev(Next);
+        if (Prev->first >= OriginBegin && Prev->first + Prev->second == Begin) {
+            Begin = Prev->first;
+            Size += Prev->second;
+            eraseFree(Prev);
+        }
+    }
+
+    insertFree(Begin, Size);
+    if (Org.FreeBytes == Org.Size) {
+        Org.FreeSince = Clock::now();
+        Org.IdleIt = IdleOrigins.insert(IdleOrigins.end(), OriginBegin);
+        IdleBytes += Org.Size;
+    }
+}
+
+void LargeExtentCache::release(
+    size_t MaxBytes, Clock::time_point FreeBefore,
+    std::vector<std::pair<void *, size_t>> &Released) {
+    // Origins become idle in the order of FreeSince
+    while (!IdleOrigins.empty()) {
+        auto It = Origins.find(IdleOrigins.front());
+        if (It->second.FreeSince > FreeBefore && IdleBytes <= MaxBytes) {
+            break;
+        }
+
+        IdleOrigins.pop_front();
+        IdleBytes -= It->second.Size;
+        eraseFree(FreeByAddr.find(It->first));
+        Released.emplace_back(reinterpret_cast<void *>(It->first),
+                              It->second.Size);
+        Origins.erase(It);
+    }
+}
+
+// If a slab was available in the pool then note that the current pooled
+// size has reduced by the size of a slab in this bucket.
+void Bucket::decrementPool(bool &FromPool) {
+    FromPool = true;
+    updateStats(1, -1);
+    OwnAllocCtx.getParams().limits->TotalSize -= SlabAllocSize();
+}
+
+// Capacity of the buckets of the given size
+static size_t getBucketCapacity(const DisjointPoolConfig &Params, size_t Size) {
+    auto It = Params.BucketCapacities.find(Size);
+    if (It != Params.BucketCapacities.end()) {
+        return It->second;
+    }
+
+    // For buckets used in chunked mode, just one slab in pool is sufficient.
+    // For larger buckets, the capacity could be more and is adjustable.
+    return Size <= Params.SlabMinSize / 2 ? 1 : Params.Capacity;
+}
+
+Bucket::Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx, size_t Align)
+    : Size{Sz}, Alignment{Align},
+      SlabCapacity(getBucketCapacity(AllocCtx.getParams(), Sz)),
+      Arena(Slab::getNumMaskWords(AllocCtx.SlabMinSize(), Sz)),
+      OwnAllocCtx{AllocCtx},
+      chunkedSlabsInPool(0) {}
+
+Bucket::~Bucket() {
+    for (auto *List : {&AvailableSlabs, &UnavailableSlabs}) {
+        while (auto *S = List->front()) {
+            List->remove(*S);
+            destroySlab(*S);
+        }
+    }
+}
+
+Slab &Bucket::createSlab() {
+    void *Record = Arena.allocate();
+    auto *Link = new (SlabArena::getLink(Record)) DeferredFreeLink();
+    try {
+        return *new (SlabArena::getSlab(Record))
+            Slab(*this, SlabArena::getMask(Record),
+                 Arena.getDeferredMask(Record), *Link);
+    } catch (...) {
+        Arena.deallocate(Record);
+        throw;
+    }
+}
+
+void Bucket::destroySlab(Slab &S) {
+    auto &Link = S.getDeferredLink();
+    S.~Slab();
+
+    // An empty slab cannot have frees in progress: the state is only reset
+    // to Idle once they are done. If the slab is still linked, its record is
+    // released when the list is processed.
+    if (Link.State.load(std::memory_order_relaxed) != DeferredFreeLink::Idle) {
+        Link.State.store(DeferredFreeLink::Dead, std::memory_order_relaxed);
+        return;
+    }
+    Arena.deallocate(SlabArena::getRecord(&Link));
+}
+
+Slab &Bucket::getAvailFullSlab(bool &FromPool) {
+    // Return a slab that will be used for a single allocation.
+    if (AvailableSlabs.empty()) {
+        AvailableSlabs.pushFront(createSlab());
+        FromPool = false;
+        updateStats(1, 0);
+    } else {
+        decrementPool(FromPool);
+    }
+
+    return *AvailableSlabs.front();
+}
+
+void *Bucket::getSlab(bool &FromPool, bool &Zeroed) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+
+    auto &FullSlab = getAvailFullSlab(FromPool);
+    auto *FreeSlab = FullSlab.getSlab(Zeroed);
+    countAlloc(FromPool);
+    incrementCounter(chunksInUse);
+    AvailableSlabs.remove(FullSlab);
+    UnavailableSlabs.pushFront(FullSlab);
+    return FreeSlab;
 }
 
 void Bucket::freeSlab(Slab &Slab, bool &ToPool) {
     std::lock_guard<std::mutex> Lg(BucketLock);
-    auto SlabIter = Slab.getIterator();
-    assert(SlabIter != UnavailableSlabs.end());
+    countFree();
+    addToCounter(chunksInUse, -1);
+    onFreeSlab(Slab, ToPool);
+}
+
+void Bucket::onFreeSlab(Slab &Slab, bool &ToPool) {
+    UnavailableSlabs.remove(Slab);
     if (CanPool(ToPool)) {
-        auto It =
-            AvailableSlabs.insert(AvailableSlabs.begin(), std::move(*SlabIter));
-        UnavailableSlabs.erase(SlabIter);
-        (*It)->setIterator(It);
+        AvailableSlabs.pushFront(Slab);
+        Slab.setPooled();
     } else {
-        UnavailableSlabs.erase(SlabIter);
+        destroySlab(Slab);
     }
 }
 
-auto Bucket::getAvailSlab(bool &FromPool) -> decltype(AvailableSlabs.begin()) {
+Slab &Bucket::getAvailSlab(bool &FromPool) {
 
-    if (AvailableSlabs.size() == 0) {
-        auto It = AvailableSlabs.insert(AvailableSlabs.begin(),
-                                        std::make_unique<Slab>(*this));
-        (*It)->setIterator(It);
+    if (AvailableSlabs.empty()) {
+        AvailableSlabs.pushFront(createSlab());
 
         updateStats(1, 0);
         FromPool = false;
     } else {
-        if ((*(AvailableSlabs.begin()))->getNumAllocated() == 0) {
+        if (AvailableSlabs.front()->getNumAllocated() == 0) {
             // If this was an empty slab, it was in the pool.
             // Now it is no longer in the pool, so update count.
             --chunkedSlabsInPool;
@@ -565,328 +1658,1459 @@ auto Bucket::getAvailSlab(bool &FromPool) -> decltype(AvailableSlabs.begin()) {
         }
     }
 
-    return AvailableSlabs.begin();
+    return *AvailableSlabs.front();
+}
+
+void *Bucket::getChunk(bool &FromPool, bool &Zeroed) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    applyDeferredFrees();
+
+    auto &AvailSlab = getAvailSlab(FromPool);
+    auto *FreeChunk = AvailSlab.getChunk(Zeroed);
+    countAlloc(FromPool);
+    incrementCounter(chunksInUse);
+
+    // If the slab is full, move it to unavailable slabs
+    if (!AvailSlab.hasAvail()) {
+        AvailableSlabs.remove(AvailSlab);
+        UnavailableSlabs.pushFront(AvailSlab);
+    }
+
+    return FreeChunk;
+}
+
+void Bucket::getChunks(std::vector<CachedChunk> &Chunks, size_t Count,
+                       bool &FromPool) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    applyDeferredFrees();
+
+    size_t Initial = Chunks.size();
+    for (size_t i = 0; i < Count; i++) {
+        bool FromPoolChunk;
+        Slab *AvailSlab;
+        try {
+            AvailSlab = &getAvailSlab(FromPoolChunk);
+        } catch (MemoryProviderError &) {
+            // Return what we have got so far, if anything.
+            if (Chunks.size() > Initial) {
+                break;
+            }
+            throw;
+        }
+
+        if (i == 0) {
+            FromPool = FromPoolChunk;
+        }
+
+        bool Zeroed;
+        auto *Chunk = AvailSlab->getChunk(Zeroed);
+        Chunks.push_back({Chunk, AvailSlab, Zeroed});
+        incrementCounter(chunksInUse);
+
+        if (!AvailSlab->hasAvail()) {
+            AvailableSlabs.remove(*AvailSlab);
+            UnavailableSlabs.pushFront(*AvailSlab);
+        }
+    }
+}
+
+void Bucket::freeChunk(void *Ptr, Slab &Slab, bool &ToPool) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+
+    Slab.freeChunk(Ptr);
+    countFree();
+    addToCounter(chunksInUse, -1);
+
+    onFreeChunk(Slab, ToPool);
+}
+
+void Bucket::freeChunks(const CachedChunk *Chunks, size_t Count) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+
+    for (size_t i = 0; i < Count; i++) {
+        bool ToPool;
+        Chunks[i].Owner->freeChunk(Chunks[i].Ptr);
+        onFreeChunk(*Chunks[i].Owner, ToPool);
+    }
+    addToCounter(chunksInUse, -Count);
+}
+
+size_t Bucket::allocateBatch(void **Ptrs, size_t Count) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    applyDeferredFrees();
+
+    bool Chunked = getSize() <= ChunkCutOff();
+    size_t Allocated = 0;
+    try {
+        for (; Allocated < Count; Allocated++) {
+            bool FromPool;
+            bool Zeroed;
+            if (Chunked) {
+                auto &AvailSlab = getAvailSlab(FromPool);
+                Ptrs[Allocated] = AvailSlab.getChunk(Zeroed);
+                if (!AvailSlab.hasAvail()) {
+                    AvailableSlabs.remove(AvailSlab);
+                    UnavailableSlabs.pushFront(AvailSlab);
+                }
+            } else {
+                auto &FullSlab = getAvailFullSlab(FromPool);
+                Ptrs[Allocated] = FullSlab.getSlab(Zeroed);
+                AvailableSlabs.remove(FullSlab);
+                UnavailableSlabs.pushFront(FullSlab);
+            }
+            countAlloc(FromPool);
+            incrementCounter(chunksInUse);
+        }
+    } catch (MemoryProviderError &e) {
+        umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+    }
+    return Allocated;
+}
+
+void Bucket::freeBatch(const CachedChunk *Allocs, size_t Count) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+
+    bool Chunked = getSize() <= ChunkCutOff();
+    for (size_t i = 0; i < Count; i++) {
+        bool ToPool;
+        if (Chunked) {
+            Allocs[i].Owner->freeChunk(Allocs[i].Ptr);
+            onFreeChunk(*Allocs[i].Owner, ToPool);
+        } else {
+            onFreeSlab(*Allocs[i].Owner, ToPool);
+        }
+    }
+    addToCounter(freeCount, Count);
+    addToCounter(chunksInUse, -Count);
+}
+
+void Bucket::freeChunkDeferred(void *Ptr, Slab &Slab) {
+    auto &Link = Slab.getDeferredLink();
+
+    // The slab is linked before the chunk is marked as freed. Until then the
+    // chunk keeps the slab from becoming empty, so it cannot be destroyed
+    // while the link is being pushed. The free stays pending until the chunk
+    // is marked, so that the owner neither resets the state and scans the
+    // marks in between nor releases the record of a destroyed slab.
+    Link.Pending.fetch_add(1);
+    if (Link.State.exchange(DeferredFreeLink::Queued) ==
+        DeferredFreeLink::Idle) {
+        Link.Next = DeferredFreeSlabs.load(std::memory_order_relaxed);
+        while (!DeferredFreeSlabs.compare_exchange_weak(
+            Link.Next, &Link, std::memory_order_release,
+            std::memory_order_relaxed)) {
+        }
+    }
+
+    Slab.deferFreeChunk(Ptr);
+    Link.Pending.fetch_sub(1, std::memory_order_release);
+}
+
+void Bucket::applyDeferredFrees() {
+    if (!DeferredFreeSlabs.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    auto *Link = DeferredFreeSlabs.exchange(nullptr, std::memory_order_acquire);
+    while (Link) {
+        // The link may be pushed again as soon as its state is reset
+        auto *Next = Link->Next;
+        if (Link->State.load(std::memory_order_relaxed) ==
+            DeferredFreeLink::Dead) {
+            Link->waitPendingFrees();
+            Arena.deallocate(SlabArena::getRecord(Link));
+            Link = Next;
+            continue;
+        }
+
+        // Frees which find the state reset link the slab again. Those which
+        // found it queued are marked once they are no longer pending.
+        Link->State.store(DeferredFreeLink::Idle);
+        Link->waitPendingFrees();
+
+        auto &S = *SlabArena::getSlab(SlabArena::getRecord(Link));
+        auto *Base = static_cast<char *>(S.getPtr());
+        bool Destroyed = false;
+        for (size_t WordIdx = 0; WordIdx < S.getNumMaskWords() && !Destroyed;
+             WordIdx++) {
+            for (auto Bits = S.takeDeferredFrees(WordIdx); Bits;
+                 Bits &= Bits - 1) {
+                auto ChunkIdx = WordIdx * 64 + getRightmostSetBitPos(Bits);
+                S.freeChunk(Base + ChunkIdx * getSize());
+                countFree();
+                addToCounter(chunksInUse, -1);
+
+                // The slab may only be destroyed once no chunk of it is
+                // allocated, so there are no more deferred frees to apply.
+                bool ToPool;
+                Destroyed = S.getNumAllocated() == 0;
+                onFreeChunk(S, ToPool);
+            }
+        }
+        Link = Next;
+    }
+}
+
+bool Bucket::prewarm() {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+
+    // Do not allocate a slab which would be returned right away
+    bool chunkedBucket = getSize() <= ChunkCutOff();
+    size_t SlabsInPool =
+        chunkedBucket ? chunkedSlabsInPool : AvailableSlabs.size();
+    if (SlabsInPool >= Capacity()) {
+        return false;
+    }
+
+    auto &NewSlab = createSlab();
+    updateStats(1, 0);
+
+    bool ToPool;
+    if (!CanPool(ToPool)) {
+        destroySlab(NewSlab);
+        return false;
+    }
+
+    AvailableSlabs.pushBack(NewSlab);
+    NewSlab.setPooled();
+    return true;
+}
+
+// Return cached chunks to the buckets owning their slabs, which differ for
+// chunks of different shards. Consecutive chunks of the same bucket are freed
+// under a single lock.
+static void freeCachedChunks(const CachedChunk *Chunks, size_t Count) {
+    size_t Begin = 0;
+    for (size_t i = 1; i <= Count; i++) {
+        auto &Owner = Chunks[Begin].Owner->getBucket();
+        if (i == Count || &Chunks[i].Owner->getBucket() != &Owner) {
+            Owner.freeChunks(Chunks + Begin, i - Begin);
+            Begin = i;
+        }
+    }
+}
+
+// The lock must be acquired before calling this method
+void Bucket::onFreeChunk(Slab &Slab, bool &ToPool) {
+    ToPool = true;
+
+    // In case if the slab was previously full and now has 1 available
+    // chunk, it should be moved to the list of available slabs
+    if (Slab.getNumAllocated() == (Slab.getNumChunks() - 1)) {
+        UnavailableSlabs.remove(Slab);
+        AvailableSlabs.pushFront(Slab);
+    }
+
+    // Check if slab is empty, and pool it if we can.
+    if (Slab.getNumAllocated() == 0) {
+        // The slab is now empty.
+        // If pool has capacity then put the slab in the pool.
+        // The ToPool parameter indicates whether the Slab will be put in the
+        // pool or freed.
+        if (!CanPool(ToPool)) {
+            AvailableSlabs.remove(Slab);
+            destroySlab(Slab);
+        } else {
+            Slab.setPooled();
+        }
+    }
+}
+
+void Bucket::decay(std::chrono::steady_clock::time_point Now,
+                   std::chrono::milliseconds Decay) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    applyDeferredFrees();
+
+    // All slabs of a chunked bucket which are entirely free are in the pool,
+    // for other buckets all available slabs are.
+    bool chunkedBucket = getSize() <= ChunkCutOff();
+    for (auto *S = AvailableSlabs.front(); S;) {
+        auto *Next = S->getNext();
+        if ((chunkedBucket && S->getNumAllocated() != 0) ||
+            !S->decay(Now, Decay)) {
+            S = Next;
+            continue;
+        }
+
+        if (chunkedBucket) {
+            --chunkedSlabsInPool;
+        }
+        updateStats(0, -1);
+        OwnAllocCtx.getParams().limits->TotalSize -= SlabAllocSize();
+        AvailableSlabs.remove(*S);
+        destroySlab(*S);
+        S = Next;
+    }
+}
+
+bool Bucket::CanPool(bool &ToPool) {
+    size_t NewFreeSlabsInBucket;
+    // Check if this bucket is used in chunked form or as full slabs.
+    bool chunkedBucket = getSize() <= ChunkCutOff();
+    if (chunkedBucket) {
+        NewFreeSlabsInBucket = chunkedSlabsInPool + 1;
+    } else {
+        NewFreeSlabsInBucket = AvailableSlabs.size() + 1;
+    }
+    if (Capacity() >= NewFreeSlabsInBucket) {
+        size_t PoolSize = OwnAllocCtx.getParams().limits->TotalSize;
+        while (true) {
+            size_t NewPoolSize = PoolSize + SlabAllocSize();
+
+            if (OwnAllocCtx.getParams().limits->MaxSize < NewPoolSize) {
+                break;
+            }
+
+            if (OwnAllocCtx.getParams()
+                    .limits->TotalSize.compare_exchange_strong(PoolSize,
+                                                               NewPoolSize)) {
+                if (chunkedBucket) {
+                    ++chunkedSlabsInPool;
+                }
+
+                updateStats(-1, 1);
+                ToPool = true;
+                return true;
+            }
+        }
+    }
+
+    updateStats(-1, 0);
+    ToPool = false;
+    return false;
+}
+
+size_t Bucket::SlabMinSize() { return OwnAllocCtx.getParams().SlabMinSize; }
+
+size_t Bucket::SlabAllocSize() { return std::max(getSize(), SlabMinSize()); }
+
+size_t Bucket::Capacity() { return SlabCapacity; }
+
+size_t Bucket::MaxPoolableSize() {
+    return OwnAllocCtx.getParams().MaxPoolableSize;
+}
+
+size_t Bucket::ChunkCutOff() { return SlabMinSize() / 2; }
+
+void Bucket::countAlloc(bool FromPool) {
+    incrementCounter(allocCount);
+    if (FromPool) {
+        incrementCounter(allocPoolCount);
+    }
+}
+
+void Bucket::countFree() { incrementCounter(freeCount); }
+
+void Bucket::updateStats(int InUse, int InPool) {
+    addToCounter(currSlabsInUse, InUse);
+    addToCounter(currSlabsInPool, InPool);
+    maxSlabsInUse.store(std::max(currSlabsInUse.load(std::memory_order_relaxed),
+                                 maxSlabsInUse.load(std::memory_order_relaxed)),
+                        std::memory_order_relaxed);
+    maxSlabsInPool.store(
+        std::max(currSlabsInPool.load(std::memory_order_relaxed),
+                 maxSlabsInPool.load(std::memory_order_relaxed)),
+        std::memory_order_relaxed);
+
+    if (OwnAllocCtx.getParams().PoolTrace == 0) {
+        return;
+    }
+    // Increment or decrement current pool sizes based on whether
+    // slab was added to or removed from pool.
+    OwnAllocCtx.getParams().CurPoolSize += InPool * SlabAllocSize();
+}
+
+DisjointPoolBucketStats Bucket::getStats() const {
+    DisjointPoolBucketStats Stats;
+    Stats.Size = getSize();
+    Stats.Alignment = getAlignment();
+    Stats.AllocCount = allocCount.load(std::memory_order_relaxed);
+    Stats.FreeCount = freeCount.load(std::memory_order_relaxed);
+    Stats.AllocPoolCount = allocPoolCount.load(std::memory_order_relaxed);
+    Stats.ChunksInUse = chunksInUse.load(std::memory_order_relaxed);
+    Stats.SlabsInUse = currSlabsInUse.load(std::memory_order_relaxed);
+    Stats.SlabsInPool = currSlabsInPool.load(std::memory_order_relaxed);
+    Stats.MaxSlabsInUse = maxSlabsInUse.load(std::memory_order_relaxed);
+    Stats.MaxSlabsInPool = maxSlabsInPool.load(std::memory_order_relaxed);
+    return Stats;
+}
+
+static void printBucketStats(const DisjointPoolBucketStats &Stats,
+                             bool &TitlePrinted, const std::string &Label) {
+    if (Stats.AllocCount) {
+        if (!TitlePrinted) {
+            std::cout << Label << " memory statistics\n";
+            std::cout << std::setw(14) << "Bucket Size" << std::setw(12)
+                      << "Allocs" << std::setw(12) << "Frees" << std::setw(18)
+                      << "Allocs from Pool" << std::setw(20)
+                      << "Peak Slabs in Use" << std::setw(21)
+                      << "Peak Slabs in Pool" << std::endl;
+            TitlePrinted = true;
+        }
+        std::cout << std::setw(14) << Stats.Size << std::setw(12)
+                  << Stats.AllocCount << std::setw(12) << Stats.FreeCount
+                  << std::setw(18) << Stats.AllocPoolCount << std::setw(20)
+                  << Stats.MaxSlabsInUse << std::setw(21)
+                  << Stats.MaxSlabsInPool << std::endl;
+    }
+}
+
+// Return the index of the smallest bucket of the list which fits Size.
+// MinSizeExp is the position of the most significant bit of the size of the
+// first bucket.
+static size_t findBucketIdx(size_t Size,
+                            const std::vector<std::unique_ptr<Bucket>> &Buckets,
+                            size_t MinSizeExp) {
+    assert(Size <= CutOff && "Unexpected size");
+
+    size_t Idx = 0;
+    if (Size > Buckets[0]->getSize()) {
+        // Buckets come in pairs for each power of 2: MinBucketSize * 2^k
+        // followed by 1.5 * MinBucketSize * 2^k. The leftmost set bit of
+        // (Size - 1) selects the pair and the bit right below it tells
+        // whether Size fits in the smaller bucket of the next pair.
+        auto Pos = getLeftmostSetBitPos(Size - 1);
+        Idx = 2 * (Pos - MinSizeExp) + 1;
+        if (Pos > 0 && ((Size - 1) >> (Pos - 1)) & 1) {
+            ++Idx;
+        }
+        Idx = std::min(Idx, Buckets.size() - 1);
+    }
+
+    // The index is exact if MinBucketSize is a power of 2, otherwise it may be
+    // off by a few buckets.
+    while (Buckets[Idx]->getSize() < Size) {
+        ++Idx;
+    }
+    while (Idx > 0 && Buckets[Idx - 1]->getSize() >= Size) {
+        --Idx;
+    }
+
+    return Idx;
+}
+
+// Return the bin of the size histogram for allocations of Size bytes. Each
+// range (2^k, 2^(k+1)] is split into SubBins bins of equal width, sizes up to
+// 16 bytes are counted as 16.
+static size_t getSizeHistogramBin(size_t Size, size_t SubBins) {
+    Size = std::max<size_t>(Size, 16);
+    auto Pos = getLeftmostSetBitPos(Size - 1);
+    auto SubBinBits = getLeftmostSetBitPos(SubBins);
+    return Pos * SubBins + (((Size - 1) >> (Pos - SubBinBits)) & (SubBins - 1));
+}
+
+// Return the largest size of the bin of the size histogram
+static size_t getSizeHistogramBinSize(size_t Bin, size_t SubBins) {
+    auto Pos = Bin / SubBins;
+    return ((size_t)1 << Pos) +
+           (Bin % SubBins + 1) * ((size_t)1 << Pos) / SubBins;
+}
+
+size_t DisjointPool::AllocImpl::firstProvider(size_t RoutingSize) {
+    if (MemHandles.size() == 1) {
+        return 0;
+    }
+
+    switch (getParams().ProviderPolicy) {
+    case DisjointPoolProviderPolicy::Stripe:
+        return NextProvider.fetch_add(1, std::memory_order_relaxed) %
+               MemHandles.size();
+    case DisjointPoolProviderPolicy::SizeRouted: {
+        auto &Limits = getParams().ProviderSizeLimits;
+        size_t Idx = std::lower_bound(Limits.begin(), Limits.end(),
+                                      RoutingSize) -
+                     Limits.begin();
+        return std::min(Idx, MemHandles.size() - 1);
+    }
+    default:
+        return 0;
+    }
+}
+
+void *DisjointPool::AllocImpl::providerAlloc(size_t Size, size_t Alignment,
+                                             size_t RoutingSize,
+                                             size_t &ProviderIdx) {
+    size_t First = firstProvider(RoutingSize);
+    MemoryProviderError LastError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    for (size_t i = 0; i < MemHandles.size(); i++) {
+        size_t Idx = (First + i) % MemHandles.size();
+        try {
+            void *Ptr = memoryProviderAlloc(MemHandles[Idx], Size, Alignment);
+            ProviderIdx = Idx;
+            return Ptr;
+        } catch (MemoryProviderError &e) {
+            LastError = e;
+        }
+    }
+    throw LastError;
+}
+
+void *DisjointPool::AllocImpl::allocateLarge(size_t Size, size_t Alignment,
+                                             bool &FromPool, bool &Zeroed) {
+    bool UseCache = getParams().MaxLargeCacheSize != 0;
+    if (UseCache) {
+        // Round the extents so that splitting them does not leave pieces
+        // too small to be of any use
+        Size = AlignUp(Size, SlabMinSize());
+    }
+
+    // Each provider is tried with its cache first, so that the policy
+    // decides where the memory comes from whether or not it is cached.
+    size_t First = firstProvider(Size);
+    MemoryProviderError LastError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    for (size_t i = 0; i < MemHandles.size(); i++) {
+        size_t Idx = (First + i) % MemHandles.size();
+
+        if (UseCache) {
+            std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+            if (void *Ptr = LargeCaches[Idx].get(Size, Alignment)) {
+                LargeAllocs.emplace(Ptr, LargeAlloc{Size, Idx});
+                ++LargeAllocCount;
+                ++LargeAllocPoolCount;
+                LargeAllocBytes += Size;
+                FromPool = true;
+                Zeroed = false;
+                return Ptr;
+            }
+        }
+
+        void *Ptr;
+        try {
+            Ptr = memoryProviderAlloc(MemHandles[Idx], Size, Alignment);
+        } catch (MemoryProviderError &e) {
+            LastError = e;
+            continue;
+        }
+        FromPool = false;
+        Zeroed = getParams().ZeroedProviderMemory;
+
+        try {
+            std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+            auto It = LargeAllocs.emplace(Ptr, LargeAlloc{Size, Idx}).first;
+            if (UseCache) {
+                try {
+                    LargeCaches[Idx].addOrigin(Ptr, Size);
+                } catch (...) {
+                    LargeAllocs.erase(It);
+                    throw;
+                }
+            }
+            ++LargeAllocCount;
+            LargeAllocBytes += Size;
+        } catch (...) {
+            memoryProviderFree(MemHandles[Idx], Ptr, Size);
+            throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+        }
+
+        trackProviderAlloc(Size);
+        return Ptr;
+    }
+    throw LastError;
+}
+
+void *DisjointPool::AllocImpl::allocate(size_t Size, bool &FromPool,
+                                        bool &Zeroed) try {
+    void *Ptr;
+
+    if (Size == 0) {
+        return nullptr;
+    }
+
+    FromPool = false;
+    if (Size > getParams().MaxPoolableSize) {
+        return allocateLarge(Size, 0, FromPool, Zeroed);
+    }
+
+    recordSize(Size);
+    auto BucketIdx = findBucketIdx(Size);
+    auto &Bucket = *getShard()[BucketIdx];
+
+    if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+        Ptr = Bucket.getSlab(FromPool, Zeroed);
+    } else {
+        Ptr = getChunk(BucketIdx, FromPool, Zeroed);
+    }
+
+    return Ptr;
+} catch (MemoryProviderError &e) {
+    umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+    return nullptr;
+}
+
+void *DisjointPool::AllocImpl::allocate(size_t Size, size_t Alignment,
+                                        bool &FromPool) try {
+    void *Ptr;
+
+    if (Size == 0) {
+        return nullptr;
+    }
+
+    if (Alignment <= 1) {
+        return allocate(Size, FromPool);
+    }
+
+    // This allocation will be served from a Bucket which size is multiple
+    // of Alignment. Slab address is aligned to ProviderMinPageSize, or to
+    // Alignment for larger alignments, so the address will be properly
+    // aligned.
+    size_t AlignedSize = (Size > 1) ? AlignUp(Size, Alignment) : Alignment;
+
+    // Check if requested allocation size is within pooling limit.
+    // If not, just request aligned pointer from the system.
+    FromPool = false;
+    bool Zeroed;
+    if (AlignedSize > getParams().MaxPoolableSize) {
+        return allocateLarge(Size, Alignment, FromPool, Zeroed);
+    }
+
+    Bucket *Bucket;
+    if (Alignment <= ProviderMinPageSize) {
+        recordSize(AlignedSize);
+        auto &Buckets = getShard();
+        auto BucketIdx = findBucketIdx(AlignedSize);
+
+        // Chunks of the extra buckets may not be aligned
+        while (Buckets[BucketIdx]->getSize() % Alignment) {
+            ++BucketIdx;
+        }
+        Bucket = Buckets[BucketIdx].get();
+
+        if (Bucket->getSize() > Bucket->ChunkCutOff()) {
+            Ptr = Bucket->getSlab(FromPool, Zeroed);
+        } else {
+            Ptr = getChunk(BucketIdx, FromPool, Zeroed);
+        }
+    } else {
+        // Chunks of these buckets bypass the thread cache, whose bins only
+        // hold chunks of the default buckets.
+        auto &List = getAlignedBuckets(Alignment);
+        Bucket = List[usm::findBucketIdx(AlignedSize, List,
+                                         getLeftmostSetBitPos(Alignment))]
+                     .get();
+
+        if (Bucket->getSize() > Bucket->ChunkCutOff()) {
+            Ptr = Bucket->getSlab(FromPool, Zeroed);
+        } else {
+            Ptr = Bucket->getChunk(FromPool, Zeroed);
+        }
+    }
+
+    return AlignPtrUp(Ptr, Alignment);
+} catch (MemoryProviderError &e) {
+    umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+    return nullptr;
+}
+
+size_t DisjointPool::AllocImpl::findBucketIdx(size_t Size) {
+    if (HasExtraBuckets) {
+        auto It = std::lower_bound(
+            Shards[0].begin(), Shards[0].end(), Size,
+            [](const auto &B, size_t Size) { return B->getSize() < Size; });
+        assert(It != Shards[0].end() && "Unexpected size");
+        return It - Shards[0].begin();
+    }
+    return usm::findBucketIdx(Size, Shards[0], MinBucketSizeExp);
+}
+
+void DisjointPool::AllocImpl::recordSize(size_t Size) {
+    auto Limit = getParams().SizeHistogramAllocs;
+    if (SizeHistogramCount.load(std::memory_order_relaxed) >= Limit ||
+        SizeHistogramCount.fetch_add(1, std::memory_order_relaxed) >= Limit) {
+        return;
+    }
+
+    SizeHistogram[getSizeHistogramBin(Size, SizeHistogramSubBins)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+DisjointPool::AllocImpl::BucketList &DisjointPool::AllocImpl::getShard() {
+    if (Shards.size() == 1) {
+        return Shards[0];
+    }
+
+    // Threads are assigned to shards round-robin, in the order they first
+    // allocate from any pool.
+    static std::atomic<size_t> NextThreadIdx{0};
+    static thread_local size_t ThreadIdx = NextThreadIdx++;
+    return Shards[ThreadIdx % Shards.size()];
+}
+
+void DisjointPool::AllocImpl::createBuckets(BucketList &List, size_t MinSize,
+                                            size_t Alignment) {
+    // Generate buckets sized such as: 64, 96, 128, 192, ..., CutOff.
+    // Powers of 2 and the value halfway between the powers of 2.
+    auto Size1 = MinSize;
+    auto Size2 = Size1 + Size1 / 2;
+    for (; Size2 < CutOff; Size1 *= 2, Size2 *= 2) {
+        List.push_back(std::make_unique<Bucket>(Size1, *this, Alignment));
+        List.push_back(std::make_unique<Bucket>(Size2, *this, Alignment));
+    }
+    List.push_back(std::make_unique<Bucket>(CutOff, *this, Alignment));
+
+    if (Alignment) {
+        return;
+    }
+
+    for (auto Size : getParams().ExtraBucketSizes) {
+        Size = AlignUp(Size, alignof(std::max_align_t));
+        if (Size <= MinSize || Size >= CutOff) {
+            continue;
+        }
+
+        auto It = std::lower_bound(
+            List.begin(), List.end(), Size,
+            [](const auto &B, size_t Size) { return B->getSize() < Size; });
+        if ((*It)->getSize() != Size) {
+            List.insert(It, std::make_unique<Bucket>(Size, *this, Alignment));
+            HasExtraBuckets = true;
+        }
+    }
+}
+
+DisjointPool::AllocImpl::BucketList &
+DisjointPool::AllocImpl::getAlignedBuckets(size_t Alignment) {
+    auto &Entry = AlignedBuckets[getLeftmostSetBitPos(Alignment)];
+    if (auto *List = Entry.load(std::memory_order_acquire)) {
+        return *List;
+    }
+
+    std::lock_guard<std::mutex> Lg(AlignedBucketsLock);
+    if (auto *List = Entry.load(std::memory_order_relaxed)) {
+        return *List;
+    }
+
+    // The smallest bucket is the alignment itself, so that all the chunks of
+    // a slab aligned by the provider are aligned as well.
+    auto &List = AlignedBucketLists.emplace_back();
+    createBuckets(List, Alignment, Alignment);
+    Entry.store(&List, std::memory_order_release);
+    return List;
+}
+
+void *DisjointPool::AllocImpl::getChunk(size_t BucketIdx, bool &FromPool,
+                                        bool &Zeroed) {
+    auto &Bucket = *getShard()[BucketIdx];
+    if (!getParams().ThreadCacheSize) {
+        return Bucket.getChunk(FromPool, Zeroed);
+    }
+
+    auto &Cache = getThreadCache();
+    auto &Bin = Cache.Bins[BucketIdx];
+    if (Bin.empty()) {
+        incrementCounter(Cache.Misses);
+        auto RefillSize = std::max<size_t>(getParams().ThreadCacheSize / 2, 1);
+        Bucket.getChunks(Bin, RefillSize, FromPool);
+    } else {
+        incrementCounter(Cache.Hits);
+        FromPool = true;
+    }
+
+    incrementCounter(Cache.BinStats[BucketIdx].AllocCount);
+    if (FromPool) {
+        incrementCounter(Cache.BinStats[BucketIdx].AllocPoolCount);
+    }
+
+    void *Chunk = Bin.back().Ptr;
+    Zeroed = Bin.back().Zeroed;
+    Bin.pop_back();
+    return Chunk;
+}
+
+void DisjointPool::AllocImpl::freeChunk(void *Ptr, Slab &Slab, bool &ToPool) {
+    auto &Bucket = Slab.getBucket();
+    if (!getParams().ThreadCacheSize || Bucket.getAlignment()) {
+        if (getParams().DeferredFree) {
+            Bucket.freeChunkDeferred(Ptr, Slab);
+            ToPool = true;
+        } else {
+            Bucket.freeChunk(Ptr, Slab, ToPool);
+        }
+        return;
+    }
+
+    auto &Cache = getThreadCache();
+    auto BucketIdx = findBucketIdx(Bucket.getSize());
+    auto &Bin = Cache.Bins[BucketIdx];
+    Bin.push_back({Slab.getChunkStart(Ptr), &Slab, false});
+    incrementCounter(Cache.BinStats[BucketIdx].FreeCount);
+    ToPool = true;
+
+    if (Bin.size() > getParams().ThreadCacheSize) {
+        // Return the least recently freed chunks to the bucket and keep the
+        // most recent ones, which are more likely to still be in cache.
+        auto NumFlushed = Bin.size() - getParams().ThreadCacheSize / 2;
+        freeCachedChunks(Bin.data(), NumFlushed);
+        Bin.erase(Bin.begin(), Bin.begin() + NumFlushed);
+        incrementCounter(Cache.Flushes);
+    }
+}
+
+ThreadCache &DisjointPool::AllocImpl::getThreadCache() {
+    if (LastThreadCachePoolId == PoolId) {
+        return *LastThreadCache;
+    }
+
+    auto It = ThreadCaches.find(PoolId);
+    if (It == ThreadCaches.end()) {
+        // Drop the caches of pools which no longer exist before adding a new
+        // one, so they do not accumulate in long-running threads.
+        for (auto I = ThreadCaches.begin(); I != ThreadCaches.end();) {
+            if (!I->second->isOwnerAlive()) {
+                if (I->first == LastThreadCachePoolId) {
+                    LastThreadCachePoolId = 0;
+                }
+                I = ThreadCaches.erase(I);
+            } else {
+                ++I;
+            }
+        }
+
+        It = ThreadCaches
+                 .emplace(PoolId, std::make_unique<ThreadCacheHandle>(
+                                      CacheRegistry, Shards[0].size()))
+                 .first;
+    }
+
+    LastThreadCachePoolId = PoolId;
+    LastThreadCache = &It->second->getCache();
+    return *LastThreadCache;
+}
+
+void DisjointPool::AllocImpl::flushThreadCache(ThreadCache &Cache) {
+    for (auto &Bin : Cache.Bins) {
+        if (!Bin.empty()) {
+            freeCachedChunks(Bin.data(), Bin.size());
+            Bin.clear();
+        }
+    }
+}
+
+DisjointPoolThreadCacheStats DisjointPool::AllocImpl::getThreadCacheStats() {
+    std::lock_guard<std::mutex> Lg(CacheRegistry->Lock);
+
+    auto Stats = CacheRegistry->Retired;
+    for (auto *Cache : CacheRegistry->Caches) {
+        Stats.Hits += Cache->Hits.load(std::memory_order_relaxed);
+        Stats.Misses += Cache->Misses.load(std::memory_order_relaxed);
+        Stats.Flushes += Cache->Flushes.load(std::memory_order_relaxed);
+    }
+    return Stats;
+}
+
+void DisjointPool::AllocImpl::releaseExtents(
+    size_t ProviderIdx, const std::vector<std::pair<void *, size_t>> &Extents) {
+    for (auto &[Ptr, Size] : Extents) {
+        trackProviderFree(Size);
+        try {
+            memoryProviderFree(MemHandles[ProviderIdx], Ptr, Size);
+        } catch (MemoryProviderError &e) {
+            std::cout << "DisjointPool: error from memory provider: " << e.code
+                      << "\n";
+        }
+    }
+}
+
+void DisjointPool::AllocImpl::releaseLargeCache(
+    std::chrono::steady_clock::time_point FreeBefore) {
+    for (size_t Idx = 0; Idx < LargeCaches.size(); Idx++) {
+        std::vector<std::pair<void *, size_t>> Released;
+        {
+            std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+            LargeCaches[Idx].release(getParams().MaxLargeCacheSize,
+                                     FreeBefore, Released);
+        }
+        releaseExtents(Idx, Released);
+    }
+}
+
+void DisjointPool::AllocImpl::decay(std::chrono::milliseconds Decay) {
+    auto Now = std::chrono::steady_clock::now();
+    if (getParams().MaxLargeCacheSize) {
+        // Same as for pooled slabs, but cached extents are not purged
+        releaseLargeCache(Decay.count()
+                              ? Now - 2 * Decay
+                              : std::chrono::steady_clock::time_point::max());
+    }
+
+    for (auto &Buckets : Shards) {
+        for (auto &B : Buckets) {
+            B->decay(Now, Decay);
+        }
+    }
+
+    std::lock_guard<std::mutex> Lg(AlignedBucketsLock);
+    for (auto &List : AlignedBucketLists) {
+        for (auto &B : List) {
+            B->decay(Now, Decay);
+        }
+    }
+}
+
+void DisjointPool::AllocImpl::trim() {
+    // Chunks cached by the calling thread would keep their slabs in use
+    if (getParams().ThreadCacheSize) {
+        flushThreadCache(getThreadCache());
+    }
+
+    decay(std::chrono::milliseconds(getParams().PurgeDecayMs));
 }
 
-void *Bucket::getChunk(bool &FromPool) {
-    std::lock_guard<std::mutex> Lg(BucketLock);
-
-    auto SlabIt = getAvailSlab(FromPool);
-    auto *FreeChunk = (*SlabIt)->getChunk();
+void DisjointPool::AllocImpl::purgeThreadMain() {
+    std::chrono::milliseconds Decay(getParams().PurgeDecayMs);
+    // Check twice per decay period, so that slabs are not kept much longer
+    // than configured
+    auto Interval = std::max(Decay / 2, std::chrono::milliseconds(1));
 
-    // If the slab is full, move it to unavailable slabs and update its iterator
-    if (!((*SlabIt)->hasAvail())) {
-        auto It = UnavailableSlabs.insert(UnavailableSlabs.begin(),
-                                          std::move(*SlabIt));
-        AvailableSlabs.erase(SlabIt);
-        (*It)->setIterator(It);
+    std::unique_lock<std::mutex> Lk(PurgeLock);
+    while (!PurgeCv.wait_for(Lk, Interval, [this] { return StopPurge; })) {
+        Lk.unlock();
+        decay(Decay);
+        Lk.lock();
     }
-
-    return FreeChunk;
 }
 
-void Bucket::freeChunk(void *Ptr, Slab &Slab, bool &ToPool) {
-    std::lock_guard<std::mutex> Lg(BucketLock);
-
-    Slab.freeChunk(Ptr);
+void DisjointPool::AllocImpl::prewarm() {
+    size_t Rounds = getParams().PrewarmSlabs;
+    if (!Rounds) {
+        Rounds = getParams().Capacity;
+    }
+    size_t Budget = getParams().PrewarmSize;
+    if (!Budget) {
+        Budget = std::numeric_limits<size_t>::max();
+    }
 
-    onFreeChunk(Slab, ToPool);
-}
+    // Add one slab to each bucket per round, smallest buckets first, so that
+    // a byte budget is spread across the sizes most likely to be used.
+    for (size_t Round = 0; Round < Rounds; Round++) {
+        bool Added = false;
+        for (auto &Buckets : Shards) {
+            for (auto &B : Buckets) {
+                if (StopPrewarm) {
+                    return;
+                }
 
-// The lock must be acquired before calling this method
-void Bucket::onFreeChunk(Slab &Slab, bool &ToPool) {
-    ToPool = true;
+                if (B->getSize() > getParams().MaxPoolableSize ||
+                    B->SlabAllocSize() > Budget) {
+                    continue;
+                }
 
-    // In case if the slab was previously full and now has 1 available
-    // chunk, it should be moved to the list of available slabs
-    if (Slab.getNumAllocated() == (Slab.getNumChunks() - 1)) {
-        auto SlabIter = Slab.getIterator();
-        assert(SlabIter != UnavailableSlabs.end());
+                try {
+                    if (B->prewarm()) {
+                        Budget -= B->SlabAllocSize();
+                        Added = true;
+                    }
+                } catch (MemoryProviderError &) {
+                    // Prewarming is best effort, stop at the first failure
+                    return;
+                }
+            }
+        }
 
-        auto It =
-            AvailableSlabs.insert(AvailableSlabs.begin(), std::move(*SlabIter));
-        UnavailableSlabs.erase(SlabIter);
+        if (!Added) {
+            return;
+        }
+    }
+}
 
-        (*It)->setIterator(It);
+DisjointPool::AllocImpl::~AllocImpl() {
+    if (PrewarmThread.joinable()) {
+        StopPrewarm = true;
+        PrewarmThread.join();
     }
 
-    // Check if slab is empty, and pool it if we can.
-    if (Slab.getNumAllocated() == 0) {
-        // The slab is now empty.
-        // If pool has capacity then put the slab in the pool.
-        // The ToPool parameter indicates whether the Slab will be put in the
-        // pool or freed.
-        if (!CanPool(ToPool)) {
-            // Note: since the slab is stored as unique_ptr, just remove it from
-            // the list to destroy the object.
-            auto It = Slab.getIterator();
-            assert(It != AvailableSlabs.end());
-            AvailableSlabs.erase(It);
+    if (PurgeThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lg(PurgeLock);
+            StopPurge = true;
         }
+        PurgeCv.notify_one();
+        PurgeThread.join();
     }
+
+    releaseLargeCache(std::chrono::steady_clock::time_point::max());
+
+    // Chunks left in thread caches are released together with their slabs,
+    // the threads only need to know they must not return them here anymore.
+    std::lock_guard<std::mutex> Lg(CacheRegistry->Lock);
+    CacheRegistry->Owner = nullptr;
 }
 
-bool Bucket::CanPool(bool &ToPool) {
-    size_t NewFreeSlabsInBucket;
-    // Check if this bucket is used in chunked form or as full slabs.
-    bool chunkedBucket = getSize() <= ChunkCutOff();
-    if (chunkedBucket) {
-        NewFreeSlabsInBucket = chunkedSlabsInPool + 1;
-    } else {
-        NewFreeSlabsInBucket = AvailableSlabs.size() + 1;
+ThreadCacheHandle::ThreadCacheHandle(std::shared_ptr<ThreadCacheRegistry> Reg,
+                                     size_t NumBuckets)
+    : Registry(std::move(Reg)), Cache(NumBuckets) {
+    std::lock_guard<std::mutex> Lg(Registry->Lock);
+    Registry->Caches.insert(&Cache);
+}
+
+ThreadCacheHandle::~ThreadCacheHandle() {
+    std::lock_guard<std::mutex> Lg(Registry->Lock);
+
+    // The registry lock also keeps the pool alive while flushing.
+    if (auto *Owner = Registry->Owner.load()) {
+        Owner->flushThreadCache(Cache);
     }
-    if (Capacity() >= NewFreeSlabsInBucket) {
-        size_t PoolSize = OwnAllocCtx.getParams().limits->TotalSize;
-        while (true) {
-            size_t NewPoolSize = PoolSize + SlabAllocSize();
 
-            if (OwnAllocCtx.getParams().limits->MaxSize < NewPoolSize) {
-                break;
-            }
+    Registry->Retired.Hits += Cache.Hits.load(std::memory_order_relaxed);
+    Registry->Retired.Misses += Cache.Misses.load(std::memory_order_relaxed);
+    Registry->Retired.Flushes += Cache.Flushes.load(std::memory_order_relaxed);
+
+    auto &RetiredBins = Registry->RetiredBins;
+    RetiredBins.resize(Cache.BinStats.size());
+    for (size_t i = 0; i < Cache.BinStats.size(); i++) {
+        auto &Bin = Cache.BinStats[i];
+        RetiredBins[i].AllocCount +=
+            Bin.AllocCount.load(std::memory_order_relaxed);
+        RetiredBins[i].AllocPoolCount +=
+            Bin.AllocPoolCount.load(std::memory_order_relaxed);
+        RetiredBins[i].FreeCount +=
+            Bin.FreeCount.load(std::memory_order_relaxed);
+    }
+    Registry->Caches.erase(&Cache);
+}
 
-            if (OwnAllocCtx.getParams()
-                    .limits->TotalSize.compare_exchange_strong(PoolSize,
-                                                               NewPoolSize)) {
-                if (chunkedBucket) {
-                    ++chunkedSlabsInPool;
+void DisjointPool::AllocImpl::deallocateLarge(void *Ptr) {
+    // The size is 0 for pointers the pool does not know about, they are
+    // passed to the first provider
+    LargeAlloc Alloc{0, 0};
+    bool Cached = false;
+    std::vector<std::pair<void *, size_t>> Released;
+    {
+        std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+        auto It = LargeAllocs.find(Ptr);
+        if (It != LargeAllocs.end()) {
+            Alloc = It->second;
+            LargeAllocs.erase(It);
+            ++LargeFreeCount;
+            LargeAllocBytes -= Alloc.Size;
+
+            if (size_t MaxSize = getParams().MaxLargeCacheSize) {
+                // Only the cache the memory is returned to is trimmed, the
+                // others keep what was within the limit before
+                size_t OtherBytes = 0;
+                for (size_t Idx = 0; Idx < LargeCaches.size(); Idx++) {
+                    if (Idx != Alloc.ProviderIdx) {
+                        OtherBytes += LargeCaches[Idx].getIdleBytes();
+                    }
                 }
 
-                updateStats(-1, 1);
-                ToPool = true;
-                return true;
+                auto &Cache = LargeCaches[Alloc.ProviderIdx];
+                Cache.put(Ptr, Alloc.Size);
+                Cache.release(MaxSize - std::min(MaxSize, OtherBytes),
+                              std::chrono::steady_clock::time_point::min(),
+                              Released);
+                Cached = true;
             }
         }
     }
 
-    updateStats(-1, 0);
-    ToPool = false;
-    return false;
-}
+    if (Cached) {
+        releaseExtents(Alloc.ProviderIdx, Released);
+        return;
+    }
 
-umf_memory_provider_handle_t Bucket::getMemHandle() {
-    return OwnAllocCtx.getMemHandle();
+    trackProviderFree(Alloc.Size);
+    memoryProviderFree(MemHandles[Alloc.ProviderIdx], Ptr, Alloc.Size);
 }
 
-size_t Bucket::SlabMinSize() { return OwnAllocCtx.getParams().SlabMinSize; }
+void DisjointPool::AllocImpl::deallocate(void *Ptr, size_t Size,
+                                         bool &ToPool) {
+    ToPool = false;
 
-size_t Bucket::SlabAllocSize() { return std::max(getSize(), SlabMinSize()); }
+    // Even aligned allocations are served by the provider directly if the
+    // requested size alone is beyond the pooling limit.
+    if (Size > getParams().MaxPoolableSize) {
+        deallocateLarge(Ptr);
+        return;
+    }
 
-size_t Bucket::Capacity() {
-    // For buckets used in chunked mode, just one slab in pool is sufficient.
-    // For larger buckets, the capacity could be more and is adjustable.
-    if (getSize() <= ChunkCutOff()) {
-        return 1;
+    // The lookup takes no locks, the slab containing Ptr cannot be destroyed
+    // while Ptr is still allocated.
+    auto *Slab = getKnownSlabs().find(Ptr);
+    if (!Slab) {
+        deallocateLarge(Ptr);
+        return;
+    }
+
+    assert((!Size || Size <= getUsableSize(Ptr)) && "invalid size");
+
+    auto &Bucket = Slab->getBucket();
+
+    if (Bucket.getSize() <= Bucket.ChunkCutOff()) {
+        freeChunk(Ptr, *Slab, ToPool);
     } else {
-        return OwnAllocCtx.getParams().Capacity;
+        Bucket.freeSlab(*Slab, ToPool);
     }
 }
 
-size_t Bucket::MaxPoolableSize() {
-    return OwnAllocCtx.getParams().MaxPoolableSize;
-}
+size_t DisjointPool::AllocImpl::allocateBatch(size_t Size, size_t Count,
+                                              void **Ptrs) {
+    if (Size == 0) {
+        return 0;
+    }
 
-size_t Bucket::ChunkCutOff() { return SlabMinSize() / 2; }
+    if (Size > getParams().MaxPoolableSize) {
+        size_t Allocated = 0;
+        try {
+            for (; Allocated < Count; Allocated++) {
+                bool FromPool;
+                bool Zeroed;
+                Ptrs[Allocated] = allocateLarge(Size, 0, FromPool, Zeroed);
+            }
+        } catch (MemoryProviderError &e) {
+            umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+        }
+        return Allocated;
+    }
 
-void Bucket::countAlloc(bool FromPool) {
-    ++allocCount;
-    if (FromPool) {
-        ++allocPoolCount;
+    for (size_t i = 0; i < Count; i++) {
+        recordSize(Size);
     }
+
+    // The thread cache is bypassed so that the bucket serves the whole batch
+    // under a single lock.
+    auto &Bucket = *getShard()[findBucketIdx(Size)];
+    return Bucket.allocateBatch(Ptrs, Count);
 }
 
-void Bucket::countFree() { ++freeCount; }
+umf_result_t DisjointPool::AllocImpl::deallocateBatch(void **Ptrs,
+                                                      size_t Count) {
+    umf_result_t Ret = UMF_RESULT_SUCCESS;
+    std::vector<CachedChunk> Allocs;
+    Allocs.reserve(Count);
+    for (size_t i = 0; i < Count; i++) {
+        if (!Ptrs[i]) {
+            continue;
+        }
 
-void Bucket::updateStats(int InUse, int InPool) {
-    if (OwnAllocCtx.getParams().PoolTrace == 0) {
-        return;
+        if (auto *Slab = getKnownSlabs().find(Ptrs[i])) {
+            Allocs.push_back({Ptrs[i], Slab, false});
+            continue;
+        }
+
+        try {
+            deallocateLarge(Ptrs[i]);
+        } catch (MemoryProviderError &e) {
+            if (Ret == UMF_RESULT_SUCCESS) {
+                Ret = e.code;
+            }
+        }
     }
-    currSlabsInUse += InUse;
-    maxSlabsInUse = std::max(currSlabsInUse, maxSlabsInUse);
-    currSlabsInPool += InPool;
-    maxSlabsInPool = std::max(currSlabsInPool, maxSlabsInPool);
-    // Increment or decrement current pool sizes based on whether
-    // slab was added to or removed from pool.
-    OwnAllocCtx.getParams().CurPoolSize += InPool * SlabAllocSize();
+
+    // Group the allocations by bucket, which differ for the shards and the
+    // alignments even for allocations of the same size
+    auto BucketLess = [](const CachedChunk &A, const CachedChunk &B) {
+        return std::less<Bucket *>()(&A.Owner->getBucket(),
+                                     &B.Owner->getBucket());
+    };
+    if (!std::is_sorted(Allocs.begin(), Allocs.end(), BucketLess)) {
+        std::sort(Allocs.begin(), Allocs.end(), BucketLess);
+    }
+
+    size_t Begin = 0;
+    for (size_t i = 1; i <= Allocs.size(); i++) {
+        auto &Owner = Allocs[Begin].Owner->getBucket();
+        if (i == Allocs.size() || &Allocs[i].Owner->getBucket() != &Owner) {
+            Owner.freeBatch(Allocs.data() + Begin, i - Begin);
+            Begin = i;
+        }
+    }
+    return Ret;
 }
 
-void Bucket::printStats(bool &TitlePrinted, const std::string &Label) {
-    if (allocCount) {
-        if (!TitlePrinted) {
-            std::cout << Label << " memory statistics\n";
-            std::cout << std::setw(14) << "Bucket Size" << std::setw(12)
-                      << "Allocs" << std::setw(12) << "Frees" << std::setw(18)
-                      << "Allocs from Pool" << std::setw(20)
-                      << "Peak Slabs in Use" << std::setw(21)
-                      << "Peak Slabs in Pool" << std::endl;
-            TitlePrinted = true;
+size_t DisjointPool::AllocImpl::getUsableSize(void *Ptr) {
+    if (auto *Slab = getKnownSlabs().find(Ptr)) {
+        auto &Bucket = Slab->getBucket();
+        char *End;
+        if (Bucket.getSize() <= Bucket.ChunkCutOff()) {
+            End = static_cast<char *>(Slab->getChunkStart(Ptr)) +
+                  Bucket.getSize();
+        } else {
+            End = static_cast<char *>(Slab->getPtr()) + Bucket.SlabAllocSize();
         }
-        std::cout << std::setw(14) << getSize() << std::setw(12) << allocCount
-                  << std::setw(12) << freeCount << std::setw(18)
-                  << allocPoolCount << std::setw(20) << maxSlabsInUse
-                  << std::setw(21) << maxSlabsInPool << std::endl;
+        return End - static_cast<char *>(Ptr);
     }
+
+    std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+    auto It = LargeAllocs.find(Ptr);
+    return It != LargeAllocs.end() ? It->second.Size : 0;
 }
 
-void *DisjointPool::AllocImpl::allocate(size_t Size, bool &FromPool) try {
-    void *Ptr;
+void *DisjointPool::AllocImpl::reallocate(void *Ptr, size_t Size) try {
+    bool FromPool;
+    if (!Ptr) {
+        return allocate(Size, FromPool);
+    }
 
+    bool ToPool;
     if (Size == 0) {
+        deallocate(Ptr, ToPool);
         return nullptr;
     }
 
-    FromPool = false;
-    if (Size > getParams().MaxPoolableSize) {
-        return memoryProviderAlloc(getMemHandle(), Size);
+    auto OldSize = getUsableSize(Ptr);
+    if (!OldSize) {
+        umf::getPoolLastStatusRef<DisjointPool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
     }
 
-    auto &Bucket = findBucket(Size);
-
-    if (Size > Bucket.ChunkCutOff()) {
-        Ptr = Bucket.getSlab(FromPool);
-    } else {
-        Ptr = Bucket.getChunk(FromPool);
+    // Keep the allocation if the new size still fits it and would not be
+    // served from a smaller bucket. Large allocations are kept unless they
+    // shrink by more than half.
+    if (Size <= OldSize) {
+        if (Size > getParams().MaxPoolableSize) {
+            if (Size >= OldSize / 2) {
+                return Ptr;
+            }
+        } else if (auto *Slab = getKnownSlabs().find(Ptr)) {
+            // Any shard will do, but not the buckets of large alignments
+            auto &Bucket = Slab->getBucket();
+            if (!Bucket.getAlignment() &&
+                findBucketIdx(Size) == findBucketIdx(Bucket.getSize())) {
+                return Ptr;
+            }
+        }
     }
 
-    if (getParams().PoolTrace > 1) {
-        Bucket.countAlloc(FromPool);
+    void *NewPtr = allocate(Size, FromPool);
+    if (!NewPtr) {
+        return nullptr;
     }
 
-    return Ptr;
+    std::memcpy(NewPtr, Ptr, std::min(Size, OldSize));
+    deallocate(Ptr, ToPool);
+    return NewPtr;
 } catch (MemoryProviderError &e) {
     umf::getPoolLastStatusRef<DisjointPool>() = e.code;
     return nullptr;
 }
 
-void *DisjointPool::AllocImpl::allocate(size_t Size, size_t Alignment,
-                                        bool &FromPool) try {
-    void *Ptr;
+void DisjointPool::AllocImpl::printStats(bool &TitlePrinted,
+                                         size_t &HighBucketSize,
+                                         size_t &HighPeakSlabsInUse,
+                                         const std::string &MTName) {
+    HighBucketSize = 0;
+    HighPeakSlabsInUse = 0;
 
-    if (Size == 0) {
-        return nullptr;
+    for (auto &B : getStats().Buckets) {
+        printBucketStats(B, TitlePrinted, MTName);
+        HighPeakSlabsInUse = std::max(B.MaxSlabsInUse, HighPeakSlabsInUse);
+        if (B.AllocCount) {
+            HighBucketSize =
+                std::max(std::max(B.Size, SlabMinSize()), HighBucketSize);
+        }
     }
+}
 
-    if (Alignment <= 1) {
-        return allocate(Size, FromPool);
-    }
+void DisjointPool::AllocImpl::trackProviderAlloc(size_t Size) {
+    auto Resident =
+        ResidentBytes.fetch_add(Size, std::memory_order_relaxed) + Size;
 
-    size_t AlignedSize;
-    if (Alignment <= ProviderMinPageSize) {
-        // This allocation will be served from a Bucket which size is multiple
-        // of Alignment and Slab address is aligned to ProviderMinPageSize
-        // so the address will be properly aligned.
-        AlignedSize = (Size > 1) ? AlignUp(Size, Alignment) : Alignment;
-    } else {
-        // Slabs are only aligned to ProviderMinPageSize, we need to compensate
-        // for that in case the allocation is within pooling limit.
-        // TODO: consider creating properly-aligned Slabs on demand
-        AlignedSize = Size + Alignment - 1;
+    auto Peak = PeakResidentBytes.load(std::memory_order_relaxed);
+    while (Peak < Resident && !PeakResidentBytes.compare_exchange_weak(
+                                  Peak, Resident, std::memory_order_relaxed)) {
     }
+}
 
-    // Check if requested allocation size is within pooling limit.
-    // If not, just request aligned pointer from the system.
-    FromPool = false;
-    if (AlignedSize > getParams().MaxPoolableSize) {
-        return memoryProviderAlloc(getMemHandle(), Size, Alignment);
-    }
+void DisjointPool::AllocImpl::trackProviderFree(size_t Size) {
+    ResidentBytes.fetch_sub(Size, std::memory_order_relaxed);
+}
+
+// Add the counters of From to To
+static void addBucketStats(DisjointPoolBucketStats &To,
+                           const DisjointPoolBucketStats &From) {
+    To.AllocCount += From.AllocCount;
+    To.FreeCount += From.FreeCount;
+    To.AllocPoolCount += From.AllocPoolCount;
+    To.ChunksInUse += From.ChunksInUse;
+    To.SlabsInUse += From.SlabsInUse;
+    To.SlabsInPool += From.SlabsInPool;
+    To.MaxSlabsInUse += From.MaxSlabsInUse;
+    To.MaxSlabsInPool += From.MaxSlabsInPool;
+}
 
-    auto &Bucket = findBucket(AlignedSize);
+void DisjointPool::AllocImpl::addThreadCacheStats(
+    std::vector<DisjointPoolBucketStats> &Stats) {
+    std::lock_guard<std::mutex> Lg(CacheRegistry->Lock);
 
-    if (AlignedSize > Bucket.ChunkCutOff()) {
-        Ptr = Bucket.getSlab(FromPool);
-    } else {
-        Ptr = Bucket.getChunk(FromPool);
+    auto &Retired = CacheRegistry->RetiredBins;
+    for (size_t i = 0; i < Retired.size(); i++) {
+        addBucketStats(Stats[i], Retired[i]);
     }
 
-    if (getParams().PoolTrace > 1) {
-        Bucket.countAlloc(FromPool);
+    for (auto *Cache : CacheRegistry->Caches) {
+        for (size_t i = 0; i < Cache->BinStats.size(); i++) {
+            auto &Bin = Cache->BinStats[i];
+            Stats[i].AllocCount +=
+                Bin.AllocCount.load(std::memory_order_relaxed);
+            Stats[i].AllocPoolCount +=
+                Bin.AllocPoolCount.load(std::memory_order_relaxed);
+            Stats[i].FreeCount += Bin.FreeCount.load(std::memory_order_relaxed);
+        }
     }
+}
 
-    return AlignPtrUp(Ptr, Alignment);
-} catch (MemoryProviderError &e) {
-    umf::getPoolLastStatusRef<DisjointPool>() = e.code;
-    return nullptr;
+std::vector<DisjointPoolBucketStats>
+DisjointPool::AllocImpl::getDefaultBucketStats() {
+    // The shards of a bucket are reported as one, so the peak values are the
+    // sums of the peaks of the shards.
+    std::vector<DisjointPoolBucketStats> DefaultStats;
+    for (auto &B : Shards[0]) {
+        DefaultStats.push_back(B->getStats());
+    }
+    for (size_t Shard = 1; Shard < Shards.size(); Shard++) {
+        for (size_t i = 0; i < DefaultStats.size(); i++) {
+            addBucketStats(DefaultStats[i], Shards[Shard][i]->getStats());
+        }
+    }
+    if (getParams().ThreadCacheSize) {
+        addThreadCacheStats(DefaultStats);
+    }
+    return DefaultStats;
 }
 
-Bucket &DisjointPool::AllocImpl::findBucket(size_t Size) {
-    assert(Size <= CutOff && "Unexpected size");
+DisjointPoolConfig
+DisjointPool::AllocImpl::getTunedConfig(size_t MaxExtraBuckets) {
+    auto Config = getParams();
 
-    auto It = std::find_if(
-        Buckets.begin(), Buckets.end(),
-        [Size](const auto &BucketPtr) { return BucketPtr->getSize() >= Size; });
+    std::set<size_t> Sizes;
+    for (auto &B : Shards[0]) {
+        Sizes.insert(B->getSize());
+    }
 
-    assert((It != Buckets.end()) && "Bucket should always exist");
+    // Recorded allocations by the largest size of their bin. Allocations are
+    // assumed to be of that size, so that a bucket of it fits them all.
+    std::vector<std::pair<size_t, size_t>> Recorded;
+    size_t Total = 0;
+    for (size_t Bin = 0; Bin < SizeHistogram.size(); Bin++) {
+        if (auto Count = SizeHistogram[Bin].load(std::memory_order_relaxed)) {
+            Recorded.emplace_back(
+                getSizeHistogramBinSize(Bin, SizeHistogramSubBins), Count);
+            Total += Count;
+        }
+    }
 
-    return *(*It);
-}
+    // Add one bucket at a time, the one which saves most bytes. Allocations
+    // up to its size which were served by the next larger bucket move to it.
+    // Sizes used by less than 1% of the allocations are not worth a bucket.
+    std::map<size_t, size_t> Replaced;
+    for (size_t i = 0; i < MaxExtraBuckets; i++) {
+        size_t BestSize = 0, BestSaved = 0;
+        for (auto [Size, Count] : Recorded) {
+            auto Next = Sizes.lower_bound(Size);
+            if (Size <= Config.MinBucketSize || Next == Sizes.end() ||
+                *Next == Size) {
+                continue;
+            }
 
-void DisjointPool::AllocImpl::deallocate(void *Ptr, bool &ToPool) {
-    auto *SlabPtr = AlignPtrDown(Ptr, SlabMinSize());
+            auto Prev = Next == Sizes.begin() ? 0 : *std::prev(Next);
+            size_t Moved = 0;
+            for (auto [OtherSize, OtherCount] : Recorded) {
+                if (OtherSize > Prev && OtherSize <= Size) {
+                    Moved += OtherCount;
+                }
+            }
+            if (Moved * 100 >= Total && Moved * (*Next - Size) > BestSaved) {
+                BestSize = Size;
+                BestSaved = Moved * (*Next - Size);
+            }
+        }
 
-    // Lock the map on read
-    std::shared_lock<std::shared_timed_mutex> Lk(getKnownSlabsMapLock());
+        if (!BestSize) {
+            break;
+        }
+        Replaced[BestSize] = *Sizes.lower_bound(BestSize);
+        Sizes.insert(BestSize);
+        Config.ExtraBucketSizes.push_back(BestSize);
+    }
 
-    ToPool = false;
-    auto Slabs = getKnownSlabs().equal_range(SlabPtr);
-    if (Slabs.first == Slabs.second) {
-        Lk.unlock();
-        memoryProviderFree(getMemHandle(), Ptr);
-        return;
+    // A bucket which allocated more slabs than it had in use at its peak
+    // released slabs it needed again later, so it keeps that many.
+    auto Stats = getDefaultBucketStats();
+    for (size_t i = 0; i < Stats.size(); i++) {
+        auto &B = Stats[i];
+        if (B.AllocCount - B.AllocPoolCount > B.MaxSlabsInUse &&
+            B.MaxSlabsInUse > Shards[0][i]->Capacity()) {
+            Config.BucketCapacities[B.Size] = B.MaxSlabsInUse;
+        }
     }
 
-    for (auto It = Slabs.first; It != Slabs.second; ++It) {
-        // The slab object won't be deleted until it's removed from the map which is
-        // protected by the lock, so it's safe to access it here.
-        auto &Slab = It->second;
-        if (Ptr >= Slab.getPtr() && Ptr < Slab.getEnd()) {
-            // Unlock the map before freeing the chunk, it may be locked on write
-            // there
-            Lk.unlock();
-            auto &Bucket = Slab.getBucket();
+    // New buckets take over the capacity of the buckets whose allocations
+    // they serve
+    for (auto [Size, ReplacedSize] : Replaced) {
+        auto It = Config.BucketCapacities.find(ReplacedSize);
+        if (It != Config.BucketCapacities.end()) {
+            Config.BucketCapacities[Size] = It->second;
+        }
+    }
 
-            if (getParams().PoolTrace > 1) {
-                Bucket.countFree();
-            }
+    return Config;
+}
 
-            if (Bucket.getSize() <= Bucket.ChunkCutOff()) {
-                Bucket.freeChunk(Ptr, Slab, ToPool);
-            } else {
-                Bucket.freeSlab(Slab, ToPool);
-            }
+DisjointPoolStats DisjointPool::AllocImpl::getStats() {
+    DisjointPoolStats Stats;
 
-            return;
+    for (auto &B : getDefaultBucketStats()) {
+        if (B.AllocCount) {
+            Stats.Buckets.push_back(B);
         }
     }
 
-    Lk.unlock();
-    // There is a rare case when we have a pointer from system allocation next
-    // to some slab with an entry in the map. So we find a slab
-    // but the range checks fail.
-    memoryProviderFree(getMemHandle(), Ptr);
-}
+    {
+        std::lock_guard<std::mutex> Lg(AlignedBucketsLock);
+        for (auto &List : AlignedBucketLists) {
+            for (auto &B : List) {
+                auto BucketStats = B->getStats();
+                if (BucketStats.AllocCount) {
+                    Stats.Buckets.push_back(BucketStats);
+                }
+            }
+        }
+    }
 
-void DisjointPool::AllocImpl::printStats(bool &TitlePrinted,
-                                         size_t &HighBucketSize,
-                                         size_t &HighPeakSlabsInUse,
-                                         const std::string &MTName) {
-    HighBucketSize = 0;
-    HighPeakSlabsInUse = 0;
-    for (auto &B : Buckets) {
-        (*B).printStats(TitlePrinted, MTName);
-        HighPeakSlabsInUse = std::max((*B).maxSlabsInUse, HighPeakSlabsInUse);
-        if ((*B).allocCount) {
-            HighBucketSize = std::max((*B).SlabAllocSize(), HighBucketSize);
+    for (auto &B : Stats.Buckets) {
+        Stats.AllocCount += B.AllocCount;
+        Stats.FreeCount += B.FreeCount;
+        Stats.AllocPoolCount += B.AllocPoolCount;
+        Stats.InUseBytes += B.ChunksInUse * B.Size;
+        Stats.PooledBytes += B.SlabsInPool * std::max(B.Size, SlabMinSize());
+    }
+
+    {
+        std::lock_guard<std::mutex> Lg(LargeAllocsLock);
+        Stats.AllocCount += LargeAllocCount;
+        Stats.FreeCount += LargeFreeCount;
+        Stats.AllocPoolCount += LargeAllocPoolCount;
+        Stats.InUseBytes += LargeAllocBytes;
+        for (auto &Cache : LargeCaches) {
+            Stats.PooledBytes += Cache.getCachedBytes();
         }
     }
+
+    Stats.ResidentBytes = ResidentBytes.load(std::memory_order_relaxed);
+    Stats.PeakResidentBytes = PeakResidentBytes.load(std::memory_order_relaxed);
+    if (Stats.ResidentBytes) {
+        Stats.Fragmentation =
+            1.0 - std::min(1.0, static_cast<double>(Stats.InUseBytes) /
+                                    Stats.ResidentBytes);
+    }
+
+    return Stats;
 }
 
 umf_result_t DisjointPool::initialize(umf_memory_provider_handle_t *providers,
                                       size_t numProviders,
                                       DisjointPoolConfig parameters) {
-    if (numProviders != 1 || !providers[0]) {
+    if (!numProviders ||
+        std::any_of(providers, providers + numProviders,
+                    [](umf_memory_provider_handle_t p) { return !p; })) {
         return UMF_RESULT_ERROR_INVALID_ARGUMENT;
     }
 
-    impl = std::make_unique<AllocImpl>(providers[0], parameters);
+    impl = std::make_unique<AllocImpl>(
+        std::vector<umf_memory_provider_handle_t>(providers,
+                                                  providers + numProviders),
+        parameters);
     return UMF_RESULT_SUCCESS;
 }
 
@@ -904,16 +3128,42 @@ void *DisjointPool::malloc(size_t size) { // For full-slab allocations indicates
     return Ptr;
 }
 
-void *DisjointPool::calloc(size_t, size_t) {
-    // Not supported
-    umf::getPoolLastStatusRef<DisjointPool>() = UMF_RESULT_ERROR_NOT_SUPPORTED;
-    return NULL;
+void *DisjointPool::calloc(size_t num, size_t size) {
+    if (size && num > std::numeric_limits<size_t>::max() / size) {
+        umf::getPoolLastStatusRef<DisjointPool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
+    }
+
+    bool FromPool;
+    bool Zeroed;
+    auto Ptr = impl->allocate(num * size, FromPool, Zeroed);
+
+    // Memory not used since it was obtained from the provider does not need
+    // to be cleared again
+    if (Ptr && !Zeroed) {
+        std::memset(Ptr, 0, num * size);
+    }
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().name;
+        std::cout << "Allocated " << std::setw(8) << num * size << " " << MT
+                  << " zeroed bytes from " << (FromPool ? "Pool" : "Provider")
+                  << " ->" << Ptr << std::endl;
+    }
+    return Ptr;
 }
 
-void *DisjointPool::realloc(void *, size_t) {
-    // Not supported
-    umf::getPoolLastStatusRef<DisjointPool>() = UMF_RESULT_ERROR_NOT_SUPPORTED;
-    return NULL;
+void *DisjointPool::realloc(void *ptr, size_t size) {
+    auto NewPtr = impl->reallocate(ptr, size);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().name;
+        std::cout << "Reallocated " << MT << " " << ptr << " to "
+                  << std::setw(8) << size << " bytes ->" << NewPtr
+                  << std::endl;
+    }
+    return NewPtr;
 }
 
 void *DisjointPool::aligned_malloc(size_t size, size_t alignment) {
@@ -930,14 +3180,18 @@ void *DisjointPool::aligned_malloc(size_t size, size_t alignment) {
     return Ptr;
 }
 
-size_t DisjointPool::malloc_usable_size(void *) {
-    // Not supported
-    return 0;
+size_t DisjointPool::malloc_usable_size(void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    return impl->getUsableSize(ptr);
 }
 
-enum umf_result_t DisjointPool::free(void *ptr) try {
+enum umf_result_t DisjointPool::free(void *ptr) { return free_sized(ptr, 0); }
+
+enum umf_result_t DisjointPool::free_sized(void *ptr, size_t size) try {
     bool ToPool;
-    impl->deallocate(ptr, ToPool);
+    impl->deallocate(ptr, size, ToPool);
 
     if (impl->getParams().PoolTrace > 2) {
         auto MT = impl->getParams().name;
@@ -953,10 +3207,47 @@ enum umf_result_t DisjointPool::free(void *ptr) try {
     return e.code;
 }
 
+size_t DisjointPool::malloc_batch(size_t size, size_t count, void **ptrs) {
+    auto Allocated = impl->allocateBatch(size, count, ptrs);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().name;
+        std::cout << "Allocated " << Allocated << " x " << std::setw(8) << size
+                  << " " << MT << " bytes" << std::endl;
+    }
+    return Allocated;
+}
+
+enum umf_result_t DisjointPool::free_batch(void **ptrs, size_t count) {
+    auto Ret = impl->deallocateBatch(ptrs, count);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().name;
+        std::cout << "Freed " << count << " " << MT << " allocations"
+                  << std::endl;
+    }
+    return Ret;
+}
+
 enum umf_result_t DisjointPool::get_last_allocation_error() {
     return umf::getPoolLastStatusRef<DisjointPool>();
 }
 
+umf_result_t DisjointPool::trim() {
+    impl->trim();
+    return UMF_RESULT_SUCCESS;
+}
+
+DisjointPoolStats DisjointPool::getStats() { return impl->getStats(); }
+
+DisjointPoolConfig DisjointPool::getTunedConfig(size_t MaxExtraBuckets) {
+    return impl->getTunedConfig(MaxExtraBuckets);
+}
+
+DisjointPoolThreadCacheStats DisjointPool::getThreadCacheStats() {
+    return impl->getThreadCacheStats();
+}
+
 DisjointPool::DisjointPool() {}
 
 // Define destructor for use with unique_ptr
@@ -964,7 +3255,8 @@ DisjointPool::~DisjointPool() {
     bool TitlePrinted = false;
     size_t HighBucketSize;
     size_t HighPeakSlabsInUse;
-    if (impl->getParams().PoolTrace > 1) {
+    // impl is not set if initialize failed
+    if (impl && impl->getParams().PoolTrace > 1) {
         auto name = impl->getParams().name;
         try { // cannot throw in destructor
             impl->printStats(TitlePrinted, HighBucketSize, HighPeakSlabsInUse,
@@ -973,11 +3265,24 @@ DisjointPool::~DisjointPool() {
                 std::cout << "Current Pool Size "
                           << impl->getParams().limits->TotalSize.load()
                           << std::endl;
+                if (impl->getParams().ThreadCacheSize) {
+                    auto CacheStats = impl->getThreadCacheStats();
+                    std::cout << "Thread Cache Hits " << CacheStats.Hits
+                              << ", Misses " << CacheStats.Misses
+                              << ", Flushes " << CacheStats.Flushes
+                              << std::endl;
+                }
                 std::cout << "Suggested Setting=;"
                           << std::string(1, tolower(name[0]))
                           << std::string(name.c_str() + 1) << ":"
                           << HighBucketSize << "," << HighPeakSlabsInUse
                           << ",64K" << std::endl;
+                if (impl->getParams().SizeHistogramAllocs) {
+                    std::cout << "Suggested Size Classes="
+                              << formatDisjointPoolSizeClasses(
+                                     impl->getTunedConfig(8))
+                              << std::endl;
+                }
             }
         } catch (...) { // ignore exceptions
         }
@@ -10,13 +10,27 @@
 #define USM_ALLOCATOR
 
 #include <atomic>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "../umf_helpers.hpp"
 
 namespace usm {
 
+// How a pool with several memory providers chooses the provider for a slab
+// or for an allocation bypassing the buckets. Whichever provider is chosen
+// first, the others are tried in turn, wrapping around, if it fails.
+enum class DisjointPoolProviderPolicy {
+    // Round-robin over all providers, spreading the slabs evenly
+    Stripe,
+    // The first provider, the others only when it runs out of memory
+    Fallback,
+    // By size, see DisjointPoolConfig::ProviderSizeLimits
+    SizeRouted
+};
+
 // Configuration for specific USM allocator instance
 class DisjointPoolConfig {
   public:
@@ -53,9 +67,155 @@ class DisjointPoolConfig {
     // Whether to print pool usage statistics
     int PoolTrace = 0;
 
+    // Maximum number of chunks each thread keeps cached per bucket in front
+    // of the shared bucket. Chunks are moved between the thread cache and the
+    // bucket in batches of half of this size. 0 disables thread caching.
+    size_t ThreadCacheSize = 0;
+
+    // Maximum number of bytes of freed allocations above MaxPoolableSize kept
+    // for reuse. Adjacent freed ranges are merged, and ranges of memory
+    // obtained from the provider by a single allocation are split to serve
+    // requests of at least half of its size. Memory is returned to the
+    // provider in the same pieces it was allocated in, least recently freed
+    // first, when the limit is exceeded or on decay. Only pieces which are
+    // entirely free count towards the limit; the free part of a piece still
+    // in use is at most as large as the part in use. 0 disables the cache.
+    size_t MaxLargeCacheSize = 0;
+
+    // Number of independent sets of buckets, each with its own slab lists
+    // and locks. Threads are spread across the shards to reduce contention on
+    // the bucket locks, at the cost of more memory held in partially used
+    // slabs. Memory is always freed to the shard it was allocated from.
+    size_t NumShards = 1;
+
+    // Sizes of buckets created in addition to the default ones, which are the
+    // powers of 2 and the midpoints between them starting at MinBucketSize.
+    // Sizes are rounded up to the fundamental alignment. Typically learned by
+    // DisjointPool::getTunedConfig() of a previous run.
+    std::vector<size_t> ExtraBucketSizes;
+
+    // Capacity of the buckets of the given sizes, overriding Capacity, or the
+    // single pooled slab of buckets which split slabs into chunks.
+    std::map<size_t, size_t> BucketCapacities;
+
+    // Number of allocations after the pool is created whose sizes are
+    // recorded for DisjointPool::getTunedConfig(). 0 disables the recording.
+    size_t SizeHistogramAllocs = 0;
+
+    // Whether chunks are freed without taking the bucket lock. The free is
+    // recorded in an atomic bitmap of the slab and applied in bulk by the next
+    // allocation from the bucket, so threads freeing memory allocated by
+    // other threads do not contend with them. Until then, the freed chunks
+    // are reported as in use. Not used for chunks kept by thread caches.
+    bool DeferredFree = false;
+
+    // Whether the memory provider returns zero-initialized memory. If so,
+    // calloc does not clear memory which was not used since it was obtained
+    // from the provider.
+    bool ZeroedProviderMemory = false;
+
+    // Slabs kept in the pool for longer than this many milliseconds are
+    // purged with the memory provider's purge_lazy, and returned to the
+    // provider once they stay unused for twice as long. 0 disables the decay.
+    size_t PurgeDecayMs = 0;
+
+    // Whether the decay is applied periodically by a background thread,
+    // otherwise only by calls to DisjointPool::trim().
+    bool PurgeThread = false;
+
+    // Number of slabs allocated up front for each bucket, so that the first
+    // allocations do not have to wait for the memory provider. The slabs are
+    // put in the pool, so they are limited by the capacity of each bucket and
+    // by limits->MaxSize. If 0 but PrewarmSize is set, up to Capacity slabs
+    // are allocated.
+    size_t PrewarmSlabs = 0;
+
+    // Maximum number of bytes allocated up front across all buckets, smaller
+    // buckets first. 0 means no limit other than PrewarmSlabs.
+    size_t PrewarmSize = 0;
+
+    // Whether the slabs are allocated by a background thread instead of by
+    // DisjointPool::initialize()
+    bool PrewarmAsync = false;
+
+    // Policy used if the pool is created with several memory providers
+    DisjointPoolProviderPolicy ProviderPolicy =
+        DisjointPoolProviderPolicy::Fallback;
+
+    // For the SizeRouted policy, the largest size served by each provider
+    // except the last, in ascending order. Slabs are routed by the size of
+    // the chunks of their bucket. Sizes above the last limit, and those
+    // whose limit is missing, go to the last provider.
+    std::vector<size_t> ProviderSizeLimits;
+
     std::shared_ptr<SharedLimits> limits;
 };
 
+// Counters of the per-thread chunk caches of a pool instance
+struct DisjointPoolThreadCacheStats {
+    // Allocations served directly from a thread cache
+    size_t Hits = 0;
+
+    // Allocations which had to refill the thread cache from a bucket
+    size_t Misses = 0;
+
+    // Number of times a thread cache returned chunks to a bucket
+    size_t Flushes = 0;
+};
+
+// Counters of a single bucket of a pool instance
+struct DisjointPoolBucketStats {
+    // Size of the allocations served by the bucket
+    size_t Size = 0;
+
+    // Alignment of the slabs of the bucket, 0 for the default buckets
+    size_t Alignment = 0;
+
+    // Number of allocations and frees
+    size_t AllocCount = 0;
+    size_t FreeCount = 0;
+
+    // Allocations served from memory which was already held by the pool
+    size_t AllocPoolCount = 0;
+
+    // Chunks handed out by the bucket, including chunks in thread caches
+    size_t ChunksInUse = 0;
+
+    // Slabs with at least one chunk in use and slabs kept in the pool
+    size_t SlabsInUse = 0;
+    size_t SlabsInPool = 0;
+
+    // Peak values of the above
+    size_t MaxSlabsInUse = 0;
+    size_t MaxSlabsInPool = 0;
+};
+
+// Counters of a pool instance
+struct DisjointPoolStats {
+    // Buckets which served at least one allocation
+    std::vector<DisjointPoolBucketStats> Buckets;
+
+    // Number of allocations and frees, including those bypassing the buckets
+    size_t AllocCount = 0;
+    size_t FreeCount = 0;
+
+    // Allocations served from memory which was already held by the pool
+    size_t AllocPoolCount = 0;
+
+    // Bytes of chunks and of allocations bypassing the buckets in use
+    size_t InUseBytes = 0;
+
+    // Bytes of slabs kept in the pool and of cached large allocations
+    size_t PooledBytes = 0;
+
+    // Bytes currently allocated from the memory provider, and the peak value
+    size_t ResidentBytes = 0;
+    size_t PeakResidentBytes = 0;
+
+    // Part of ResidentBytes which is not in use, between 0 and 1
+    double Fragmentation = 0;
+};
+
 class DisjointPool {
   public:
     class AllocImpl;
@@ -64,13 +224,46 @@ class DisjointPool {
     umf_result_t initialize(umf_memory_provider_handle_t *providers,
                             size_t numProviders, DisjointPoolConfig parameters);
     void *malloc(size_t size);
+    // calloc and realloc access the memory from the host, so they must only
+    // be used with host-accessible memory
     void *calloc(size_t, size_t);
     void *realloc(void *, size_t);
     void *aligned_malloc(size_t size, size_t alignment);
     size_t malloc_usable_size(void *);
     enum umf_result_t free(void *ptr);
+
+    // Same as free, but size must be 0 or the size ptr was allocated with.
+    // Freeing allocations which bypass the pool then needs no slab lookup.
+    enum umf_result_t free_sized(void *ptr, size_t size);
     enum umf_result_t get_last_allocation_error();
 
+    // Allocate count blocks of size bytes into ptrs, taking the lock of the
+    // bucket serving them only once. Return the number of blocks allocated,
+    // which is less than count only on failure.
+    size_t malloc_batch(size_t size, size_t count, void **ptrs);
+
+    // Free count allocations of any size, taking the lock of each bucket
+    // involved only once. NULL elements are ignored.
+    enum umf_result_t free_batch(void **ptrs, size_t count);
+
+    // Apply the decay of pooled slabs now. If the decay is disabled, return
+    // all pooled slabs to the memory provider.
+    enum umf_result_t trim();
+
+    // Aggregated counters of all thread caches of this pool
+    DisjointPoolThreadCacheStats getThreadCacheStats();
+
+    // Current statistics of this pool. Cheap enough to be queried at runtime,
+    // the counters are updated whether or not PoolTrace is set.
+    DisjointPoolStats getStats();
+
+    // Configuration of this pool with up to MaxExtraBuckets size classes
+    // added to ExtraBucketSizes where they most reduce the memory wasted by
+    // rounding up the allocation sizes recorded so far, see
+    // SizeHistogramAllocs. BucketCapacities is raised for buckets which had
+    // to allocate more slabs than they ever had in use at once.
+    DisjointPoolConfig getTunedConfig(size_t MaxExtraBuckets = 8);
+
     DisjointPool();
     ~DisjointPool();
 
@@ -10,6 +10,10 @@
 
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
 namespace usm {
@@ -134,14 +138,23 @@ DisjointPoolAllConfigs parseDisjointPoolConfig(const std::string &config,
             }
         }
         if (More) {
-            ParamParser(Params, AllConfigs.Configs[LM].SlabMinSize,
-                        ParamWasSet);
+            More = ParamParser(Params, AllConfigs.Configs[LM].SlabMinSize,
+                               ParamWasSet);
             if (ParamWasSet && memType == DisjointPoolMemType::All) {
                 for (auto &Config : AllConfigs.Configs) {
                     Config.SlabMinSize = AllConfigs.Configs[LM].SlabMinSize;
                 }
             }
         }
+        if (More) {
+            ParamParser(Params, AllConfigs.Configs[LM].PrewarmSize,
+                        ParamWasSet);
+            if (ParamWasSet && memType == DisjointPoolMemType::All) {
+                for (auto &Config : AllConfigs.Configs) {
+                    Config.PrewarmSize = AllConfigs.Configs[LM].PrewarmSize;
+                }
+            }
+        }
     };
 
     auto MemTypeParser = [MemParser](std::string &Params) {
@@ -259,6 +272,16 @@ DisjointPoolAllConfigs parseDisjointPoolConfig(const std::string &config,
         << std::setw(12)
         << AllConfigs.Configs[DisjointPoolMemType::SharedReadOnly].Capacity
         << std::endl;
+    std::cout
+        << std::setw(15) << "PrewarmSize" << std::setw(12)
+        << AllConfigs.Configs[DisjointPoolMemType::Host].PrewarmSize
+        << std::setw(12)
+        << AllConfigs.Configs[DisjointPoolMemType::Device].PrewarmSize
+        << std::setw(12)
+        << AllConfigs.Configs[DisjointPoolMemType::Shared].PrewarmSize
+        << std::setw(12)
+        << AllConfigs.Configs[DisjointPoolMemType::SharedReadOnly].PrewarmSize
+        << std::endl;
     std::cout << std::setw(15) << "MaxPoolSize" << std::setw(12)
               << limits->MaxSize << std::endl;
     std::cout << std::setw(15) << "EnableBuffers" << std::setw(12)
@@ -267,4 +290,74 @@ DisjointPoolAllConfigs parseDisjointPoolConfig(const std::string &config,
 
     return AllConfigs;
 }
+
+std::string formatDisjointPoolSizeClasses(const DisjointPoolConfig &config) {
+    std::set<size_t> Sizes(config.ExtraBucketSizes.begin(),
+                           config.ExtraBucketSizes.end());
+    for (auto &[Size, Capacity] : config.BucketCapacities) {
+        Sizes.insert(Size);
+    }
+
+    std::ostringstream Out;
+    for (auto Size : Sizes) {
+        if (Size != *Sizes.begin()) {
+            Out << ",";
+        }
+        Out << Size;
+
+        auto It = config.BucketCapacities.find(Size);
+        if (It != config.BucketCapacities.end()) {
+            Out << ":" << It->second;
+        }
+    }
+    return Out.str();
+}
+
+bool parseDisjointPoolSizeClasses(const std::string &sizeClasses,
+                                  DisjointPoolConfig &config) {
+    auto ParseNumber = [](const std::string &Str, size_t &Value) {
+        if (Str.empty() ||
+            Str.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        try {
+            auto Number = std::stoull(Str);
+            if (Number > std::numeric_limits<size_t>::max()) {
+                return false;
+            }
+            Value = Number;
+        } catch (std::out_of_range &) {
+            return false;
+        }
+        return true;
+    };
+
+    std::vector<size_t> Sizes;
+    std::map<size_t, size_t> Capacities;
+    std::istringstream In(sizeClasses);
+    std::string Entry;
+    while (std::getline(In, Entry, ',')) {
+        auto Pos = Entry.find(':');
+        size_t Size;
+        if (!ParseNumber(Entry.substr(0, Pos), Size)) {
+            return false;
+        }
+        Sizes.push_back(Size);
+
+        if (Pos != std::string::npos) {
+            size_t Capacity;
+            if (!ParseNumber(Entry.substr(Pos + 1), Capacity)) {
+                return false;
+            }
+            Capacities[Size] = Capacity;
+        }
+    }
+
+    config.ExtraBucketSizes.insert(config.ExtraBucketSizes.end(),
+                                   Sizes.begin(), Sizes.end());
+    for (auto &[Size, Capacity] : Capacities) {
+        config.BucketCapacities[Size] = Capacity;
+    }
+    return true;
+}
 } // namespace usm
@@ -30,7 +30,7 @@ class DisjointPoolAllConfigs {
 // [EnableBuffers][;[MaxPoolSize][;memtypelimits]...]
 //  memtypelimits: [<memtype>:]<limits>
 //  memtype: host|device|shared
-//  limits:  [MaxPoolableSize][,[Capacity][,SlabMinSize]]
+//  limits:  [MaxPoolableSize][,[Capacity][,[SlabMinSize][,PrewarmSize]]]
 //
 // Without a memory type, the limits are applied to each memory type.
 // Parameters are for each context, except MaxPoolSize, which is overall
@@ -47,11 +47,29 @@ class DisjointPoolAllConfigs {
 //                  Default 4.
 // SlabMinSize:     Minimum allocation size requested from USM.
 //                  Default 64KB host and device, 2MB shared.
+// PrewarmSize:     Memory allocated into the pool when it is created, so
+//                  that the first allocations are served without calls to
+//                  USM. Spread over the buckets, smallest first.
+//                  Default 0.
 //
 // Example of usage:
 // "1;32M;host:1M,4,64K;device:1M,4,64K;shared:0,0,2M"
 DisjointPoolAllConfigs parseDisjointPoolConfig(const std::string &config,
                                                bool trace = 1);
+
+// Format ExtraBucketSizes and BucketCapacities of the config as:
+// <size>[:<capacity>][,<size>[:<capacity>]]...
+// so that size classes learned by DisjointPool::getTunedConfig() can be saved
+// and applied at the next start with parseDisjointPoolSizeClasses.
+std::string formatDisjointPoolSizeClasses(const DisjointPoolConfig &config);
+
+// Add the size classes in the format above to ExtraBucketSizes and
+// BucketCapacities of the config. Sizes of default buckets are added to
+// ExtraBucketSizes as well, where the pool ignores them, so only their
+// capacity takes effect. Return false if the string is malformed or a number
+// does not fit in size_t, leaving config intact.
+bool parseDisjointPoolSizeClasses(const std::string &sizeClasses,
+                                  DisjointPoolConfig &config);
 } // namespace usm
 
 #endif
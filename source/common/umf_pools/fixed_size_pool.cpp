@@ -0,0 +1,473 @@
+//===---------- fixed_size_pool.cpp - Object allocator for USM memory -----===//
+//
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "fixed_size_pool.hpp"
+
+namespace usm {
+
+namespace {
+
+// Header of a free object, stored in the object itself
+struct FreeObject {
+    FreeObject *Next;
+};
+
+// Free objects of a pool kept by a single thread
+struct ThreadCache {
+    FreeObject *Head = nullptr;
+    size_t Count = 0;
+};
+
+// Shared by a pool and the thread-local cache handles, so whichever goes away
+// last can still safely access it.
+struct CacheRegistry {
+    std::mutex Lock;
+
+    // Set to nullptr when the pool is destroyed
+    std::atomic<FixedSizePool::AllocImpl *> Owner;
+};
+
+// Owns a thread cache on behalf of a thread. On thread exit the cached
+// objects are returned to the pool, if it still exists.
+class ThreadCacheHandle {
+    std::shared_ptr<CacheRegistry> Registry;
+    ThreadCache Cache;
+
+  public:
+    explicit ThreadCacheHandle(std::shared_ptr<CacheRegistry> Reg)
+        : Registry(std::move(Reg)) {}
+    ~ThreadCacheHandle();
+
+    ThreadCache &getCache() { return Cache; }
+    bool isOwnerAlive() const { return Registry->Owner.load() != nullptr; }
+};
+
+} // namespace
+
+class FixedSizePool::AllocImpl {
+    umf_memory_provider_handle_t MemHandle;
+
+    // Configuration for this instance, with the sizes rounded up
+    FixedSizePoolConfig params;
+
+    // Number of objects moved between a thread cache and the shared list
+    size_t BatchSize;
+
+    // Free objects not kept by any thread, and the part of the newest slab
+    // which was never handed out, protected by Lock
+    FreeObject *SharedHead = nullptr;
+    char *UnusedBegin = nullptr;
+    char *UnusedEnd = nullptr;
+    std::vector<void *> Slabs;
+    std::mutex Lock;
+
+    // Unique id of this instance, used to find the thread caches of the pool
+    const uint64_t PoolId;
+    static std::atomic<uint64_t> NextPoolId;
+
+    std::shared_ptr<CacheRegistry> Registry;
+
+    // Allocate a new slab as the unused part, with Lock held
+    bool newSlab();
+
+    // Get the calling thread's cache for this pool, creating it if needed.
+    // nullptr if thread caching is disabled or the cache cannot be created.
+    ThreadCache *getThreadCache();
+
+  public:
+    AllocImpl(umf_memory_provider_handle_t hProvider,
+              FixedSizePoolConfig params);
+    ~AllocImpl();
+
+    const FixedSizePoolConfig &getParams() const { return params; }
+
+    void *allocate();
+    void deallocate(void *Ptr);
+    size_t allocateBatch(size_t Count, void **Ptrs);
+    void deallocateBatch(void **Ptrs, size_t Count);
+
+    // Take up to Count objects from the shared list and the unused part of
+    // the slabs, allocating a new slab if needed. Return them as a list,
+    // Taken is set to its length.
+    FreeObject *takeShared(size_t Count, size_t &Taken);
+
+    // Put the list from Head to Tail on the shared list
+    void putShared(FreeObject *Head, FreeObject *Tail);
+
+    // Put the first Count objects of the thread cache on the shared list
+    void flushThreadCache(ThreadCache &Cache, size_t Count);
+};
+
+std::atomic<uint64_t> FixedSizePool::AllocImpl::NextPoolId{1};
+
+// Thread caches of the calling thread, keyed by the id of the pool they
+// belong to. Pool ids are never reused, so an entry left behind by a destroyed
+// pool cannot be mistaken for the cache of a live one.
+static thread_local std::unordered_map<uint64_t,
+                                       std::unique_ptr<ThreadCacheHandle>>
+    ThreadCaches;
+
+// The most recently used entry of ThreadCaches
+static thread_local uint64_t LastThreadCachePoolId = 0;
+static thread_local ThreadCache *LastThreadCache = nullptr;
+
+ThreadCacheHandle::~ThreadCacheHandle() {
+    std::lock_guard<std::mutex> Lg(Registry->Lock);
+
+    // The registry lock also keeps the pool alive while flushing.
+    if (auto *Owner = Registry->Owner.load()) {
+        Owner->flushThreadCache(Cache, Cache.Count);
+    }
+}
+
+FixedSizePool::AllocImpl::AllocImpl(umf_memory_provider_handle_t hProvider,
+                                    FixedSizePoolConfig params)
+    : MemHandle(hProvider), params(params),
+      BatchSize(std::max<size_t>(params.ThreadCacheSize / 2, 1)),
+      PoolId(NextPoolId++), Registry(std::make_shared<CacheRegistry>()) {
+    Registry->Owner = this;
+}
+
+FixedSizePool::AllocImpl::~AllocImpl() {
+    // Objects left in thread caches are released together with their slabs,
+    // the threads only need to know they must not return them here anymore.
+    {
+        std::lock_guard<std::mutex> Lg(Registry->Lock);
+        Registry->Owner = nullptr;
+    }
+
+    for (void *Slab : Slabs) {
+        umfMemoryProviderFree(MemHandle, Slab, params.SlabSize);
+    }
+}
+
+bool FixedSizePool::AllocImpl::newSlab() {
+    try {
+        Slabs.reserve(Slabs.size() + 1);
+    } catch (std::bad_alloc &) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        return false;
+    }
+
+    void *Slab;
+    size_t Alignment =
+        params.Alignment > alignof(std::max_align_t) ? params.Alignment : 0;
+    auto Ret =
+        umfMemoryProviderAlloc(MemHandle, params.SlabSize, Alignment, &Slab);
+    if (Ret != UMF_RESULT_SUCCESS) {
+        umf::getPoolLastStatusRef<FixedSizePool>() = Ret;
+        return false;
+    }
+
+    Slabs.push_back(Slab);
+    UnusedBegin = static_cast<char *>(Slab);
+    UnusedEnd = UnusedBegin + params.SlabSize / params.ObjectSize *
+                                  params.ObjectSize;
+    return true;
+}
+
+FreeObject *FixedSizePool::AllocImpl::takeShared(size_t Count,
+                                                 size_t &Taken) {
+    FreeObject *Head = nullptr;
+    FreeObject *Tail = nullptr;
+    Taken = 0;
+
+    std::lock_guard<std::mutex> Lg(Lock);
+    if (SharedHead) {
+        Head = SharedHead;
+        while (Taken < Count && SharedHead) {
+            Tail = SharedHead;
+            SharedHead = SharedHead->Next;
+            ++Taken;
+        }
+    }
+
+    while (Taken < Count) {
+        if (UnusedBegin == UnusedEnd && !newSlab()) {
+            break;
+        }
+
+        auto *Object = reinterpret_cast<FreeObject *>(UnusedBegin);
+        UnusedBegin += params.ObjectSize;
+        if (Tail) {
+            Tail->Next = Object;
+        } else {
+            Head = Object;
+        }
+        Tail = Object;
+        ++Taken;
+    }
+
+    if (Tail) {
+        Tail->Next = nullptr;
+    }
+    return Head;
+}
+
+void FixedSizePool::AllocImpl::putShared(FreeObject *Head, FreeObject *Tail) {
+    std::lock_guard<std::mutex> Lg(Lock);
+    Tail->Next = SharedHead;
+    SharedHead = Head;
+}
+
+void FixedSizePool::AllocImpl::flushThreadCache(ThreadCache &Cache,
+                                                size_t Count) {
+    if (!Count) {
+        return;
+    }
+
+    FreeObject *Head = Cache.Head;
+    FreeObject *Tail = Head;
+    for (size_t i = 1; i < Count; i++) {
+        Tail = Tail->Next;
+    }
+    Cache.Head = Tail->Next;
+    Cache.Count -= Count;
+    putShared(Head, Tail);
+}
+
+ThreadCache *FixedSizePool::AllocImpl::getThreadCache() {
+    if (!params.ThreadCacheSize) {
+        return nullptr;
+    }
+    if (LastThreadCachePoolId == PoolId) {
+        return LastThreadCache;
+    }
+
+    try {
+        auto It = ThreadCaches.find(PoolId);
+        if (It == ThreadCaches.end()) {
+            // Drop the caches of pools which no longer exist before adding a
+            // new one, so they do not accumulate in long-running threads.
+            for (auto I = ThreadCaches.begin(); I != ThreadCaches.end();) {
+                if (!I->second->isOwnerAlive()) {
+                    if (I->first == LastThreadCachePoolId) {
+                        LastThreadCachePoolId = 0;
+                    }
+                    I = ThreadCaches.erase(I);
+                } else {
+                    ++I;
+                }
+            }
+
+            It = ThreadCaches
+                     .emplace(PoolId,
+                              std::make_unique<ThreadCacheHandle>(Registry))
+                     .first;
+        }
+
+        LastThreadCachePoolId = PoolId;
+        LastThreadCache = &It->second->getCache();
+        return LastThreadCache;
+    } catch (std::bad_alloc &) {
+        // Fall back to the shared list
+        return nullptr;
+    }
+}
+
+void *FixedSizePool::AllocImpl::allocate() {
+    size_t Taken;
+    auto *Cache = getThreadCache();
+    if (!Cache) {
+        return takeShared(1, Taken);
+    }
+
+    if (!Cache->Head) {
+        Cache->Head = takeShared(BatchSize, Taken);
+        Cache->Count = Taken;
+        if (!Cache->Head) {
+            return nullptr;
+        }
+    }
+
+    FreeObject *Object = Cache->Head;
+    Cache->Head = Object->Next;
+    --Cache->Count;
+    return Object;
+}
+
+void FixedSizePool::AllocImpl::deallocate(void *Ptr) {
+    auto *Object = static_cast<FreeObject *>(Ptr);
+    auto *Cache = getThreadCache();
+    if (!Cache) {
+        putShared(Object, Object);
+        return;
+    }
+
+    Object->Next = Cache->Head;
+    Cache->Head = Object;
+    if (++Cache->Count > params.ThreadCacheSize) {
+        flushThreadCache(*Cache, BatchSize);
+    }
+}
+
+size_t FixedSizePool::AllocImpl::allocateBatch(size_t Count, void **Ptrs) {
+    size_t Allocated = 0;
+    if (auto *Cache = getThreadCache()) {
+        while (Allocated < Count && Cache->Head) {
+            Ptrs[Allocated++] = Cache->Head;
+            Cache->Head = Cache->Head->Next;
+            --Cache->Count;
+        }
+    }
+
+    if (Allocated < Count) {
+        size_t Taken;
+        auto *Object = takeShared(Count - Allocated, Taken);
+        for (; Object; Object = Object->Next) {
+            Ptrs[Allocated++] = Object;
+        }
+    }
+    return Allocated;
+}
+
+void FixedSizePool::AllocImpl::deallocateBatch(void **Ptrs, size_t Count) {
+    size_t i = 0;
+    if (auto *Cache = getThreadCache()) {
+        for (; i < Count && Cache->Count < params.ThreadCacheSize; i++) {
+            if (auto *Object = static_cast<FreeObject *>(Ptrs[i])) {
+                Object->Next = Cache->Head;
+                Cache->Head = Object;
+                ++Cache->Count;
+            }
+        }
+    }
+
+    // The rest goes to the shared list at once
+    FreeObject *Head = nullptr;
+    FreeObject *Tail = nullptr;
+    for (; i < Count; i++) {
+        if (auto *Object = static_cast<FreeObject *>(Ptrs[i])) {
+            Object->Next = Head;
+            Head = Object;
+            if (!Tail) {
+                Tail = Object;
+            }
+        }
+    }
+    if (Head) {
+        putShared(Head, Tail);
+    }
+}
+
+umf_result_t FixedSizePool::initialize(umf_memory_provider_handle_t *providers,
+                                       size_t numProviders,
+                                       FixedSizePoolConfig parameters) {
+    auto &Alignment = parameters.Alignment;
+    Alignment = std::max(Alignment, alignof(FreeObject));
+    if (numProviders != 1 || !providers[0] || !parameters.ObjectSize ||
+        (Alignment & (Alignment - 1))) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    auto &ObjectSize = parameters.ObjectSize;
+    ObjectSize = std::max(ObjectSize, sizeof(FreeObject));
+    ObjectSize = (ObjectSize + Alignment - 1) & ~(Alignment - 1);
+    parameters.SlabSize = std::max(parameters.SlabSize, ObjectSize);
+
+    impl = std::make_unique<AllocImpl>(providers[0], parameters);
+    return UMF_RESULT_SUCCESS;
+}
+
+void *FixedSizePool::malloc(size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+    if (size > impl->getParams().ObjectSize) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
+    }
+    return impl->allocate();
+}
+
+void *FixedSizePool::calloc(size_t num, size_t size) {
+    if (size && num > std::numeric_limits<size_t>::max() / size) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
+    }
+
+    void *Ptr = malloc(num * size);
+    if (Ptr) {
+        std::memset(Ptr, 0, num * size);
+    }
+    return Ptr;
+}
+
+void *FixedSizePool::realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+    if (size > impl->getParams().ObjectSize) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return nullptr;
+    }
+    return ptr;
+}
+
+void *FixedSizePool::aligned_malloc(size_t size, size_t alignment) {
+    if ((alignment & (alignment - 1)) ||
+        alignment > impl->getParams().Alignment) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+        return nullptr;
+    }
+    return malloc(size);
+}
+
+size_t FixedSizePool::malloc_usable_size(void *ptr) {
+    return ptr ? impl->getParams().ObjectSize : 0;
+}
+
+enum umf_result_t FixedSizePool::free(void *ptr) {
+    if (ptr) {
+        impl->deallocate(ptr);
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+enum umf_result_t FixedSizePool::get_last_allocation_error() {
+    return umf::getPoolLastStatusRef<FixedSizePool>();
+}
+
+size_t FixedSizePool::malloc_batch(size_t size, size_t count, void **ptrs) {
+    if (size == 0 || size > impl->getParams().ObjectSize) {
+        umf::getPoolLastStatusRef<FixedSizePool>() =
+            UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        return 0;
+    }
+    return impl->allocateBatch(count, ptrs);
+}
+
+enum umf_result_t FixedSizePool::free_batch(void **ptrs, size_t count) {
+    impl->deallocateBatch(ptrs, count);
+    return UMF_RESULT_SUCCESS;
+}
+
+FixedSizePool::FixedSizePool() {}
+
+// Define destructor for use with unique_ptr
+FixedSizePool::~FixedSizePool() {}
+
+} // namespace usm
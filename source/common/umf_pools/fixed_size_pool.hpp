@@ -0,0 +1,86 @@
+//===---------- fixed_size_pool.hpp - Object allocator for USM memory -----===//
+//
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef USM_FIXED_SIZE_ALLOCATOR
+#define USM_FIXED_SIZE_ALLOCATOR
+
+#include <cstddef>
+#include <memory>
+
+#include "../umf_helpers.hpp"
+
+namespace usm {
+
+// Configuration for specific fixed-size allocator instance
+class FixedSizePoolConfig {
+  public:
+    // Size of the objects, rounded up to a multiple of Alignment
+    size_t ObjectSize = 0;
+
+    // Alignment of the objects, at least the alignment of a pointer
+    size_t Alignment = alignof(std::max_align_t);
+
+    // Size of the slabs requested from the memory provider, each split into
+    // as many objects as fit
+    size_t SlabSize = 64 * 1024;
+
+    // Maximum number of freed objects each thread keeps for its following
+    // allocations. Objects are moved between the thread and the shared free
+    // list in batches of half of this size. 0 disables thread caching.
+    size_t ThreadCacheSize = 64;
+
+    // Configuration for objects of type T
+    template <typename T> static FixedSizePoolConfig forType() {
+        FixedSizePoolConfig Config;
+        Config.ObjectSize = sizeof(T);
+        Config.Alignment = alignof(T);
+        return Config;
+    }
+};
+
+// Allocator for objects of a single size. Free objects are linked through
+// their own memory, in a list per thread and a shared list for the objects
+// the threads have too many of, so allocations and frees need no size class
+// lookup and mostly no lock. Since the free lists are stored in the objects,
+// the memory of the provider must be host-accessible. Slabs are only
+// returned to the provider when the pool is destroyed.
+class FixedSizePool {
+  public:
+    class AllocImpl;
+    using Config = FixedSizePoolConfig;
+
+    umf_result_t initialize(umf_memory_provider_handle_t *providers,
+                            size_t numProviders, FixedSizePoolConfig parameters);
+
+    // Allocations larger than the object size fail
+    void *malloc(size_t size);
+    void *calloc(size_t, size_t);
+    void *realloc(void *, size_t);
+    void *aligned_malloc(size_t size, size_t alignment);
+    size_t malloc_usable_size(void *);
+    enum umf_result_t free(void *ptr);
+    enum umf_result_t get_last_allocation_error();
+
+    // Allocate count objects of at least size bytes into ptrs, taking the
+    // shared list lock at most once. Return the number of objects allocated,
+    // which is less than count only on failure.
+    size_t malloc_batch(size_t size, size_t count, void **ptrs);
+
+    // Free count objects, taking the shared list lock at most once
+    enum umf_result_t free_batch(void **ptrs, size_t count);
+
+    FixedSizePool();
+    ~FixedSizePool();
+
+  private:
+    std::unique_ptr<AllocImpl> impl;
+};
+
+} // namespace usm
+
+#endif
@@ -28,8 +28,9 @@ extern "C" {
 /// \brief Extracts 'UMF' API minor version
 #define UMF_MINOR_VERSION(_ver) (_ver & 0x0000ffff)
 
-/// \brief Current version of the UMF headers
-#define UMF_VERSION_CURRENT UMF_MAKE_VERSION(0, 9)
+/// \brief Current version of the UMF headers. Ops structures of version 0.9
+/// are still accepted, see memory_provider_ops.h and memory_pool_ops.h.
+#define UMF_VERSION_CURRENT UMF_MAKE_VERSION(0, 10)
 
 /// \brief Operation results
 enum umf_result_t {
@@ -20,7 +20,11 @@ extern "C" {
 typedef struct umf_ipc_data_t *umf_ipc_handle_t;
 
 ///
-/// \brief Creates an IPC handle for the specified UMF allocation.
+/// \brief Creates an IPC handle for the specified UMF allocation. The handle
+///        is a flat buffer of size bytes which can be copied to other
+///        processes, e.g. through a pipe or shared memory. The memory
+///        provider is only asked for a handle the first time an allocation
+///        is exported, until it is freed.
 /// \param ptr pointer to the allocated memory.
 /// \param ipcHandle [out] returned IPC handle.
 /// \param size [out] size of IPC handle in bytes.
@@ -29,13 +33,19 @@ enum umf_result_t umfGetIPCHandle(const void *ptr, umf_ipc_handle_t *ipcHandle,
                                   size_t *size);
 
 ///
-/// \brief Release IPC handle retrieved by umfGetIPCHandle.
+/// \brief Release IPC handle retrieved by umfGetIPCHandle. Must be called by
+///        the process which created the handle. Handles of allocations
+///        which are not freed yet stay cached.
 /// \param ipcHandle IPC handle.
 /// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
 enum umf_result_t umfPutIPCHandle(umf_ipc_handle_t ipcHandle);
 
 ///
-/// \brief Open IPC handle retrieved by umfGetIPCHandle.
+/// \brief Open IPC handle retrieved by umfGetIPCHandle. The memory provider of
+///        hPool at the same index as the one the memory was allocated from
+///        must be of the same kind. The memory is mapped until
+///        umfCloseIPCHandle is called, it must not be freed with umfFree.
+///        Requires pool tracking, UMF_RESULT_ERROR_NOT_SUPPORTED otherwise.
 /// \param hPool [in] Pool handle where to open the the IPC handle.
 /// \param ipcHandle [in] IPC handle.
 /// \param ptr [out] pointer to the memory in the current process.
@@ -44,7 +54,8 @@ enum umf_result_t umfOpenIPCHandle(umf_memory_pool_handle_t hPool,
                                    umf_ipc_handle_t ipcHandle, void **ptr);
 
 ///
-/// \brief Close IPC handle.
+/// \brief Close IPC handle. The memory stays mapped, up to a limit, so that
+///        opening the same handle again is cheap.
 /// \param ptr [in] pointer to the memory.
 /// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
 enum umf_result_t umfCloseIPCHandle(void *ptr);
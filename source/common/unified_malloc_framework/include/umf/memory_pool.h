@@ -100,6 +100,35 @@ size_t umfPoolMallocUsableSize(umf_memory_pool_handle_t hPool, void *ptr);
 ///
 enum umf_result_t umfPoolFree(umf_memory_pool_handle_t hPool, void *ptr);
 
+///
+/// \brief Allocates count blocks of size bytes of uninitialized storage of the
+///        specified hPool. Pools which support it serve the whole batch at the
+///        cost of a single allocation, e.g. taking their locks only once,
+///        otherwise the blocks are allocated one by one.
+/// \param hPool specified memory hPool
+/// \param size number of bytes of each block
+/// \param count number of blocks to allocate
+/// \param ptrs [out] array of count elements receiving the allocated blocks
+/// \return Number of blocks allocated, stored in the first elements of ptrs.
+///         If it is less than count, umfPoolGetLastAllocationError returns
+///         the reason of the failure.
+///
+size_t umfPoolMallocBatch(umf_memory_pool_handle_t hPool, size_t size,
+                          size_t count, void **ptrs);
+
+///
+/// \brief Frees count blocks of memory of the specified hPool, which may have
+///        been allocated with any allocation function and with different
+///        sizes. NULL elements are ignored.
+/// \param hPool specified memory hPool
+/// \param ptrs array of count pointers to the allocated memory
+/// \param count number of elements of ptrs
+/// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         All blocks are freed even if freeing one of them fails.
+///
+enum umf_result_t umfPoolFreeBatch(umf_memory_pool_handle_t hPool, void **ptrs,
+                                   size_t count);
+
 ///
 /// \brief Frees the memory space pointed by ptr if it belongs to UMF pool, does nothing otherwise.
 /// \param ptr pointer to the allocated memory
@@ -128,6 +157,25 @@ enum umf_result_t umfFree(void *ptr);
 ///         The value is undefined if the previous allocation was successful.
 enum umf_result_t umfPoolGetLastAllocationError(umf_memory_pool_handle_t hPool);
 
+///
+/// \brief Returns memory which is held by hPool but not used by any allocation
+///        back to its memory providers, according to the pool's policy.
+/// \param hPool specified memory hPool
+/// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if the pool does not support it.
+///
+enum umf_result_t umfPoolTrim(umf_memory_pool_handle_t hPool);
+
+///
+/// \brief Frees all memory allocated from hPool at once, for pools whose
+///        allocations are released together rather than one by one. Must not
+///        be called concurrently with other operations on hPool.
+/// \param hPool specified memory hPool
+/// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if the pool does not support it.
+///
+enum umf_result_t umfPoolReset(umf_memory_pool_handle_t hPool);
+
 ///
 /// \brief Retrieve memory pool associated with a given ptr. Only memory allocated
 ///        with the usage of a memory provider is being tracked.
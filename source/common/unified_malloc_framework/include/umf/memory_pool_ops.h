@@ -25,7 +25,8 @@ typedef struct umf_memory_provider_t *umf_memory_provider_handle_t;
 /// pointers.
 struct umf_memory_pool_ops_t {
     /// Version of the ops structure.
-    /// Should be initialized using UMF_VERSION_CURRENT
+    /// Should be initialized using UMF_VERSION_CURRENT. Structures of version
+    /// 0.9 end with get_last_allocation_error.
     uint32_t version;
 
     ///
@@ -53,6 +54,20 @@ struct umf_memory_pool_ops_t {
     size_t (*malloc_usable_size)(void *pool, void *ptr);
     enum umf_result_t (*free)(void *pool, void *);
     enum umf_result_t (*get_last_allocation_error)(void *pool);
+
+    /// Since version 0.10.
+    /// Optional, may be NULL if the pool does not support it.
+    /// Refer to memory_pool.h for description of this function
+    enum umf_result_t (*trim)(void *pool);
+
+    /// Optional, may be NULL if the pool does not support it.
+    /// Refer to memory_pool.h for description of this function
+    enum umf_result_t (*reset)(void *pool);
+
+    /// Optional, may be NULL if the pool does not support it.
+    /// Refer to memory_pool.h for description of those functions
+    size_t (*malloc_batch)(void *pool, size_t size, size_t count, void **ptrs);
+    enum umf_result_t (*free_batch)(void *pool, void **ptrs, size_t count);
 };
 
 #ifdef __cplusplus
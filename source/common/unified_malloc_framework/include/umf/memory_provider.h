@@ -20,6 +20,15 @@ extern "C" {
 
 typedef struct umf_memory_provider_t *umf_memory_provider_handle_t;
 
+/// \brief Access allowed to the memory allocated by memory providers which
+///        support setting it
+enum umf_mem_protection_flags_t {
+    UMF_PROTECTION_NONE = 0,         ///< Memory cannot be accessed
+    UMF_PROTECTION_READ = (1 << 0),  ///< Memory can be read
+    UMF_PROTECTION_WRITE = (1 << 1), ///< Memory can be written
+    UMF_PROTECTION_EXEC = (1 << 2),  ///< Memory can be executed
+};
+
 ///
 /// \brief Creates new memory provider.
 /// \param ops instance of umf_memory_provider_ops_t
@@ -150,6 +159,7 @@ umfMemoryProviderPurgeForce(umf_memory_provider_handle_t hProvider, void *ptr,
 /// \param hProvider [in] handle to the memory provider
 /// \param size [out] size of the ipc data structure created by the memory provider
 /// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if the provider does not support IPC.
 enum umf_result_t
 umfMemoryProviderGetIPCHandleSize(umf_memory_provider_handle_t hProvider,
                                   size_t *size);
@@ -189,10 +199,44 @@ umfMemoryProviderOpenIPCHandle(umf_memory_provider_handle_t hProvider,
 /// @brief close IPC handle open with umfMemoryProviderOpenIPCHandle function.
 /// \param hProvider [in] handle to the memory provider.
 /// \param ptr [in] pointer returned by umfMemoryProviderOpenIPCHandle function.
+/// \param size [in] size of the memory address range passed to
+///                  umfMemoryProviderGetIPCHandle.
 /// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
 enum umf_result_t
 umfMemoryProviderCloseIPCHandle(umf_memory_provider_handle_t hProvider,
-                                void *ptr);
+                                void *ptr, size_t size);
+
+///
+/// \brief Split an allocation into two allocations, which can then be freed
+///        or further split and merged independently.
+/// \param hProvider handle to the memory provider
+/// \param ptr pointer to the beginning of the allocation
+/// \param totalSize size of the allocation
+/// \param firstSize size of the first of the two allocations, which starts
+///        at ptr. The second one starts at ptr + firstSize.
+/// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_INVALID_ARGUMENT if firstSize is not smaller than
+///         totalSize or [ptr, ptr + totalSize) is not a single allocation.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if operation is not supported by this provider.
+enum umf_result_t
+umfMemoryProviderAllocationSplit(umf_memory_provider_handle_t hProvider,
+                                 void *ptr, size_t totalSize,
+                                 size_t firstSize);
+
+///
+/// \brief Merge two adjacent allocations into a single one.
+/// \param hProvider handle to the memory provider
+/// \param lowPtr pointer to the beginning of the lower allocation
+/// \param highPtr pointer to the beginning of the higher allocation, which
+///        must directly follow the lower one
+/// \param totalSize sum of the sizes of the two allocations
+/// \return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_INVALID_ARGUMENT if the allocations are not adjacent.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if operation is not supported by this provider.
+enum umf_result_t
+umfMemoryProviderAllocationMerge(umf_memory_provider_handle_t hProvider,
+                                 void *lowPtr, void *highPtr,
+                                 size_t totalSize);
 
 ///
 /// \brief Retrieve name of a given memory provider.
@@ -23,7 +23,8 @@ extern "C" {
 /// initialize all function pointers.
 struct umf_memory_provider_ops_t {
     /// Version of the ops structure.
-    /// Should be initialized using UMF_VERSION_CURRENT
+    /// Should be initialized using UMF_VERSION_CURRENT. Structures of version
+    /// 0.9 end with close_ipc_handle, which takes no size argument there.
     uint32_t version;
 
     ///
@@ -52,13 +53,25 @@ struct umf_memory_provider_ops_t {
     enum umf_result_t (*purge_force)(void *provider, void *ptr, size_t size);
     const char *(*get_name)(void *provider);
     bool (*supports_device)(const char *name);
+
+    /// Optional, may be NULL if the provider does not support IPC.
+    /// Refer to memory_provider.h for description of those functions
     enum umf_result_t (*get_ipc_handle_size)(void *provider, size_t *size);
     enum umf_result_t (*get_ipc_handle)(void *provider, const void *ptr,
                                         size_t size, void *ipcData);
     enum umf_result_t (*put_ipc_handle)(void *provider, void *ipcData);
     enum umf_result_t (*open_ipc_handle)(void *provider, void *ipcData,
                                          void **ptr);
-    enum umf_result_t (*close_ipc_handle)(void *provider, void *ptr);
+    enum umf_result_t (*close_ipc_handle)(void *provider, void *ptr,
+                                          size_t size);
+
+    /// Since version 0.10.
+    /// Optional, may be NULL if the provider does not support them.
+    /// Refer to memory_provider.h for description of those functions
+    enum umf_result_t (*allocation_split)(void *provider, void *ptr,
+                                          size_t totalSize, size_t firstSize);
+    enum umf_result_t (*allocation_merge)(void *provider, void *lowPtr,
+                                          void *highPtr, size_t totalSize);
 };
 
 #ifdef __cplusplus
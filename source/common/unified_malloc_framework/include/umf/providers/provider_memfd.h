@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef UMF_PROVIDER_MEMFD_H
+#define UMF_PROVIDER_MEMFD_H 1
+
+#include <umf/memory_provider.h>
+#include <umf/memory_provider_ops.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// \brief Parameters of the memfd memory provider
+struct umf_memfd_memory_provider_params_t {
+    /// Combination of umf_mem_protection_flags_t, used both for the
+    /// allocations and for the memory opened from IPC handles
+    unsigned protection;
+};
+
+///
+/// \brief Operations of the memfd memory provider, which backs each
+///        allocation with its own anonymous file created by memfd_create
+///        and mapped shared. IPC handles of the allocations can be opened by
+///        other processes of the same user without copying the memory, by
+///        the same provider in the other process. Handles of freed
+///        allocations fail to open. Only available on Linux.
+///
+///        Each allocation holds a file descriptor until it is freed, so the
+///        number of live allocations is limited by RLIMIT_NOFILE. Pools
+///        should request large slabs from this provider, e.g. a SlabMinSize
+///        of several megabytes for the disjoint pool.
+/// \return Operations to pass to umfMemoryProviderCreate together with a
+///         pointer to umf_memfd_memory_provider_params_t
+const struct umf_memory_provider_ops_t *umfMemfdMemoryProviderOps(void);
+
+/// \brief Default parameters: readable and writable memory
+static inline struct umf_memfd_memory_provider_params_t
+umfMemfdMemoryProviderParamsDefault(void) {
+    struct umf_memfd_memory_provider_params_t params = {
+        UMF_PROTECTION_READ | UMF_PROTECTION_WRITE};
+    return params;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UMF_PROVIDER_MEMFD_H */
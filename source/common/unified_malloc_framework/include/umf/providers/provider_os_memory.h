@@ -0,0 +1,69 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef UMF_PROVIDER_OS_MEMORY_H
+#define UMF_PROVIDER_OS_MEMORY_H 1
+
+#include <umf/memory_provider.h>
+#include <umf/memory_provider_ops.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// \brief Huge pages used by the OS memory provider
+enum umf_os_huge_pages_t {
+    UMF_OS_HUGE_PAGES_NONE = 0, ///< Only pages of the base page size
+    /// Ask the kernel to back the memory with transparent huge pages where
+    /// possible. Allocations of at least one huge page are aligned to the
+    /// huge page size to make that possible.
+    UMF_OS_HUGE_PAGES_TRANSPARENT = 1,
+    /// Allocate only huge pages reserved by the administrator, sizes are
+    /// rounded up to the huge page size. Allocations fail if the reserved
+    /// huge pages are exhausted.
+    UMF_OS_HUGE_PAGES_EXPLICIT = 2,
+};
+
+/// \brief Parameters of the OS memory provider
+struct umf_os_memory_provider_params_t {
+    /// Combination of umf_mem_protection_flags_t
+    unsigned protection;
+
+    enum umf_os_huge_pages_t hugePages;
+
+    /// Size of the explicit huge pages, 0 for the default huge page size of
+    /// the system. Ignored for transparent huge pages, whose size is fixed.
+    size_t hugePageSize;
+};
+
+///
+/// \brief Operations of the OS memory provider, which allocates memory
+///        directly from the operating system with mmap/munmap. Allocations
+///        of any power of 2 alignment are supported. Memory can be freed in
+///        parts of the page size, allocation_split and allocation_merge are
+///        supported. IPC is not supported. Only available on Linux.
+/// \return Operations to pass to umfMemoryProviderCreate together with a
+///         pointer to umf_os_memory_provider_params_t
+const struct umf_memory_provider_ops_t *umfOsMemoryProviderOps(void);
+
+/// \brief Default parameters: readable and writable memory, no huge pages
+static inline struct umf_os_memory_provider_params_t
+umfOsMemoryProviderParamsDefault(void) {
+    struct umf_os_memory_provider_params_t params = {
+        UMF_PROTECTION_READ | UMF_PROTECTION_WRITE, UMF_OS_HUGE_PAGES_NONE,
+        0};
+    return params;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UMF_PROVIDER_OS_MEMORY_H */
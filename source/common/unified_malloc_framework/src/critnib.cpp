@@ -0,0 +1,321 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include "critnib.h"
+
+#include <cassert>
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+// Maximum number of nodes on the path from the root to a leaf: every node
+// consumes at least one slice of the key
+static constexpr unsigned MAX_DEPTH = sizeof(uintptr_t) * 8 / 4 + 1;
+
+static unsigned find_last_set(uintptr_t v) {
+    assert(v);
+#ifdef _WIN32
+    unsigned long pos;
+    _BitScanReverse64(&pos, v);
+    return pos;
+#else
+    return 63 - __builtin_clzll(static_cast<unsigned long long>(v));
+#endif
+}
+
+template <typename T> void critnib::deleted_list<T>::push(T *obj) {
+    obj->next_deleted = nullptr;
+    if (tail) {
+        tail->next_deleted = obj;
+    } else {
+        head = obj;
+    }
+    tail = obj;
+    count++;
+}
+
+template <typename T> T *critnib::deleted_list<T>::pop() {
+    if (count <= DELETED_LIFE) {
+        return nullptr;
+    }
+
+    T *obj = head;
+    head = obj->next_deleted;
+    if (!head) {
+        tail = nullptr;
+    }
+    count--;
+    return obj;
+}
+
+critnib::~critnib() {
+    delete_tree(root.load(std::memory_order_relaxed));
+    while (deleted_leaves.head) {
+        auto *next = deleted_leaves.head->next_deleted;
+        delete deleted_leaves.head;
+        deleted_leaves.head = next;
+    }
+    while (deleted_nodes.head) {
+        auto *next = deleted_nodes.head->next_deleted;
+        delete deleted_nodes.head;
+        deleted_nodes.head = next;
+    }
+}
+
+void critnib::delete_tree(uintptr_t n) {
+    if (!n) {
+        return;
+    }
+    if (is_leaf(n)) {
+        delete to_leaf(n);
+        return;
+    }
+    for (auto &child : to_node(n)->child) {
+        delete_tree(child.load(std::memory_order_relaxed));
+    }
+    delete to_node(n);
+}
+
+uintptr_t critnib::path_mask(unsigned shift) {
+    if (shift + SLICE >= sizeof(uintptr_t) * 8) {
+        return 0;
+    }
+    return ~(((uintptr_t)1 << (shift + SLICE)) - 1);
+}
+
+unsigned critnib::slice_index(uintptr_t key, unsigned shift) {
+    return (key >> shift) & (SLNODES - 1);
+}
+
+// Objects which lookups may still be reading are only written to after the
+// reuse count is bumped, so that the lookups notice and retry.
+critnib::leaf *critnib::alloc_leaf() {
+    if (auto *l = deleted_leaves.pop()) {
+        reuse_count.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return l;
+    }
+    return new leaf;
+}
+
+critnib::node *critnib::alloc_node() {
+    if (auto *n = deleted_nodes.pop()) {
+        reuse_count.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return n;
+    }
+    return new node;
+}
+
+bool critnib::insert(uintptr_t key, size_t size, void *value) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto *k = alloc_leaf();
+    k->key.store(key, std::memory_order_relaxed);
+    k->size.store(size, std::memory_order_relaxed);
+    k->value.store(value, std::memory_order_relaxed);
+    auto kn = (uintptr_t)k | 1;
+
+    // Descend while the key matches the path of the nodes
+    auto *slot = &root;
+    auto n = slot->load(std::memory_order_relaxed);
+    while (n && !is_leaf(n)) {
+        auto *nd = to_node(n);
+        auto shift = nd->shift.load(std::memory_order_relaxed);
+        if ((key & path_mask(shift)) !=
+            nd->path.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        slot = &nd->child[slice_index(key, shift)];
+        n = slot->load(std::memory_order_relaxed);
+    }
+
+    if (!n) {
+        slot->store(kn, std::memory_order_release);
+        return true;
+    }
+
+    uintptr_t at = is_leaf(n)
+                       ? to_leaf(n)->key.load(std::memory_order_relaxed)
+                       : to_node(n)->path.load(std::memory_order_relaxed);
+    if (is_leaf(n) && at == key) {
+        deleted_leaves.push(k);
+        return false;
+    }
+
+    // New node at the highest slice where the key and n differ, with both
+    // of them as its children
+    auto shift = find_last_set(at ^ key) & ~(SLICE - 1);
+    auto *m = alloc_node();
+    for (auto &child : m->child) {
+        child.store(0, std::memory_order_relaxed);
+    }
+    m->child[slice_index(key, shift)].store(kn, std::memory_order_relaxed);
+    m->child[slice_index(at, shift)].store(n, std::memory_order_relaxed);
+    m->shift.store(shift, std::memory_order_relaxed);
+    m->path.store(key & path_mask(shift), std::memory_order_relaxed);
+
+    slot->store((uintptr_t)m, std::memory_order_release);
+    return true;
+}
+
+bool critnib::remove(uintptr_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::atomic<uintptr_t> *parent_slot = nullptr;
+    auto *slot = &root;
+    auto n = slot->load(std::memory_order_relaxed);
+    while (n && !is_leaf(n)) {
+        parent_slot = slot;
+        auto *nd = to_node(n);
+        slot = &nd->child[slice_index(
+            key, nd->shift.load(std::memory_order_relaxed))];
+        n = slot->load(std::memory_order_relaxed);
+    }
+
+    if (!n || to_leaf(n)->key.load(std::memory_order_relaxed) != key) {
+        return false;
+    }
+
+    slot->store(0, std::memory_order_release);
+    deleted_leaves.push(to_leaf(n));
+    if (!parent_slot) {
+        return true;
+    }
+
+    // A node with a single child left is replaced by that child
+    auto *nd = to_node(parent_slot->load(std::memory_order_relaxed));
+    uintptr_t only = 0;
+    for (auto &child : nd->child) {
+        if (auto c = child.load(std::memory_order_relaxed)) {
+            if (only) {
+                return true;
+            }
+            only = c;
+        }
+    }
+
+    parent_slot->store(only, std::memory_order_release);
+    deleted_nodes.push(nd);
+    return true;
+}
+
+critnib::leaf *critnib::find_leaf(uintptr_t key) const {
+    auto n = root.load(std::memory_order_relaxed);
+    while (n && !is_leaf(n)) {
+        auto *nd = to_node(n);
+        n = nd->child[slice_index(key,
+                                  nd->shift.load(std::memory_order_relaxed))]
+                .load(std::memory_order_relaxed);
+    }
+
+    if (!n || to_leaf(n)->key.load(std::memory_order_relaxed) != key) {
+        return nullptr;
+    }
+    return to_leaf(n);
+}
+
+bool critnib::update(uintptr_t key, size_t size, void *value) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto *l = find_leaf(key);
+    if (!l) {
+        return false;
+    }
+
+    l->size.store(size, std::memory_order_relaxed);
+    l->value.store(value, std::memory_order_relaxed);
+    return true;
+}
+
+const critnib::leaf *critnib::find_max(uintptr_t n, unsigned depth,
+                                       bool &retry) const {
+    if (!n) {
+        return nullptr;
+    }
+    if (is_leaf(n)) {
+        return to_leaf(n);
+    }
+    if (depth > MAX_DEPTH) {
+        retry = true;
+        return nullptr;
+    }
+
+    auto *nd = to_node(n);
+    for (int i = SLNODES - 1; i >= 0 && !retry; i--) {
+        auto c = nd->child[i].load(std::memory_order_acquire);
+        if (auto *l = find_max(c, depth + 1, retry)) {
+            return l;
+        }
+    }
+    return nullptr;
+}
+
+const critnib::leaf *critnib::find_le(uintptr_t n, uintptr_t key,
+                                      unsigned depth, bool &retry) const {
+    if (!n) {
+        return nullptr;
+    }
+    if (is_leaf(n)) {
+        auto *l = to_leaf(n);
+        return l->key.load(std::memory_order_relaxed) <= key ? l : nullptr;
+    }
+    if (depth > MAX_DEPTH) {
+        retry = true;
+        return nullptr;
+    }
+
+    // If the key is not under this node, either all keys under it are
+    // smaller or all are larger
+    auto *nd = to_node(n);
+    auto shift = nd->shift.load(std::memory_order_relaxed);
+    auto path = nd->path.load(std::memory_order_relaxed);
+    if ((key & path_mask(shift)) != path) {
+        return path < key ? find_max(n, depth, retry) : nullptr;
+    }
+
+    // The subtree of the key, then the subtrees of smaller keys
+    int idx = slice_index(key, shift);
+    auto c = nd->child[idx].load(std::memory_order_acquire);
+    if (auto *l = find_le(c, key, depth + 1, retry)) {
+        return l;
+    }
+    for (int i = idx - 1; i >= 0 && !retry; i--) {
+        c = nd->child[i].load(std::memory_order_acquire);
+        if (auto *l = find_max(c, depth + 1, retry)) {
+            return l;
+        }
+    }
+    return nullptr;
+}
+
+bool critnib::find_le(uintptr_t key, uintptr_t *rkey, size_t *rsize,
+                      void **rvalue) const {
+    while (true) {
+        auto reuses = reuse_count.load(std::memory_order_acquire);
+
+        bool retry = false;
+        auto *l = find_le(root.load(std::memory_order_acquire), key, 0, retry);
+        if (l) {
+            *rkey = l->key.load(std::memory_order_relaxed);
+            *rsize = l->size.load(std::memory_order_relaxed);
+            *rvalue = l->value.load(std::memory_order_relaxed);
+        }
+
+        // Check that nothing read was reused in the meantime
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (retry || reuse_count.load(std::memory_order_relaxed) != reuses) {
+            continue;
+        }
+        return l != nullptr;
+    }
+}
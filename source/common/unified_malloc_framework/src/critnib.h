@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef UMF_CRITNIB_H
+#define UMF_CRITNIB_H 1
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Concurrent map from the start addresses of non-overlapping ranges to their
+// sizes and values, implemented as a critbit tree with 4-bit nibbles (critnib).
+//
+// Lookups take no locks. Inserts and removes are serialized by a mutex, but
+// only for the few steps needed to link or unlink a single leaf. Removed
+// nodes and leaves are kept for reuse until the critnib is destroyed, so a
+// lookup racing with a removal never reads freed memory. Reusing a node
+// bumps a counter which lookups check to retry if they may have seen it
+// change. Nodes are reused only after a number of later removals, so that
+// retries are rare.
+struct critnib {
+    critnib() = default;
+    ~critnib();
+
+    critnib(const critnib &) = delete;
+    critnib &operator=(const critnib &) = delete;
+
+    // Return false if a range starting at key is already present
+    bool insert(uintptr_t key, size_t size, void *value);
+
+    // Return false if there is no range starting at key
+    bool remove(uintptr_t key);
+
+    // Change the size and value of the range starting at key. A racing lookup
+    // may see the old size with the new value or vice versa. Return false if
+    // there is no range starting at key.
+    bool update(uintptr_t key, size_t size, void *value);
+
+    // Find the range with the largest start address not greater than key.
+    // Return false if there is none.
+    bool find_le(uintptr_t key, uintptr_t *rkey, size_t *rsize,
+                 void **rvalue) const;
+
+  private:
+    static constexpr unsigned SLICE = 4;
+    static constexpr unsigned SLNODES = 1 << SLICE;
+
+    // Number of removed nodes, and separately leaves, kept before the oldest
+    // one is reused
+    static constexpr size_t DELETED_LIFE = 16;
+
+    struct leaf {
+        std::atomic<uintptr_t> key{0};
+        std::atomic<size_t> size{0};
+        std::atomic<void *> value{nullptr};
+        leaf *next_deleted = nullptr;
+    };
+
+    // Children are tagged pointers, the lowest bit is set for leaves. All keys
+    // under a node share the bits above shift + SLICE, stored in path, and
+    // are indexed by the SLICE bits at shift.
+    struct node {
+        std::atomic<uintptr_t> child[SLNODES] = {};
+        std::atomic<uintptr_t> path{0};
+        std::atomic<unsigned> shift{0};
+        node *next_deleted = nullptr;
+    };
+
+    // Removed objects waiting to be reused, oldest first
+    template <typename T> struct deleted_list {
+        T *head = nullptr;
+        T *tail = nullptr;
+        size_t count = 0;
+
+        void push(T *obj);
+        T *pop();
+    };
+
+    static bool is_leaf(uintptr_t n) { return n & 1; }
+    static leaf *to_leaf(uintptr_t n) { return (leaf *)(n & ~(uintptr_t)1); }
+    static node *to_node(uintptr_t n) { return (node *)n; }
+
+    static uintptr_t path_mask(unsigned shift);
+    static unsigned slice_index(uintptr_t key, unsigned shift);
+
+    // Get a removed object old enough to be reused, or a new one.
+    leaf *alloc_leaf();
+    node *alloc_node();
+
+    // Lookup helpers. Depth bounds the recursion, as following a node which
+    // was reused concurrently may lead anywhere. Return nullptr on failure,
+    // setting retry if the lookup has to be repeated.
+    const leaf *find_le(uintptr_t n, uintptr_t key, unsigned depth,
+                        bool &retry) const;
+    const leaf *find_max(uintptr_t n, unsigned depth, bool &retry) const;
+
+    // Leaf with the given key, must be called with the mutex held
+    leaf *find_leaf(uintptr_t key) const;
+
+    static void delete_tree(uintptr_t n);
+
+    std::atomic<uintptr_t> root{0};
+
+    // Number of reused nodes and leaves
+    std::atomic<uint64_t> reuse_count{0};
+
+    deleted_list<leaf> deleted_leaves;
+    deleted_list<node> deleted_nodes;
+
+    std::mutex mutex;
+};
+
+#endif /* UMF_CRITNIB_H */
@@ -10,90 +10,152 @@
 
 #include "umf/ipc.h"
 
+#include "ipc_internal.h"
 #include "memory_pool_internal.h"
+#include "memory_provider_internal.h"
 #include "memory_tracker.h"
 
-#include <assert.h>
 #include <stdlib.h>
 
-struct umf_ipc_data_t {
-    // TODO: uint32_t or uint16_t should be enough because IPC handle is small.
-    uint64_t size;
-    uint64_t offset;
-    char providerData[];
-};
+enum umf_result_t umfIpcExportHandle(const struct umf_alloc_info_t *allocInfo,
+                                     uint64_t id,
+                                     struct umf_ipc_data_t **ipcData) {
+    umf_memory_pool_handle_t pool = allocInfo->pool;
+    umf_memory_provider_handle_t provider = allocInfo->provider;
+
+    size_t providerIndex = 0;
+    for (; providerIndex < pool->numProviders; providerIndex++) {
+        umf_memory_provider_handle_t hUpstream;
+        umfTrackingMemoryProviderGetUpstreamProvider(
+            umfMemoryProviderGetPriv(pool->providers[providerIndex]),
+            &hUpstream);
+        if (hUpstream == provider) {
+            break;
+        }
+    }
+    if (providerIndex == pool->numProviders) {
+        // The allocation does not belong to any provider of its pool
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
 
-enum umf_result_t
-umfGetIPCHandle(const void *ptr, umf_ipc_handle_t *umfIPCHandle, size_t *size) {
-    size_t ipcHandleSize = 0;
-    struct umf_alloc_info_t allocInfo;
+    size_t providerIPCHandleSize;
     enum umf_result_t res =
-        umfMemoryTrackerGetAllocInfo(umfMemoryTrackerGet(), ptr, &allocInfo);
+        umfMemoryProviderGetIPCHandleSize(provider, &providerIPCHandleSize);
     if (res != UMF_RESULT_SUCCESS) {
         return res;
     }
 
-    // TODO: we have no cases with multiple memory providers
-    assert(allocInfo.pool->numProviders == 1);
-    umf_memory_provider_handle_t provider = allocInfo.pool->providers[0];
+    size_t ipcHandleSize =
+        sizeof(struct umf_ipc_data_t) + providerIPCHandleSize;
+    struct umf_ipc_data_t *data = malloc(ipcHandleSize);
+    if (!data) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
 
-    size_t providerIPCHandleSize;
-    res = umfMemoryProviderGetIPCHandleSize(provider, &providerIPCHandleSize);
+    res = umfMemoryProviderGetIPCHandle(provider, allocInfo->base,
+                                        allocInfo->size,
+                                        umfIpcProviderData(data));
     if (res != UMF_RESULT_SUCCESS) {
+        free(data);
         return res;
     }
 
-    ipcHandleSize = sizeof(struct umf_ipc_data_t) + providerIPCHandleSize;
-    struct umf_ipc_data_t *ipcData = malloc(ipcHandleSize);
-    if (!ipcData) {
-        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    data->size = ipcHandleSize;
+    data->offset = 0;
+    data->id = id;
+    data->base = (uintptr_t)allocInfo->base;
+    data->baseSize = allocInfo->size;
+    data->providerIndex = providerIndex;
+
+    *ipcData = data;
+    return UMF_RESULT_SUCCESS;
+}
+
+void umfIpcReleaseHandle(umf_memory_provider_handle_t hProvider,
+                         struct umf_ipc_data_t *ipcData) {
+    if (umfMemoryProviderPutIPCHandle(hProvider, umfIpcProviderData(ipcData)) !=
+        UMF_RESULT_SUCCESS) {
+        // TODO: LOG
+    }
+    free(ipcData);
+}
+
+enum umf_result_t umfIpcMapHandle(umf_memory_pool_handle_t hPool,
+                                  const struct umf_ipc_data_t *ipcData,
+                                  umf_memory_provider_handle_t *hProvider,
+                                  void **base) {
+#ifndef UMF_ENABLE_POOL_TRACKING
+    // Opened memory could not be found by umfCloseIPCHandle
+    (void)hPool;
+    (void)ipcData;
+    (void)hProvider;
+    (void)base;
+    return UMF_RESULT_ERROR_NOT_SUPPORTED;
+#else
+    if (ipcData->providerIndex >= hPool->numProviders) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
     }
 
-    res =
-        umfMemoryProviderGetIPCHandle(provider, allocInfo.base, allocInfo.size,
-                                      (void *)ipcData->providerData);
+    // The tracking provider of the pool
+    umf_memory_provider_handle_t provider =
+        hPool->providers[ipcData->providerIndex];
+
+    enum umf_result_t res = umfMemoryProviderOpenIPCHandle(
+        provider, umfIpcProviderData(ipcData), base);
     if (res != UMF_RESULT_SUCCESS) {
-        free(ipcData);
         return res;
     }
 
-    ipcData->size = ipcHandleSize;
-    ipcData->offset = (uintptr_t)ptr - (uintptr_t)allocInfo.base;
-
-    *umfIPCHandle = ipcData;
-    *size = ipcHandleSize;
+    // Tracked as owned by hPool, so that umfCloseIPCHandle can find it
+    res = umfTrackingMemoryProviderAdd(provider, *base, ipcData->baseSize);
+    if (res != UMF_RESULT_SUCCESS) {
+        umfMemoryProviderCloseIPCHandle(provider, *base, ipcData->baseSize);
+        return res;
+    }
 
+    *hProvider = provider;
     return UMF_RESULT_SUCCESS;
+#endif
 }
 
-enum umf_result_t umfPutIPCHandle(umf_ipc_handle_t umfIPCHandle) {
-    return UMF_RESULT_ERROR_NOT_SUPPORTED;
+void umfIpcUnmapHandle(umf_memory_provider_handle_t hProvider, void *base,
+                       size_t size) {
+    if (umfMemoryTrackerRemove(umfMemoryTrackerGet(), base, size) !=
+            UMF_RESULT_SUCCESS ||
+        umfMemoryProviderCloseIPCHandle(hProvider, base, size) !=
+            UMF_RESULT_SUCCESS) {
+        // TODO: LOG
+    }
 }
 
-enum umf_result_t umfOpenIPCHandle(umf_memory_pool_handle_t hPool,
-                                   umf_ipc_handle_t umfIPCHandle, void **ptr) {
-    umf_memory_provider_handle_t hProvider;
-    size_t numProviders;
-    void *base = NULL;
-
-    // TODO: So far we have no pools that support more then 1 memory providers.
+enum umf_result_t
+umfGetIPCHandle(const void *ptr, umf_ipc_handle_t *umfIPCHandle, size_t *size) {
+    struct umf_alloc_info_t allocInfo;
     enum umf_result_t res =
-        umfPoolGetMemoryProviders(hPool, 1, &hProvider, &numProviders);
+        umfMemoryTrackerGetAllocInfo(umfMemoryTrackerGet(), ptr, &allocInfo);
     if (res != UMF_RESULT_SUCCESS) {
         return res;
     }
 
-    umfMemoryProviderOpenIPCHandle(hProvider,
-                                   (void *)umfIPCHandle->providerData, &base);
+    return umfIpcCacheGetHandle(&allocInfo, ptr, umfIPCHandle, size);
+}
 
-    *ptr = (void *)((uintptr_t)base + umfIPCHandle->offset);
+enum umf_result_t umfPutIPCHandle(umf_ipc_handle_t umfIPCHandle) {
+    return umfIpcCachePutHandle(umfIPCHandle);
+}
 
-    return UMF_RESULT_SUCCESS;
+enum umf_result_t umfOpenIPCHandle(umf_memory_pool_handle_t hPool,
+                                   umf_ipc_handle_t umfIPCHandle, void **ptr) {
+    return umfIpcCacheOpenHandle(hPool, umfIPCHandle, ptr);
 }
 
 enum umf_result_t umfCloseIPCHandle(void *ptr) {
-    return UMF_RESULT_ERROR_NOT_SUPPORTED;
-    umf_memory_provider_handle_t hProvider = NULL; // TODO: find memory provider
+    struct umf_alloc_info_t allocInfo;
+    enum umf_result_t res =
+        umfMemoryTrackerGetAllocInfo(umfMemoryTrackerGet(), ptr, &allocInfo);
+    if (res != UMF_RESULT_SUCCESS) {
+        return res;
+    }
 
-    return umfMemoryProviderCloseIPCHandle(hProvider, ptr);
+    return umfIpcCacheCloseHandle(allocInfo.base);
 }
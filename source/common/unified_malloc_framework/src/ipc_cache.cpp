@@ -0,0 +1,459 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include "ipc_internal.h"
+#include "memory_tracker.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Both caches keep entries which are not referenced any more on an idle
+// list, most recently used first, and release the oldest ones above a
+// limit. Providers are only called without the cache locks held: on a miss
+// the handle is exported or opened first and then inserted, a thread which
+// lost the race releases its own copy.
+
+namespace {
+
+// Each exported handle may hold a resource of the provider, e.g. a file
+// descriptor
+constexpr size_t MAX_IDLE_EXPORTED_HANDLES = 1024;
+
+// Each mapping holds address space and the resources of the provider
+constexpr size_t MAX_IDLE_MAPPINGS = 64;
+
+struct exported_handle_t {
+    umf_memory_pool_handle_t pool;
+    umf_memory_provider_handle_t provider;
+
+    // Offset is 0, copied for each umfGetIPCHandle
+    umf_ipc_data_t *ipcData;
+
+    // Copies which were not put yet, on the idle list if 0
+    size_t refCount;
+    std::list<uintptr_t>::iterator idlePos;
+};
+
+struct producer_cache_t {
+    std::mutex lock;
+    std::unordered_map<uintptr_t, exported_handle_t> handles;
+    std::list<uintptr_t> idle;
+
+    // Checked without the lock on every free
+    std::atomic<size_t> numHandles{0};
+
+    std::atomic<uint64_t> nextId{1};
+};
+
+// Provider handle data up to this size is part of the mapping key, larger
+// data is represented by its hash
+constexpr size_t MAX_KEY_PROVIDER_DATA = 32;
+
+// The opening pool and the part of the handle which identifies the exported
+// allocation
+struct mapping_key_t {
+    umf_memory_pool_handle_t pool;
+    uint64_t id;
+    uint64_t base;
+    uint64_t baseSize;
+    uint64_t providerIndex;
+    uint64_t providerDataSize;
+    unsigned char providerData[MAX_KEY_PROVIDER_DATA];
+
+    bool operator==(const mapping_key_t &other) const {
+        return pool == other.pool && id == other.id && base == other.base &&
+               baseSize == other.baseSize &&
+               providerIndex == other.providerIndex &&
+               providerDataSize == other.providerDataSize &&
+               memcmp(providerData, other.providerData,
+                      sizeof(providerData)) == 0;
+    }
+};
+
+// FNV-1a
+uint64_t hashBytes(const void *data, size_t size,
+                   uint64_t hash = 14695981039346656037ULL) {
+    auto *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct mapping_key_hash_t {
+    size_t operator()(const mapping_key_t &key) const {
+        uint64_t fields[] = {reinterpret_cast<uintptr_t>(key.pool),
+                             key.id,
+                             key.base,
+                             key.baseSize,
+                             key.providerIndex,
+                             key.providerDataSize};
+        return static_cast<size_t>(
+            hashBytes(key.providerData, sizeof(key.providerData),
+                      hashBytes(fields, sizeof(fields))));
+    }
+};
+
+struct mapping_t {
+    umf_memory_pool_handle_t pool;
+    umf_memory_provider_handle_t provider;
+    void *base;
+    size_t size;
+    mapping_key_t key;
+
+    // Opened and not closed yet, on the idle list if 0
+    size_t refCount;
+    std::list<uintptr_t>::iterator idlePos;
+};
+
+struct consumer_cache_t {
+    std::mutex lock;
+    std::unordered_map<uintptr_t, mapping_t> mappings;
+    std::unordered_map<mapping_key_t, mapping_t *, mapping_key_hash_t> byKey;
+    std::list<uintptr_t> idle;
+};
+
+// Never destroyed, pools may still be destroyed by static destructors
+producer_cache_t &producerCache() {
+    static auto *cache = new producer_cache_t;
+    return *cache;
+}
+
+consumer_cache_t &consumerCache() {
+    static auto *cache = new consumer_cache_t;
+    return *cache;
+}
+
+bool isExportOf(const exported_handle_t &handle,
+                const umf_alloc_info_t *allocInfo) {
+    return handle.pool == allocInfo->pool &&
+           handle.provider == allocInfo->provider &&
+           handle.ipcData->baseSize == allocInfo->size;
+}
+
+template <typename Entry>
+void acquire(Entry &entry, std::list<uintptr_t> &idle) {
+    if (entry.refCount++ == 0) {
+        idle.erase(entry.idlePos);
+    }
+}
+
+// Returns false if the entry is still referenced
+template <typename Entry>
+bool release(Entry &entry, uintptr_t key, std::list<uintptr_t> &idle) {
+    assert(entry.refCount > 0);
+    if (--entry.refCount > 0) {
+        return false;
+    }
+
+    entry.idlePos = idle.insert(idle.begin(), key);
+    return true;
+}
+
+umf_result_t copyHandle(exported_handle_t &handle, uintptr_t offset,
+                        std::list<uintptr_t> &idle,
+                        umf_ipc_handle_t *ipcHandle, size_t *size) {
+    auto *copy =
+        static_cast<umf_ipc_data_t *>(malloc(handle.ipcData->size));
+    if (!copy) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    memcpy(copy, handle.ipcData, handle.ipcData->size);
+    copy->offset = offset;
+    acquire(handle, idle);
+
+    *ipcHandle = copy;
+    *size = copy->size;
+    return UMF_RESULT_SUCCESS;
+}
+
+// Removes the entry from the cache, the caller releases the handle
+void eraseHandle(producer_cache_t &cache,
+                 decltype(producer_cache_t::handles)::iterator it) {
+    if (it->second.refCount == 0) {
+        cache.idle.erase(it->second.idlePos);
+    }
+    cache.handles.erase(it);
+    cache.numHandles.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Removes the mapping from the cache, the caller unmaps it
+void eraseMapping(consumer_cache_t &cache,
+                  decltype(consumer_cache_t::mappings)::iterator it) {
+    if (it->second.refCount == 0) {
+        cache.idle.erase(it->second.idlePos);
+    }
+    cache.byKey.erase(it->second.key);
+    cache.mappings.erase(it);
+}
+
+// ipcData->size must be at least sizeof(umf_ipc_data_t)
+mapping_key_t mappingKey(umf_memory_pool_handle_t hPool,
+                         const umf_ipc_data_t *ipcData) {
+    mapping_key_t key = {};
+    key.pool = hPool;
+    key.id = ipcData->id;
+    key.base = ipcData->base;
+    key.baseSize = ipcData->baseSize;
+    key.providerIndex = ipcData->providerIndex;
+    key.providerDataSize = ipcData->size - sizeof(umf_ipc_data_t);
+
+    const void *providerData = umfIpcProviderData(ipcData);
+    if (key.providerDataSize <= sizeof(key.providerData)) {
+        memcpy(key.providerData, providerData, key.providerDataSize);
+    } else {
+        uint64_t hash = hashBytes(providerData, key.providerDataSize);
+        memcpy(key.providerData, &hash, sizeof(hash));
+    }
+    return key;
+}
+
+} // namespace
+
+extern "C" {
+
+umf_result_t umfIpcCacheGetHandle(const umf_alloc_info_t *allocInfo,
+                                  const void *ptr,
+                                  umf_ipc_handle_t *ipcHandle, size_t *size) {
+    auto &cache = producerCache();
+    auto base = reinterpret_cast<uintptr_t>(allocInfo->base);
+    auto offset = reinterpret_cast<uintptr_t>(ptr) - base;
+
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it = cache.handles.find(base);
+        if (it != cache.handles.end() && isExportOf(it->second, allocInfo)) {
+            return copyHandle(it->second, offset, cache.idle, ipcHandle, size);
+        }
+    }
+
+    umf_ipc_data_t *ipcData = nullptr;
+    umf_result_t ret = umfIpcExportHandle(
+        allocInfo, cache.nextId.fetch_add(1, std::memory_order_relaxed),
+        &ipcData);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
+    exported_handle_t unused = {};
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it = cache.handles.find(base);
+        if (it != cache.handles.end()) {
+            if (isExportOf(it->second, allocInfo)) {
+                // Exported by another thread in the meantime
+                unused = {allocInfo->pool, allocInfo->provider, ipcData};
+            } else {
+                unused = it->second;
+                eraseHandle(cache, it);
+                it = cache.handles.end();
+            }
+        }
+
+        if (it == cache.handles.end()) {
+            auto idlePos = cache.idle.insert(cache.idle.begin(), base);
+            it = cache.handles
+                     .emplace(base,
+                              exported_handle_t{allocInfo->pool,
+                                                allocInfo->provider, ipcData,
+                                                0, idlePos})
+                     .first;
+            cache.numHandles.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ret = copyHandle(it->second, offset, cache.idle, ipcHandle, size);
+    }
+
+    if (unused.ipcData) {
+        umfIpcReleaseHandle(unused.provider, unused.ipcData);
+    }
+
+    return ret;
+}
+
+umf_result_t umfIpcCachePutHandle(umf_ipc_handle_t ipcHandle) {
+    auto &cache = producerCache();
+    exported_handle_t evicted = {};
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+
+        // The allocation may have been freed and its handle dropped in the
+        // meantime
+        auto it = cache.handles.find(ipcHandle->base);
+        if (it != cache.handles.end() &&
+            it->second.ipcData->id == ipcHandle->id &&
+            release(it->second, it->first, cache.idle) &&
+            cache.idle.size() > MAX_IDLE_EXPORTED_HANDLES) {
+            auto victim = cache.handles.find(cache.idle.back());
+            evicted = victim->second;
+            eraseHandle(cache, victim);
+        }
+    }
+
+    if (evicted.ipcData) {
+        umfIpcReleaseHandle(evicted.provider, evicted.ipcData);
+    }
+
+    free(ipcHandle);
+    return UMF_RESULT_SUCCESS;
+}
+
+void umfIpcCacheDropHandle(const void *ptr) {
+    auto &cache = producerCache();
+    if (cache.numHandles.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    umf_alloc_info_t allocInfo;
+    if (umfMemoryTrackerGetAllocInfo(umfMemoryTrackerGet(), ptr,
+                                     &allocInfo) != UMF_RESULT_SUCCESS) {
+        return;
+    }
+
+    exported_handle_t dropped = {};
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it =
+            cache.handles.find(reinterpret_cast<uintptr_t>(allocInfo.base));
+        if (it == cache.handles.end()) {
+            return;
+        }
+
+        // Copies which were not put yet become invalid as well
+        dropped = it->second;
+        eraseHandle(cache, it);
+    }
+
+    umfIpcReleaseHandle(dropped.provider, dropped.ipcData);
+}
+
+umf_result_t umfIpcCacheOpenHandle(umf_memory_pool_handle_t hPool,
+                                   umf_ipc_handle_t ipcHandle, void **ptr) {
+    // The size is read from a handle received from another process
+    if (ipcHandle->size < sizeof(umf_ipc_data_t)) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    auto &cache = consumerCache();
+    auto key = mappingKey(hPool, ipcHandle);
+
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it = cache.byKey.find(key);
+        if (it != cache.byKey.end()) {
+            acquire(*it->second, cache.idle);
+            *ptr = static_cast<char *>(it->second->base) + ipcHandle->offset;
+            return UMF_RESULT_SUCCESS;
+        }
+    }
+
+    umf_memory_provider_handle_t provider = nullptr;
+    void *base = nullptr;
+    umf_result_t ret = umfIpcMapHandle(hPool, ipcHandle, &provider, &base);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
+    void *unused = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it = cache.byKey.find(key);
+        if (it != cache.byKey.end()) {
+            // Opened by another thread in the meantime
+            acquire(*it->second, cache.idle);
+            unused = base;
+            base = it->second->base;
+        } else {
+            auto &mapping = cache.mappings[reinterpret_cast<uintptr_t>(base)];
+            mapping = {hPool, provider, base, ipcHandle->baseSize, key, 1};
+            cache.byKey.emplace(key, &mapping);
+        }
+    }
+
+    if (unused) {
+        umfIpcUnmapHandle(provider, unused, ipcHandle->baseSize);
+    }
+
+    *ptr = static_cast<char *>(base) + ipcHandle->offset;
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_result_t umfIpcCacheCloseHandle(const void *base) {
+    auto &cache = consumerCache();
+    mapping_t evicted = {};
+    {
+        std::lock_guard<std::mutex> lock(cache.lock);
+        auto it = cache.mappings.find(reinterpret_cast<uintptr_t>(base));
+        if (it == cache.mappings.end() || it->second.refCount == 0) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
+
+        if (release(it->second, it->first, cache.idle) &&
+            cache.idle.size() > MAX_IDLE_MAPPINGS) {
+            auto victim = cache.mappings.find(cache.idle.back());
+            evicted = victim->second;
+            eraseMapping(cache, victim);
+        }
+    }
+
+    if (evicted.base) {
+        umfIpcUnmapHandle(evicted.provider, evicted.base, evicted.size);
+    }
+
+    return UMF_RESULT_SUCCESS;
+}
+
+void umfIpcCacheRemovePool(umf_memory_pool_handle_t hPool) {
+    std::vector<std::pair<umf_memory_provider_handle_t, umf_ipc_data_t *>>
+        handles;
+    {
+        auto &cache = producerCache();
+        std::lock_guard<std::mutex> lock(cache.lock);
+        for (auto it = cache.handles.begin(); it != cache.handles.end();) {
+            auto next = std::next(it);
+            if (it->second.pool == hPool) {
+                handles.emplace_back(it->second.provider, it->second.ipcData);
+                eraseHandle(cache, it);
+            }
+            it = next;
+        }
+    }
+
+    std::vector<mapping_t> mappings;
+    {
+        auto &cache = consumerCache();
+        std::lock_guard<std::mutex> lock(cache.lock);
+        for (auto it = cache.mappings.begin(); it != cache.mappings.end();) {
+            auto next = std::next(it);
+            if (it->second.pool == hPool) {
+                mappings.push_back(it->second);
+                eraseMapping(cache, it);
+            }
+            it = next;
+        }
+    }
+
+    for (auto &[provider, ipcData] : handles) {
+        umfIpcReleaseHandle(provider, ipcData);
+    }
+
+    for (auto &mapping : mappings) {
+        umfIpcUnmapHandle(mapping.provider, mapping.base, mapping.size);
+    }
+}
+}
@@ -0,0 +1,107 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef UMF_IPC_INTERNAL_H
+#define UMF_IPC_INTERNAL_H 1
+
+#include <umf/base.h>
+#include <umf/ipc.h>
+#include <umf/memory_pool.h>
+
+#include "memory_tracker.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct umf_ipc_data_t {
+    // TODO: uint32_t or uint16_t should be enough because IPC handle is small.
+    uint64_t size;
+    uint64_t offset;
+
+    // The rest identifies the exported allocation, handles to the same
+    // allocation only differ in the offset
+
+    // Unique for each allocation exported by the process which created the
+    // handle, providers may reuse their handle data for a new allocation
+    uint64_t id;
+
+    // Allocation exported by the memory provider, the address is only valid
+    // in the process which created the handle
+    uint64_t base;
+    uint64_t baseSize;
+
+    // Index of the memory provider in the pool the allocation was obtained
+    // from. The handle is opened with the provider of the same index.
+    uint64_t providerIndex;
+
+    // Followed by the handle data of the memory provider
+};
+
+static inline void *umfIpcProviderData(const struct umf_ipc_data_t *ipcData) {
+    return (void *)(ipcData + 1);
+}
+
+// Uncached operations on the memory provider of the pool, implemented in
+// ipc.c
+
+// Export the whole allocation described by allocInfo, with the offset set
+// to 0. The handle is allocated with malloc. Fails with
+// UMF_RESULT_ERROR_INVALID_ARGUMENT if the provider of allocInfo is not one of
+// the providers of its pool.
+enum umf_result_t umfIpcExportHandle(const struct umf_alloc_info_t *allocInfo,
+                                     uint64_t id,
+                                     struct umf_ipc_data_t **ipcData);
+
+// Release the handle data of hProvider, which exported it, and free ipcData
+void umfIpcReleaseHandle(umf_memory_provider_handle_t hProvider,
+                         struct umf_ipc_data_t *ipcData);
+
+// Map the exported allocation with the matching provider of hPool and track
+// it as owned by hPool. hProvider is set to the provider to unmap it with.
+enum umf_result_t umfIpcMapHandle(umf_memory_pool_handle_t hPool,
+                                  const struct umf_ipc_data_t *ipcData,
+                                  umf_memory_provider_handle_t *hProvider,
+                                  void **base);
+
+void umfIpcUnmapHandle(umf_memory_provider_handle_t hProvider, void *base,
+                       size_t size);
+
+// Caches of exported and opened handles, implemented in ipc_cache.cpp
+
+// Handles exported by this process, keyed by the allocation base. The
+// provider's handle is kept until the allocation is freed, resized or the
+// pool is destroyed, umfPutIPCHandle only drops a reference.
+enum umf_result_t
+umfIpcCacheGetHandle(const struct umf_alloc_info_t *allocInfo, const void *ptr,
+                     umf_ipc_handle_t *ipcHandle, size_t *size);
+enum umf_result_t umfIpcCachePutHandle(umf_ipc_handle_t ipcHandle);
+
+// Must be called before the allocation containing ptr is freed or resized
+void umfIpcCacheDropHandle(const void *ptr);
+
+// Mappings of handles exported by other processes, keyed by the handle data.
+// Mappings which are no longer open are kept, up to a limit, and closed in
+// least recently used order.
+enum umf_result_t umfIpcCacheOpenHandle(umf_memory_pool_handle_t hPool,
+                                        umf_ipc_handle_t ipcHandle,
+                                        void **ptr);
+enum umf_result_t umfIpcCacheCloseHandle(const void *base);
+
+// Drop all exported handles and close all mappings owned by hPool
+void umfIpcCacheRemovePool(umf_memory_pool_handle_t hPool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UMF_IPC_INTERNAL_H */
@@ -14,7 +14,27 @@
 #include <umf/memory_pool_ops.h>
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Oldest supported version of the ops structure, which ends with
+// get_last_allocation_error
+#define UMF_POOL_OPS_VERSION_0_9 UMF_MAKE_VERSION(0, 9)
+
+enum umf_result_t umfPoolCopyOps(const struct umf_memory_pool_ops_t *ops,
+                                 struct umf_memory_pool_ops_t *dst) {
+    if (ops->version == UMF_VERSION_CURRENT) {
+        *dst = *ops;
+        return UMF_RESULT_SUCCESS;
+    }
+    if (ops->version == UMF_POOL_OPS_VERSION_0_9) {
+        memset(dst, 0, sizeof(*dst));
+        memcpy(dst, ops, offsetof(struct umf_memory_pool_ops_t, trim));
+        return UMF_RESULT_SUCCESS;
+    }
+    return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+}
 
 void *umfPoolMalloc(umf_memory_pool_handle_t hPool, size_t size) {
     return hPool->ops.malloc(hPool->pool_priv, size);
@@ -41,7 +61,56 @@ enum umf_result_t umfPoolFree(umf_memory_pool_handle_t hPool, void *ptr) {
     return hPool->ops.free(hPool->pool_priv, ptr);
 }
 
+size_t umfPoolMallocBatch(umf_memory_pool_handle_t hPool, size_t size,
+                          size_t count, void **ptrs) {
+    if (hPool->ops.malloc_batch) {
+        return hPool->ops.malloc_batch(hPool->pool_priv, size, count, ptrs);
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        ptrs[i] = hPool->ops.malloc(hPool->pool_priv, size);
+        if (!ptrs[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+enum umf_result_t umfPoolFreeBatch(umf_memory_pool_handle_t hPool, void **ptrs,
+                                   size_t count) {
+    if (hPool->ops.free_batch) {
+        return hPool->ops.free_batch(hPool->pool_priv, ptrs, count);
+    }
+
+    enum umf_result_t ret = UMF_RESULT_SUCCESS;
+    for (size_t i = 0; i < count; i++) {
+        if (!ptrs[i]) {
+            continue;
+        }
+        enum umf_result_t freeRet = hPool->ops.free(hPool->pool_priv, ptrs[i]);
+        if (ret == UMF_RESULT_SUCCESS) {
+            ret = freeRet;
+        }
+    }
+    return ret;
+}
+
 enum umf_result_t
 umfPoolGetLastAllocationError(umf_memory_pool_handle_t hPool) {
     return hPool->ops.get_last_allocation_error(hPool->pool_priv);
 }
+
+enum umf_result_t umfPoolTrim(umf_memory_pool_handle_t hPool) {
+    if (!hPool->ops.trim) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    return hPool->ops.trim(hPool->pool_priv);
+}
+
+enum umf_result_t umfPoolReset(umf_memory_pool_handle_t hPool) {
+    if (!hPool->ops.reset) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    return hPool->ops.reset(hPool->pool_priv);
+}
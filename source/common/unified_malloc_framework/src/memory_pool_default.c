@@ -8,6 +8,7 @@
  *
  */
 
+#include "ipc_internal.h"
 #include "memory_pool_internal.h"
 
 #include <umf/memory_pool.h>
@@ -23,14 +24,17 @@ enum umf_result_t umfPoolCreate(const struct umf_memory_pool_ops_t *ops,
         return UMF_RESULT_ERROR_INVALID_ARGUMENT;
     }
 
-    enum umf_result_t ret = UMF_RESULT_SUCCESS;
+    struct umf_memory_pool_ops_t poolOps;
+    enum umf_result_t ret = umfPoolCopyOps(ops, &poolOps);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
     umf_memory_pool_handle_t pool = malloc(sizeof(struct umf_memory_pool_t));
     if (!pool) {
         return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
     }
 
-    assert(ops->version == UMF_VERSION_CURRENT);
-
     pool->providers =
         calloc(numProviders, sizeof(umf_memory_provider_handle_t));
     if (!pool->providers) {
@@ -45,7 +49,7 @@ enum umf_result_t umfPoolCreate(const struct umf_memory_pool_ops_t *ops,
         pool->providers[providerInd] = providers[providerInd];
     }
 
-    pool->ops = *ops;
+    pool->ops = poolOps;
     ret = ops->initialize(pool->providers, pool->numProviders, params,
                           &pool->pool_priv);
     if (ret != UMF_RESULT_SUCCESS) {
@@ -64,6 +68,7 @@ err_providers_alloc:
 }
 
 void umfPoolDestroy(umf_memory_pool_handle_t hPool) {
+    umfIpcCacheRemovePool(hPool);
     hPool->ops.finalize(hPool->pool_priv);
     free(hPool->providers);
     free(hPool);
@@ -30,6 +30,11 @@ struct umf_memory_pool_t {
     size_t numProviders;
 };
 
+// Copy the ops of a new pool, accepting structures of older versions. The
+// fields added since are set to NULL.
+enum umf_result_t umfPoolCopyOps(const struct umf_memory_pool_ops_t *ops,
+                                 struct umf_memory_pool_ops_t *dst);
+
 #ifdef __cplusplus
 }
 #endif
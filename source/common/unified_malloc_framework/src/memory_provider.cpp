@@ -9,6 +9,7 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #include <algorithm>
@@ -27,6 +28,13 @@ struct umf_memory_provider_t {
 
 std::vector<struct umf_memory_provider_ops_t> globalProviders;
 
+// Oldest supported version of the ops structure, which ends with
+// close_ipc_handle taking no size argument
+#define UMF_PROVIDER_OPS_VERSION_0_9 UMF_MAKE_VERSION(0, 9)
+
+typedef enum umf_result_t (*umf_close_ipc_handle_0_9_t)(void *provider,
+                                                         void *ptr);
+
 enum umf_result_t
 umfMemoryProviderCreate(const struct umf_memory_provider_ops_t *ops,
                         void *params, umf_memory_provider_handle_t *hProvider) {
@@ -36,9 +44,17 @@ umfMemoryProviderCreate(const struct umf_memory_provider_ops_t *ops,
         return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
     }
 
-    assert(ops->version == UMF_VERSION_CURRENT);
-
-    provider->ops = *ops;
+    if (ops->version == UMF_VERSION_CURRENT) {
+        provider->ops = *ops;
+    } else if (ops->version == UMF_PROVIDER_OPS_VERSION_0_9) {
+        // The fields added since are not part of the caller's structure
+        memset(&provider->ops, 0, sizeof(provider->ops));
+        memcpy(&provider->ops, ops,
+               offsetof(struct umf_memory_provider_ops_t, allocation_split));
+    } else {
+        free(provider);
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
 
     void *provider_priv;
     enum umf_result_t ret = ops->initialize(params, &provider_priv);
@@ -174,33 +190,100 @@ const char *umfMemoryProviderGetName(umf_memory_provider_handle_t hProvider) {
 enum umf_result_t
 umfMemoryProviderGetIPCHandleSize(umf_memory_provider_handle_t hProvider,
                                   size_t *size) {
+    if (!hProvider->ops.get_ipc_handle_size) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
     return hProvider->ops.get_ipc_handle_size(hProvider->provider_priv, size);
 }
 
 enum umf_result_t
 umfMemoryProviderGetIPCHandle(umf_memory_provider_handle_t hProvider,
                               const void *ptr, size_t size, void *ipcData) {
-    return hProvider->ops.get_ipc_handle(hProvider->provider_priv, ptr, size,
-                                         ipcData);
+    if (!hProvider->ops.get_ipc_handle) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    enum umf_result_t res = hProvider->ops.get_ipc_handle(
+        hProvider->provider_priv, ptr, size, ipcData);
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
 }
 
 enum umf_result_t
 umfMemoryProviderPutIPCHandle(umf_memory_provider_handle_t hProvider,
                               void *ipcData) {
-    return hProvider->ops.put_ipc_handle(hProvider->provider_priv, ipcData);
+    if (!hProvider->ops.put_ipc_handle) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    enum umf_result_t res =
+        hProvider->ops.put_ipc_handle(hProvider->provider_priv, ipcData);
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
 }
 
 enum umf_result_t
 umfMemoryProviderOpenIPCHandle(umf_memory_provider_handle_t hProvider,
                                void *ipcData, void **ptr) {
-    return hProvider->ops.open_ipc_handle(hProvider->provider_priv, ipcData,
-                                          ptr);
+    if (!hProvider->ops.open_ipc_handle) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    enum umf_result_t res =
+        hProvider->ops.open_ipc_handle(hProvider->provider_priv, ipcData, ptr);
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
 }
 
 enum umf_result_t
 umfMemoryProviderCloseIPCHandle(umf_memory_provider_handle_t hProvider,
-                                void *ptr) {
-    return hProvider->ops.close_ipc_handle(hProvider->provider_priv, ptr);
+                                void *ptr, size_t size) {
+    if (!hProvider->ops.close_ipc_handle) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    enum umf_result_t res;
+    if (hProvider->ops.version == UMF_PROVIDER_OPS_VERSION_0_9) {
+        auto closeIpcHandle = reinterpret_cast<umf_close_ipc_handle_0_9_t>(
+            reinterpret_cast<void (*)(void)>(hProvider->ops.close_ipc_handle));
+        res = closeIpcHandle(hProvider->provider_priv, ptr);
+    } else {
+        res = hProvider->ops.close_ipc_handle(hProvider->provider_priv, ptr,
+                                              size);
+    }
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
+}
+
+enum umf_result_t
+umfMemoryProviderAllocationSplit(umf_memory_provider_handle_t hProvider,
+                                 void *ptr, size_t totalSize,
+                                 size_t firstSize) {
+    if (!hProvider->ops.allocation_split) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    if (firstSize == 0 || firstSize >= totalSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    enum umf_result_t res = hProvider->ops.allocation_split(
+        hProvider->provider_priv, ptr, totalSize, firstSize);
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
+}
+
+enum umf_result_t
+umfMemoryProviderAllocationMerge(umf_memory_provider_handle_t hProvider,
+                                 void *lowPtr, void *highPtr,
+                                 size_t totalSize) {
+    if (!hProvider->ops.allocation_merge) {
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+    }
+    if ((uintptr_t)highPtr <= (uintptr_t)lowPtr ||
+        (uintptr_t)highPtr - (uintptr_t)lowPtr >= totalSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    enum umf_result_t res = hProvider->ops.allocation_merge(
+        hProvider->provider_priv, lowPtr, highPtr, totalSize);
+    checkErrorAndSetLastProvider(res, hProvider);
+    return res;
 }
 
 umf_memory_provider_handle_t umfGetLastFailedMemoryProvider(void) {
@@ -9,67 +9,161 @@
  */
 
 #include "memory_tracker.h"
+#include "critnib.h"
+#include "ipc_internal.h"
 #include <umf/memory_provider.h>
 #include <umf/memory_provider_ops.h>
 
+#include "memory_provider_internal.h"
+
+#include <atomic>
 #include <cassert>
-#include <map>
-#include <mutex>
-#include <shared_mutex>
 #include <stdlib.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-struct tracker_value_t {
-    size_t size;
-    void *pool;
+struct umf_tracking_memory_provider_t {
+    umf_memory_provider_handle_t hUpstream;
+    umf_memory_tracker_handle_t hTracker;
+    umf_memory_pool_handle_t pool;
 };
-// TODO: reimplement in C and optimize...
-struct umf_memory_tracker_t {
-    enum umf_result_t add(void *pool, const void *ptr, size_t size) {
-        std::unique_lock<std::shared_mutex> lock(mtx);
 
+typedef struct umf_tracking_memory_provider_t umf_tracking_memory_provider_t;
+
+// Ranges are mapped to the tracking provider they were obtained from, which
+// knows both the pool and the upstream provider. Lookups do not take any
+// locks, see critnib.h. Each thread also caches the ranges it looked up last,
+// as frees tend to hit the same slabs repeatedly.
+// The cached ranges are dropped whenever any range is removed or resized.
+//
+// Modifications of a single range must not race with each other, but the
+// ranges may be looked up concurrently. Ranges are therefore changed so
+// that every part which stays tracked can be found at any point: new ranges
+// are inserted before the old ones are shrunk or removed.
+struct umf_memory_tracker_t {
+    enum umf_result_t add(umf_tracking_memory_provider_t *provider,
+                          const void *ptr, size_t size) {
         if (size == 0) {
             return UMF_RESULT_SUCCESS;
         }
 
-        auto ret = map.try_emplace(reinterpret_cast<uintptr_t>(ptr),
-                                   tracker_value_t{size, pool});
-        return ret.second ? UMF_RESULT_SUCCESS : UMF_RESULT_ERROR_UNKNOWN;
+        return map.insert(reinterpret_cast<uintptr_t>(ptr), size, provider)
+                   ? UMF_RESULT_SUCCESS
+                   : UMF_RESULT_ERROR_UNKNOWN;
     }
 
+    // Remove [ptr, ptr + size) from the range containing it, or the whole
+    // range starting at ptr if size is 0. Parts of the range before and
+    // after stay tracked as separate ranges.
     enum umf_result_t remove(const void *ptr, size_t size) {
-        std::unique_lock<std::shared_mutex> lock(mtx);
+        auto start = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t address;
+        size_t rangeSize;
+        void *value;
+        if (!map.find_le(start, &address, &rangeSize, &value) ||
+            start - address >= rangeSize) {
+            // Not tracked, e.g. allocations of size 0
+            return UMF_RESULT_SUCCESS;
+        }
 
-        map.erase(reinterpret_cast<uintptr_t>(ptr));
+        auto end = size ? start + size : address + rangeSize;
+        if ((size == 0 && start != address) || end < start ||
+            end > address + rangeSize) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
 
-        // TODO: handle removing part of the range
-        (void)size;
+        if (end < address + rangeSize &&
+            !map.insert(end, address + rangeSize - end, value)) {
+            return UMF_RESULT_ERROR_UNKNOWN;
+        }
+
+        if (start == address) {
+            map.remove(address);
+        } else {
+            map.update(address, start - address, value);
+        }
 
+        invalidateCaches();
         return UMF_RESULT_SUCCESS;
     }
 
-    bool find(const void *ptr, umf_alloc_info_t *pAllocInfo) {
-        std::shared_lock<std::shared_mutex> lock(mtx);
+    enum umf_result_t split(const void *ptr, size_t totalSize,
+                            size_t firstSize) {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t key;
+        size_t size;
+        void *value;
+        if (!map.find_le(address, &key, &size, &value) || key != address ||
+            size != totalSize || firstSize == 0 || firstSize >= totalSize) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
 
-        auto intptr = reinterpret_cast<uintptr_t>(ptr);
-        auto it = map.upper_bound(intptr);
-        if (it == map.begin()) {
-            return false;
+        if (!map.insert(address + firstSize, totalSize - firstSize, value)) {
+            return UMF_RESULT_ERROR_UNKNOWN;
+        }
+        map.update(address, firstSize, value);
+
+        invalidateCaches();
+        return UMF_RESULT_SUCCESS;
+    }
+
+    enum umf_result_t merge(const void *lowPtr, const void *highPtr,
+                            size_t totalSize) {
+        auto low = reinterpret_cast<uintptr_t>(lowPtr);
+        auto high = reinterpret_cast<uintptr_t>(highPtr);
+        uintptr_t lowKey, highKey;
+        size_t lowSize, highSize;
+        void *lowValue, *highValue;
+        if (!map.find_le(low, &lowKey, &lowSize, &lowValue) || lowKey != low ||
+            !map.find_le(high, &highKey, &highSize, &highValue) ||
+            highKey != high || low + lowSize != high ||
+            lowSize + highSize != totalSize || lowValue != highValue) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
         }
 
-        --it;
+        map.update(low, totalSize, lowValue);
+        map.remove(high);
+
+        invalidateCaches();
+        return UMF_RESULT_SUCCESS;
+    }
+
+    bool find(const void *ptr, umf_alloc_info_t *pAllocInfo) {
+        auto intptr = reinterpret_cast<uintptr_t>(ptr);
+        auto gen = generation.load(std::memory_order_acquire);
+        auto &cache = lastHits;
+        for (auto &hit : cache.entries) {
+            if (hit.tracker == this && hit.generation == gen &&
+                intptr - hit.base < hit.size) {
+                pAllocInfo->base = reinterpret_cast<void *>(hit.base);
+                pAllocInfo->size = hit.size;
+                pAllocInfo->pool = hit.pool;
+                pAllocInfo->provider = hit.provider;
+                return true;
+            }
+        }
 
-        auto address = it->first;
-        auto size = it->second.size;
-        auto pool = it->second.pool;
+        uintptr_t address;
+        size_t size;
+        void *value;
+        if (!map.find_le(intptr, &address, &size, &value)) {
+            return false;
+        }
 
         if (intptr >= address && intptr < address + size) {
+            auto *provider =
+                static_cast<umf_tracking_memory_provider_t *>(value);
             pAllocInfo->base = reinterpret_cast<void *>(address);
             pAllocInfo->size = size;
-            pAllocInfo->pool = (umf_memory_pool_handle_t)pool;
+            pAllocInfo->pool = provider->pool;
+            pAllocInfo->provider = provider->hUpstream;
+
+            auto &hit = cache.entries[cache.next];
+            cache.next = (cache.next + 1) % LAST_HITS;
+            hit = {this, gen, address, size, pAllocInfo->pool,
+                   pAllocInfo->provider};
             return true;
         }
 
@@ -77,20 +171,57 @@ struct umf_memory_tracker_t {
     }
 
   private:
-    std::shared_mutex mtx;
-    std::map<uintptr_t, tracker_value_t> map;
+    // After the change, so that a lookup which still found the old range
+    // caches it with a stale generation
+    void invalidateCaches() {
+        generation.fetch_add(1, std::memory_order_release);
+    }
+
+    static constexpr size_t LAST_HITS = 4;
+
+    struct last_hit_t {
+        const umf_memory_tracker_t *tracker;
+        uint64_t generation;
+        uintptr_t base;
+        size_t size;
+        umf_memory_pool_handle_t pool;
+        umf_memory_provider_handle_t provider;
+    };
+
+    // Replaced round-robin
+    struct last_hits_t {
+        last_hit_t entries[LAST_HITS] = {};
+        size_t next = 0;
+    };
+
+    static thread_local last_hits_t lastHits;
+
+    critnib map;
+
+    // Number of changes to existing ranges, starting at 1 so that unused
+    // cache entries never match
+    std::atomic<uint64_t> generation{1};
 };
 
+thread_local umf_memory_tracker_t::last_hits_t umf_memory_tracker_t::lastHits;
+
 static enum umf_result_t
-umfMemoryTrackerAdd(umf_memory_tracker_handle_t hTracker, void *pool,
-                    const void *ptr, size_t size) {
-    return hTracker->add(pool, ptr, size);
+umfMemoryTrackerAdd(umf_memory_tracker_handle_t hTracker,
+                    umf_tracking_memory_provider_t *provider, const void *ptr,
+                    size_t size) {
+    return hTracker->add(provider, ptr, size);
 }
 
 static enum umf_result_t
-umfMemoryTrackerRemove(umf_memory_tracker_handle_t hTracker, const void *ptr,
-                       size_t size) {
-    return hTracker->remove(ptr, size);
+umfMemoryTrackerSplit(umf_memory_tracker_handle_t hTracker, const void *ptr,
+                      size_t totalSize, size_t firstSize) {
+    return hTracker->split(ptr, totalSize, firstSize);
+}
+
+static enum umf_result_t
+umfMemoryTrackerMerge(umf_memory_tracker_handle_t hTracker, const void *lowPtr,
+                      const void *highPtr, size_t totalSize) {
+    return hTracker->merge(lowPtr, highPtr, totalSize);
 }
 
 extern "C" {
@@ -119,6 +250,11 @@ void __attribute__((destructor)) deleteLibTracker() { delete tracker; }
 
 umf_memory_tracker_handle_t umfMemoryTrackerGet(void) { return tracker; }
 
+enum umf_result_t umfMemoryTrackerRemove(umf_memory_tracker_handle_t hTracker,
+                                         const void *ptr, size_t size) {
+    return hTracker->remove(ptr, size);
+}
+
 void *umfMemoryTrackerGetPool(umf_memory_tracker_handle_t hTracker,
                               const void *ptr) {
     struct umf_alloc_info_t allocInfo;
@@ -132,14 +268,6 @@ umfMemoryTrackerGetAllocInfo(umf_memory_tracker_handle_t hTracker,
                                            : UMF_RESULT_ERROR_INVALID_ARGUMENT;
 }
 
-struct umf_tracking_memory_provider_t {
-    umf_memory_provider_handle_t hUpstream;
-    umf_memory_tracker_handle_t hTracker;
-    umf_memory_pool_handle_t pool;
-};
-
-typedef struct umf_tracking_memory_provider_t umf_tracking_memory_provider_t;
-
 static enum umf_result_t trackingAlloc(void *hProvider, size_t size,
                                        size_t alignment, void **ptr) {
     umf_tracking_memory_provider_t *p =
@@ -155,7 +283,7 @@ static enum umf_result_t trackingAlloc(void *hProvider, size_t size,
         return ret;
     }
 
-    ret = umfMemoryTrackerAdd(p->hTracker, p->pool, *ptr, size);
+    ret = umfMemoryTrackerAdd(p->hTracker, p, *ptr, size);
     if (ret != UMF_RESULT_SUCCESS && p->hUpstream) {
         if (umfMemoryProviderFree(p->hUpstream, *ptr, size)) {
             // TODO: LOG
@@ -173,7 +301,9 @@ static enum umf_result_t trackingFree(void *hProvider, void *ptr, size_t size) {
     // umfMemoryTrackerRemove should be called before umfMemoryProviderFree
     // to avoid a race condition. If the order would be different, other thread
     // could allocate the memory at address `ptr` before a call to umfMemoryTrackerRemove
-    // resulting in inconsistent state.
+    // resulting in inconsistent state. The same holds for IPC handles
+    // exported for the allocation.
+    umfIpcCacheDropHandle(ptr);
     ret = umfMemoryTrackerRemove(p->hTracker, ptr, size);
     if (ret != UMF_RESULT_SUCCESS) {
         return ret;
@@ -181,7 +311,7 @@ static enum umf_result_t trackingFree(void *hProvider, void *ptr, size_t size) {
 
     ret = umfMemoryProviderFree(p->hUpstream, ptr, size);
     if (ret != UMF_RESULT_SUCCESS) {
-        if (umfMemoryTrackerAdd(p->hTracker, p->pool, ptr, size) !=
+        if (umfMemoryTrackerAdd(p->hTracker, p, ptr, size) !=
             UMF_RESULT_SUCCESS) {
             // TODO: LOG
         }
@@ -191,6 +321,57 @@ static enum umf_result_t trackingFree(void *hProvider, void *ptr, size_t size) {
     return ret;
 }
 
+static enum umf_result_t trackingAllocationSplit(void *hProvider, void *ptr,
+                                                 size_t totalSize,
+                                                 size_t firstSize) {
+    umf_tracking_memory_provider_t *p =
+        (umf_tracking_memory_provider_t *)hProvider;
+
+    umfIpcCacheDropHandle(ptr);
+    enum umf_result_t ret = umfMemoryProviderAllocationSplit(
+        p->hUpstream, ptr, totalSize, firstSize);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
+    ret = umfMemoryTrackerSplit(p->hTracker, ptr, totalSize, firstSize);
+    if (ret != UMF_RESULT_SUCCESS) {
+        if (umfMemoryProviderAllocationMerge(p->hUpstream, ptr,
+                                             (char *)ptr + firstSize,
+                                             totalSize) != UMF_RESULT_SUCCESS) {
+            // TODO: LOG
+        }
+    }
+
+    return ret;
+}
+
+static enum umf_result_t trackingAllocationMerge(void *hProvider, void *lowPtr,
+                                                 void *highPtr,
+                                                 size_t totalSize) {
+    umf_tracking_memory_provider_t *p =
+        (umf_tracking_memory_provider_t *)hProvider;
+
+    umfIpcCacheDropHandle(lowPtr);
+    umfIpcCacheDropHandle(highPtr);
+    enum umf_result_t ret = umfMemoryProviderAllocationMerge(
+        p->hUpstream, lowPtr, highPtr, totalSize);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
+    ret = umfMemoryTrackerMerge(p->hTracker, lowPtr, highPtr, totalSize);
+    if (ret != UMF_RESULT_SUCCESS) {
+        size_t lowSize = (uintptr_t)highPtr - (uintptr_t)lowPtr;
+        if (umfMemoryProviderAllocationSplit(p->hUpstream, lowPtr, totalSize,
+                                             lowSize) != UMF_RESULT_SUCCESS) {
+            // TODO: LOG
+        }
+    }
+
+    return ret;
+}
+
 static enum umf_result_t trackingInitialize(void *params, void **ret) {
     umf_tracking_memory_provider_t *provider =
         (umf_tracking_memory_provider_t *)malloc(
@@ -275,10 +456,11 @@ static enum umf_result_t trackingOpenIpcHandle(void *provider, void *ipcData,
     return umfMemoryProviderOpenIPCHandle(p->hUpstream, ipcData, ptr);
 }
 
-static enum umf_result_t trackingCloseIpcHandle(void *provider, void *ptr) {
+static enum umf_result_t trackingCloseIpcHandle(void *provider, void *ptr,
+                                                size_t size) {
     umf_tracking_memory_provider_t *p =
         (umf_tracking_memory_provider_t *)provider;
-    return umfMemoryProviderCloseIPCHandle(p->hUpstream, ptr);
+    return umfMemoryProviderCloseIPCHandle(p->hUpstream, ptr, size);
 }
 
 enum umf_result_t umfTrackingMemoryProviderCreate(
@@ -307,11 +489,22 @@ enum umf_result_t umfTrackingMemoryProviderCreate(
     trackingMemoryProviderOps.put_ipc_handle = trackingPutIpcHandle;
     trackingMemoryProviderOps.open_ipc_handle = trackingOpenIpcHandle;
     trackingMemoryProviderOps.close_ipc_handle = trackingCloseIpcHandle;
+    trackingMemoryProviderOps.allocation_split = trackingAllocationSplit;
+    trackingMemoryProviderOps.allocation_merge = trackingAllocationMerge;
 
     return umfMemoryProviderCreate(&trackingMemoryProviderOps, &params,
                                    hTrackingProvider);
 }
 
+enum umf_result_t
+umfTrackingMemoryProviderAdd(umf_memory_provider_handle_t hTrackingProvider,
+                             const void *ptr, size_t size) {
+    umf_tracking_memory_provider_t *p =
+        (umf_tracking_memory_provider_t *)umfMemoryProviderGetPriv(
+            hTrackingProvider);
+    return umfMemoryTrackerAdd(p->hTracker, p, ptr, size);
+}
+
 void umfTrackingMemoryProviderGetUpstreamProvider(
     umf_memory_provider_handle_t hTrackingProvider,
     umf_memory_provider_handle_t *hUpstream) {
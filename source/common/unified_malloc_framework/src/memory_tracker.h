@@ -25,9 +25,17 @@ struct umf_alloc_info_t {
     void *base;
     size_t size;
     umf_memory_pool_handle_t pool;
+
+    // The memory provider of the pool the range was obtained from
+    umf_memory_provider_handle_t provider;
 };
 
 umf_memory_tracker_handle_t umfMemoryTrackerGet(void);
+
+// Stop tracking [ptr, ptr + size), or the whole range starting at ptr if
+// size is 0. The range may be part of a tracked range.
+enum umf_result_t umfMemoryTrackerRemove(umf_memory_tracker_handle_t hTracker,
+                                         const void *ptr, size_t size);
 void *umfMemoryTrackerGetPool(umf_memory_tracker_handle_t hTracker,
                               const void *ptr);
 
@@ -42,6 +50,12 @@ enum umf_result_t umfTrackingMemoryProviderCreate(
     umf_memory_provider_handle_t hUpstream, umf_memory_pool_handle_t hPool,
     umf_memory_provider_handle_t *hTrackingProvider);
 
+// Track [ptr, ptr + size) as obtained from hTrackingProvider other than by
+// an allocation, e.g. by opening an IPC handle. Ranges must not overlap.
+enum umf_result_t
+umfTrackingMemoryProviderAdd(umf_memory_provider_handle_t hTrackingProvider,
+                             const void *ptr, size_t size);
+
 void umfTrackingMemoryProviderGetUpstreamProvider(
     umf_memory_provider_handle_t hTrackingProvider,
     umf_memory_provider_handle_t *hUpstream);
@@ -0,0 +1,395 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include <umf/memory_provider.h>
+#include <umf/memory_provider_ops.h>
+#include <umf/providers/provider_memfd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Exported to other processes, which open the file through /proc. The
+// descriptor may have been closed and reused for another file since, which
+// is detected by the inode number and the size.
+struct memfd_ipc_data_t {
+    int32_t pid;
+    int32_t fd;
+    uint64_t size;
+    uint64_t ino;
+};
+
+struct memfd_memory_provider_t {
+    int protection;
+    size_t pageSize;
+
+    struct allocation_t {
+        int fd;
+        size_t size;
+        ino_t ino;
+    };
+
+    // Allocations of this provider by their address, memory opened from IPC
+    // handles is not included
+    std::map<uintptr_t, allocation_t> allocations;
+    std::mutex mutex;
+};
+
+// Set on UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC, the native error is errno
+thread_local struct {
+    const char *msg;
+    int32_t error;
+} lastNativeError;
+
+umf_result_t setLastNativeError(const char *msg) {
+    lastNativeError.msg = msg;
+    lastNativeError.error = errno;
+    return UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC;
+}
+
+size_t alignUp(size_t v, size_t alignment) {
+    return (v + alignment - 1) & ~(alignment - 1);
+}
+
+umf_result_t memfdInitialize(void *params, void **provider) {
+    auto *memfdParams =
+        static_cast<umf_memfd_memory_provider_params_t *>(params);
+    if (!memfdParams) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    auto *memfd = new (std::nothrow) memfd_memory_provider_t;
+    if (!memfd) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    memfd->protection = PROT_NONE;
+    if (memfdParams->protection & UMF_PROTECTION_READ) {
+        memfd->protection |= PROT_READ;
+    }
+    if (memfdParams->protection & UMF_PROTECTION_WRITE) {
+        memfd->protection |= PROT_WRITE;
+    }
+    if (memfdParams->protection & UMF_PROTECTION_EXEC) {
+        memfd->protection |= PROT_EXEC;
+    }
+    memfd->pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    *provider = memfd;
+    return UMF_RESULT_SUCCESS;
+}
+
+void memfdFinalize(void *provider) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    for (auto &[address, allocation] : memfd->allocations) {
+        munmap(reinterpret_cast<void *>(address), allocation.size);
+        close(allocation.fd);
+    }
+    delete memfd;
+}
+
+umf_result_t memfdAlloc(void *provider, size_t size, size_t alignment,
+                        void **resultPtr) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+
+    if (!resultPtr) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+    *resultPtr = nullptr;
+
+    if (alignment & (alignment - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    if (size == 0) {
+        return UMF_RESULT_SUCCESS;
+    }
+
+    size = alignUp(size, memfd->pageSize);
+    if (size == 0) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    int fd = memfd_create("umf_memfd", MFD_CLOEXEC);
+    if (fd < 0) {
+        return setLastNativeError("memfd_create failed");
+    }
+    if (ftruncate(fd, static_cast<off_t>(size))) {
+        auto ret = setLastNativeError("ftruncate failed");
+        close(fd);
+        return ret;
+    }
+
+    // Identifies the file in IPC handles
+    struct stat st;
+    if (fstat(fd, &st)) {
+        auto ret = setLastNativeError("fstat failed");
+        close(fd);
+        return ret;
+    }
+
+    // mmap only guarantees the page alignment, so for larger alignments an
+    // address range is reserved first, and the file is mapped into it
+    void *addr = nullptr;
+    if (alignment > memfd->pageSize) {
+        size_t reserveSize = size + alignment - memfd->pageSize;
+        void *reserved = mmap(nullptr, reserveSize, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            auto ret = setLastNativeError("mmap failed");
+            close(fd);
+            return ret;
+        }
+
+        auto start = reinterpret_cast<uintptr_t>(reserved);
+        auto aligned = alignUp(start, alignment);
+        addr = mmap(reinterpret_cast<void *>(aligned), size, memfd->protection,
+                    MAP_SHARED | MAP_FIXED, fd, 0);
+        if (addr == MAP_FAILED) {
+            auto ret = setLastNativeError("mmap failed");
+            munmap(reserved, reserveSize);
+            close(fd);
+            return ret;
+        }
+
+        if (aligned != start) {
+            munmap(reserved, aligned - start);
+        }
+        if (aligned + size != start + reserveSize) {
+            munmap(reinterpret_cast<void *>(aligned + size),
+                   start + reserveSize - aligned - size);
+        }
+    } else {
+        addr = mmap(nullptr, size, memfd->protection, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            auto ret = setLastNativeError("mmap failed");
+            close(fd);
+            return ret;
+        }
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(memfd->mutex);
+        memfd->allocations.emplace(reinterpret_cast<uintptr_t>(addr),
+                                   memfd_memory_provider_t::allocation_t{
+                                       fd, size, st.st_ino});
+    } catch (...) {
+        munmap(addr, size);
+        close(fd);
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    *resultPtr = addr;
+    return UMF_RESULT_SUCCESS;
+}
+
+// Only whole allocations can be freed, size may be 0
+umf_result_t memfdFree(void *provider, void *ptr, size_t size) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+
+    if (!ptr) {
+        return UMF_RESULT_SUCCESS;
+    }
+
+    memfd_memory_provider_t::allocation_t allocation;
+    {
+        std::lock_guard<std::mutex> lock(memfd->mutex);
+        auto it = memfd->allocations.find(reinterpret_cast<uintptr_t>(ptr));
+        if (it == memfd->allocations.end() ||
+            (size && alignUp(size, memfd->pageSize) != it->second.size)) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
+        allocation = it->second;
+        memfd->allocations.erase(it);
+    }
+
+    // Processes which opened the memory keep it until they close it
+    munmap(ptr, allocation.size);
+    close(allocation.fd);
+    return UMF_RESULT_SUCCESS;
+}
+
+void memfdGetLastNativeError(void *provider, const char **ppMessage,
+                             int32_t *pError) {
+    (void)provider;
+    if (ppMessage) {
+        *ppMessage = lastNativeError.msg;
+    }
+    if (pError) {
+        *pError = lastNativeError.error;
+    }
+}
+
+umf_result_t memfdGetPageSize(void *provider, size_t *pageSize) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    if (!pageSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    *pageSize = memfd->pageSize;
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_result_t memfdGetRecommendedPageSize(void *provider, size_t size,
+                                         size_t *pageSize) {
+    (void)size;
+    return memfdGetPageSize(provider, pageSize);
+}
+
+umf_result_t memfdGetMinPageSize(void *provider, void *ptr, size_t *pageSize) {
+    (void)ptr;
+    return memfdGetPageSize(provider, pageSize);
+}
+
+// Dropping the pages of a shared mapping does not free them, they have to be
+// removed from the file, which also zeroes them for all processes. There is
+// no lazy variant, so both purges do the same.
+umf_result_t memfdPurge(void *provider, void *ptr, size_t size) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    if ((reinterpret_cast<uintptr_t>(ptr) | size) & (memfd->pageSize - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    if (madvise(ptr, size, MADV_REMOVE)) {
+        return setLastNativeError("madvise failed");
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+const char *memfdGetName(void *provider) {
+    (void)provider;
+    return "memfd";
+}
+
+umf_result_t memfdGetIpcHandleSize(void *provider, size_t *size) {
+    (void)provider;
+    if (!size) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    *size = sizeof(memfd_ipc_data_t);
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_result_t memfdGetIpcHandle(void *provider, const void *ptr, size_t size,
+                               void *ipcData) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    (void)size;
+
+    std::lock_guard<std::mutex> lock(memfd->mutex);
+    auto it = memfd->allocations.find(reinterpret_cast<uintptr_t>(ptr));
+    if (it == memfd->allocations.end()) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    auto *data = static_cast<memfd_ipc_data_t *>(ipcData);
+    data->pid = static_cast<int32_t>(getpid());
+    data->fd = it->second.fd;
+    data->size = it->second.size;
+    data->ino = it->second.ino;
+    return UMF_RESULT_SUCCESS;
+}
+
+// The file stays open as long as the allocation exists, nothing to release
+umf_result_t memfdPutIpcHandle(void *provider, void *ipcData) {
+    (void)provider;
+    (void)ipcData;
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_result_t memfdOpenIpcHandle(void *provider, void *ipcData, void **ptr) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    auto *data = static_cast<memfd_ipc_data_t *>(ipcData);
+    if (!data || !ptr) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Works for processes of the same user which may ptrace each other, the
+    // same requirement as for CUDA and Level Zero IPC handles
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd/%d", static_cast<int>(data->pid),
+             static_cast<int>(data->fd));
+    int fd = open(path, (memfd->protection & PROT_WRITE) ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return setLastNativeError("open failed");
+    }
+
+    // A stale handle must not open another allocation of the exporter
+    struct stat st;
+    if (fstat(fd, &st)) {
+        auto ret = setLastNativeError("fstat failed");
+        close(fd);
+        return ret;
+    }
+    if (static_cast<uint64_t>(st.st_ino) != data->ino ||
+        static_cast<uint64_t>(st.st_size) != data->size) {
+        close(fd);
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    void *addr =
+        mmap(nullptr, data->size, memfd->protection, MAP_SHARED, fd, 0);
+    auto ret = addr == MAP_FAILED ? setLastNativeError("mmap failed")
+                                  : UMF_RESULT_SUCCESS;
+
+    // The mapping keeps the file alive
+    close(fd);
+    if (ret != UMF_RESULT_SUCCESS) {
+        return ret;
+    }
+
+    *ptr = addr;
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_result_t memfdCloseIpcHandle(void *provider, void *ptr, size_t size) {
+    auto *memfd = static_cast<memfd_memory_provider_t *>(provider);
+    if (munmap(ptr, alignUp(size, memfd->pageSize))) {
+        return setLastNativeError("munmap failed");
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+umf_memory_provider_ops_t makeMemfdMemoryProviderOps() {
+    umf_memory_provider_ops_t ops = {};
+    ops.version = UMF_VERSION_CURRENT;
+    ops.initialize = memfdInitialize;
+    ops.finalize = memfdFinalize;
+    ops.alloc = memfdAlloc;
+    ops.free = memfdFree;
+    ops.get_last_native_error = memfdGetLastNativeError;
+    ops.get_recommended_page_size = memfdGetRecommendedPageSize;
+    ops.get_min_page_size = memfdGetMinPageSize;
+    ops.purge_lazy = memfdPurge;
+    ops.purge_force = memfdPurge;
+    ops.get_name = memfdGetName;
+    ops.get_ipc_handle_size = memfdGetIpcHandleSize;
+    ops.get_ipc_handle = memfdGetIpcHandle;
+    ops.put_ipc_handle = memfdPutIpcHandle;
+    ops.open_ipc_handle = memfdOpenIpcHandle;
+    ops.close_ipc_handle = memfdCloseIpcHandle;
+    return ops;
+}
+
+const umf_memory_provider_ops_t memfdMemoryProviderOps =
+    makeMemfdMemoryProviderOps();
+
+} // namespace
+
+const umf_memory_provider_ops_t *umfMemfdMemoryProviderOps(void) {
+    return &memfdMemoryProviderOps;
+}
@@ -0,0 +1,368 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <umf/memory_provider.h>
+#include <umf/memory_provider_ops.h>
+#include <umf/providers/provider_os_memory.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TRANSPARENT_HUGE_PAGE_SIZE_DEFAULT (2 * 1024 * 1024)
+
+struct os_memory_provider_t {
+    int protection;
+    enum umf_os_huge_pages_t hugePages;
+
+    // Base page size of the system
+    size_t pageSize;
+
+    // Size of the huge pages used, 0 if huge pages are not used
+    size_t hugePageSize;
+
+    // Granularity of the allocations, hugePageSize for explicit huge pages
+    // and pageSize otherwise
+    size_t minPageSize;
+};
+
+// Set on UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC, the native error is errno
+static __thread struct {
+    const char *msg;
+    int32_t error;
+} lastNativeError;
+
+static enum umf_result_t setLastNativeError(const char *msg) {
+    lastNativeError.msg = msg;
+    lastNativeError.error = errno;
+    return UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC;
+}
+
+static bool isPowerOf2(size_t v) { return v && !(v & (v - 1)); }
+
+static size_t alignUp(size_t v, size_t alignment) {
+    return (v + alignment - 1) & ~(alignment - 1);
+}
+
+static unsigned log2Floor(size_t v) {
+    unsigned ret = 0;
+    while (v >>= 1) {
+        ret++;
+    }
+    return ret;
+}
+
+// Size in bytes read from a file containing a number of units, or 0
+static size_t readSizeFromFile(const char *path, const char *format,
+                               size_t unit) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    size_t size = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, format, &size) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return size * unit;
+}
+
+static size_t getTransparentHugePageSize(void) {
+    size_t size = readSizeFromFile(
+        "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "%zu", 1);
+    return size ? size : TRANSPARENT_HUGE_PAGE_SIZE_DEFAULT;
+}
+
+static size_t getDefaultHugePageSize(void) {
+    return readSizeFromFile("/proc/meminfo", "Hugepagesize: %zu kB", 1024);
+}
+
+static enum umf_result_t osInitialize(void *params, void **provider) {
+    struct umf_os_memory_provider_params_t *osParams =
+        (struct umf_os_memory_provider_params_t *)params;
+    if (!osParams) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    int protection = PROT_NONE;
+    if (osParams->protection & UMF_PROTECTION_READ) {
+        protection |= PROT_READ;
+    }
+    if (osParams->protection & UMF_PROTECTION_WRITE) {
+        protection |= PROT_WRITE;
+    }
+    if (osParams->protection & UMF_PROTECTION_EXEC) {
+        protection |= PROT_EXEC;
+    }
+
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t hugePageSize = 0;
+    switch (osParams->hugePages) {
+    case UMF_OS_HUGE_PAGES_NONE:
+        break;
+    case UMF_OS_HUGE_PAGES_TRANSPARENT:
+        hugePageSize = getTransparentHugePageSize();
+        break;
+    case UMF_OS_HUGE_PAGES_EXPLICIT:
+#ifdef MAP_HUGETLB
+        hugePageSize = osParams->hugePageSize ? osParams->hugePageSize
+                                              : getDefaultHugePageSize();
+        if (!hugePageSize) {
+            return UMF_RESULT_ERROR_NOT_SUPPORTED;
+        }
+        break;
+#else
+        return UMF_RESULT_ERROR_NOT_SUPPORTED;
+#endif
+    default:
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (hugePageSize &&
+        (!isPowerOf2(hugePageSize) || hugePageSize < pageSize)) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    struct os_memory_provider_t *os =
+        (struct os_memory_provider_t *)malloc(sizeof(*os));
+    if (!os) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    os->protection = protection;
+    os->hugePages = osParams->hugePages;
+    os->pageSize = pageSize;
+    os->hugePageSize = hugePageSize;
+    os->minPageSize = osParams->hugePages == UMF_OS_HUGE_PAGES_EXPLICIT
+                          ? hugePageSize
+                          : pageSize;
+
+    *provider = os;
+    return UMF_RESULT_SUCCESS;
+}
+
+static void osFinalize(void *provider) { free(provider); }
+
+static int osMmapFlags(struct os_memory_provider_t *os) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    if (os->hugePages == UMF_OS_HUGE_PAGES_EXPLICIT) {
+        flags |= MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        flags |= (int)log2Floor(os->hugePageSize) << MAP_HUGE_SHIFT;
+#endif
+    }
+#endif
+    return flags;
+}
+
+static enum umf_result_t osAlloc(void *provider, size_t size,
+                                 size_t alignment, void **resultPtr) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+
+    if (!resultPtr) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+    *resultPtr = NULL;
+
+    if (alignment && !isPowerOf2(alignment)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    if (size == 0) {
+        return UMF_RESULT_SUCCESS;
+    }
+
+    // Transparent huge pages can only back huge page aligned memory
+    if (os->hugePages == UMF_OS_HUGE_PAGES_TRANSPARENT &&
+        size >= os->hugePageSize && alignment < os->hugePageSize) {
+        alignment = os->hugePageSize;
+    }
+
+    size = alignUp(size, os->minPageSize);
+    if (size == 0) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    // mmap only guarantees the page alignment, so for larger alignments
+    // more is mapped and the excess is unmapped
+    size_t mapSize = size;
+    if (alignment > os->minPageSize) {
+        mapSize = size + alignment - os->minPageSize;
+        if (mapSize < size) {
+            return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        }
+    }
+
+    void *addr = mmap(NULL, mapSize, os->protection, osMmapFlags(os), -1, 0);
+    if (addr == MAP_FAILED) {
+        return setLastNativeError("mmap failed");
+    }
+
+    uintptr_t start = (uintptr_t)addr;
+    if (mapSize != size) {
+        uintptr_t aligned = alignUp(start, alignment);
+        if (aligned != start) {
+            munmap(addr, aligned - start);
+        }
+        if (aligned + size != start + mapSize) {
+            munmap((void *)(aligned + size), start + mapSize - aligned - size);
+        }
+        start = aligned;
+    }
+
+    if (os->hugePages == UMF_OS_HUGE_PAGES_TRANSPARENT) {
+        // Only a hint, e.g. if transparent huge pages are disabled
+        madvise((void *)start, size, MADV_HUGEPAGE);
+    }
+
+    *resultPtr = (void *)start;
+    return UMF_RESULT_SUCCESS;
+}
+
+// Any page aligned part of an allocation can be freed
+static enum umf_result_t osFree(void *provider, void *ptr, size_t size) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+
+    if (!ptr) {
+        return UMF_RESULT_SUCCESS;
+    }
+    if (size == 0) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+    if ((uintptr_t)ptr & (os->minPageSize - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+
+    if (munmap(ptr, alignUp(size, os->minPageSize))) {
+        return setLastNativeError("munmap failed");
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+static void osGetLastNativeError(void *provider, const char **ppMessage,
+                                 int32_t *pError) {
+    (void)provider;
+    if (ppMessage) {
+        *ppMessage = lastNativeError.msg;
+    }
+    if (pError) {
+        *pError = lastNativeError.error;
+    }
+}
+
+static enum umf_result_t osGetRecommendedPageSize(void *provider, size_t size,
+                                                  size_t *pageSize) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+    if (!pageSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    *pageSize = os->hugePageSize && size >= os->hugePageSize
+                    ? os->hugePageSize
+                    : os->minPageSize;
+    return UMF_RESULT_SUCCESS;
+}
+
+static enum umf_result_t osGetMinPageSize(void *provider, void *ptr,
+                                          size_t *pageSize) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+    (void)ptr;
+    if (!pageSize) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    *pageSize = os->minPageSize;
+    return UMF_RESULT_SUCCESS;
+}
+
+static enum umf_result_t osPurge(struct os_memory_provider_t *os, void *ptr,
+                                 size_t size, int advice) {
+    if (((uintptr_t)ptr | size) & (os->minPageSize - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    if (madvise(ptr, size, advice)) {
+        return setLastNativeError("madvise failed");
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+static enum umf_result_t osPurgeLazy(void *provider, void *ptr, size_t size) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+#ifdef MADV_FREE
+    // Not supported before Linux 4.5, nor for huge pages of hugetlbfs
+    if (os->hugePages != UMF_OS_HUGE_PAGES_EXPLICIT &&
+        osPurge(os, ptr, size, MADV_FREE) == UMF_RESULT_SUCCESS) {
+        return UMF_RESULT_SUCCESS;
+    }
+#endif
+    return osPurge(os, ptr, size, MADV_DONTNEED);
+}
+
+static enum umf_result_t osPurgeForce(void *provider, void *ptr, size_t size) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+    return osPurge(os, ptr, size, MADV_DONTNEED);
+}
+
+static const char *osGetName(void *provider) {
+    (void)provider;
+    return "OS";
+}
+
+// Mappings can be unmapped in any page aligned parts, so splitting and
+// merging only has to keep the allocations page aligned
+static enum umf_result_t osAllocationSplit(void *provider, void *ptr,
+                                           size_t totalSize, size_t firstSize) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+    (void)totalSize;
+    if (((uintptr_t)ptr | firstSize) & (os->minPageSize - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+static enum umf_result_t osAllocationMerge(void *provider, void *lowPtr,
+                                           void *highPtr, size_t totalSize) {
+    struct os_memory_provider_t *os = (struct os_memory_provider_t *)provider;
+    (void)totalSize;
+    if (((uintptr_t)lowPtr | (uintptr_t)highPtr) & (os->minPageSize - 1)) {
+        return UMF_RESULT_ERROR_INVALID_ALIGNMENT;
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+static const struct umf_memory_provider_ops_t osMemoryProviderOps = {
+    .version = UMF_VERSION_CURRENT,
+    .initialize = osInitialize,
+    .finalize = osFinalize,
+    .alloc = osAlloc,
+    .free = osFree,
+    .get_last_native_error = osGetLastNativeError,
+    .get_recommended_page_size = osGetRecommendedPageSize,
+    .get_min_page_size = osGetMinPageSize,
+    .purge_lazy = osPurgeLazy,
+    .purge_force = osPurgeForce,
+    .get_name = osGetName,
+    .allocation_split = osAllocationSplit,
+    .allocation_merge = osAllocationMerge};
+
+const struct umf_memory_provider_ops_t *umfOsMemoryProviderOps(void) {
+    return &osMemoryProviderOps;
+}
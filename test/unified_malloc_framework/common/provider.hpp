@@ -14,6 +14,8 @@
 #include <umf/base.h>
 #include <umf/memory_provider.h>
 
+#include <atomic>
+
 #include <gtest/gtest.h>
 
 #include "base.hpp"
@@ -76,6 +78,34 @@ struct provider_malloc : public provider_base {
     const char *get_name() noexcept { return "malloc"; }
 };
 
+// Provider keeping track of the memory allocated from it. The counters are
+// shared by all instances.
+struct counting_provider : public provider_malloc {
+    static inline std::atomic<size_t> allocatedBytes{0};
+    static inline std::atomic<size_t> numAllocs{0};
+    static inline std::atomic<size_t> purgedBytes{0};
+
+    static void resetCounters() {
+        allocatedBytes = 0;
+        numAllocs = 0;
+        purgedBytes = 0;
+    }
+
+    enum umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+        allocatedBytes += size;
+        ++numAllocs;
+        return provider_malloc::alloc(size, align, ptr);
+    }
+    enum umf_result_t free(void *ptr, size_t size) noexcept {
+        allocatedBytes -= size;
+        return provider_malloc::free(ptr, size);
+    }
+    enum umf_result_t purge_lazy(void *, size_t size) noexcept {
+        purgedBytes += size;
+        return UMF_RESULT_SUCCESS;
+    }
+};
+
 } // namespace umf_test
 
 #endif /* UMF_TEST_PROVIDER_HPP */
@@ -61,6 +61,20 @@ TEST_P(umfPoolTest, allocFree) {
     umfPoolFree(pool.get(), ptr);
 }
 
+TEST_P(umfPoolTest, mallocFreeBatch) {
+    static constexpr size_t allocSize = 64;
+    static constexpr size_t count = 100;
+    std::vector<void *> ptrs(count);
+    ASSERT_EQ(umfPoolMallocBatch(pool.get(), allocSize, count, ptrs.data()),
+              count);
+    for (auto ptr : ptrs) {
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0, allocSize);
+    }
+    ASSERT_EQ(umfPoolFreeBatch(pool.get(), ptrs.data(), count),
+              UMF_RESULT_SUCCESS);
+}
+
 TEST_P(umfPoolTest, reallocFree) {
     if (!umf_test::isReallocSupported(pool.get())) {
         GTEST_SKIP();
@@ -253,7 +267,6 @@ TEST_P(umfPoolTest, multiThreadedMallocFreeRandomSizes) {
 
 #ifdef UMF_ENABLE_POOL_TRACKING_TESTS
 // TODO: add similar tests for realloc/aligned_alloc, etc.
-// TODO: add multithreaded tests
 TEST_P(umfMultiPoolTest, memoryTracking) {
     static constexpr int allocSizes[] = {8, 16, 32, 40, 64, 128, 1024, 4096};
     static constexpr auto nAllocs = 256;
@@ -288,6 +301,46 @@ TEST_P(umfMultiPoolTest, memoryTracking) {
         umfFree(std::get<0>(p));
     }
 }
+
+TEST_P(umfMultiPoolTest, memoryTrackingMultiThreaded) {
+    static constexpr size_t allocSizes[] = {8, 64, 1024, 4096, 65536};
+    static constexpr auto nIters = 256;
+    static constexpr auto nAllocs = 16;
+
+    // Lookups race with the tracking of allocations of the other threads
+    auto worker = [&](int id) {
+        std::mt19937_64 g(id);
+        std::uniform_int_distribution<size_t> allocSizesDist(
+            0, std::size(allocSizes) - 1);
+        auto *pool = pools[id % pools.size()].get();
+
+        for (int i = 0; i < nIters; i++) {
+            std::vector<std::pair<void *, size_t>> ptrs;
+            for (int j = 0; j < nAllocs; j++) {
+                auto size = allocSizes[allocSizesDist(g)];
+                auto *ptr = umfPoolMalloc(pool, size);
+                ASSERT_NE(ptr, nullptr);
+                ptrs.emplace_back(ptr, size);
+            }
+
+            for (auto [ptr, size] : ptrs) {
+                ASSERT_EQ(umfPoolByPtr(ptr), pool);
+                ASSERT_EQ(umfPoolByPtr(static_cast<char *>(ptr) + size - 1),
+                          pool);
+                umfFree(ptr);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++) {
+        threads.emplace_back(worker, i);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
 #endif /* UMF_ENABLE_POOL_TRACKING_TESTS */
 
 #endif /* UMF_TEST_MEMORY_POOL_OPS_HPP */
@@ -13,6 +13,7 @@
 #include "umf/memory_provider.h"
 
 #include <array>
+#include <cstddef>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -157,6 +158,137 @@ INSTANTIATE_TEST_SUITE_P(
             .second;
     }));
 
+TEST_F(test, trimOptionalOp) {
+    auto nullProvider = umf_test::wrapProviderUnique(nullProviderCreate());
+    umf_memory_provider_handle_t providers[] = {nullProvider.get()};
+
+    struct pool : public umf_test::pool_base {
+        umf_result_t trim() noexcept { return UMF_RESULT_SUCCESS; }
+    };
+
+    auto [ret, trimPool] = umf::poolMakeUnique<pool>(providers, 1);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolTrim(trimPool.get()), UMF_RESULT_SUCCESS);
+
+    auto [retBase, basePool] =
+        umf::poolMakeUnique<umf_test::pool_base>(providers, 1);
+    ASSERT_EQ(retBase, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolTrim(basePool.get()), UMF_RESULT_ERROR_NOT_SUPPORTED);
+}
+
+TEST_F(test, resetOptionalOp) {
+    auto nullProvider = umf_test::wrapProviderUnique(nullProviderCreate());
+    umf_memory_provider_handle_t providers[] = {nullProvider.get()};
+
+    struct pool : public umf_test::pool_base {
+        umf_result_t reset() noexcept { return UMF_RESULT_SUCCESS; }
+    };
+
+    auto [ret, resetPool] = umf::poolMakeUnique<pool>(providers, 1);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolReset(resetPool.get()), UMF_RESULT_SUCCESS);
+
+    auto [retBase, basePool] =
+        umf::poolMakeUnique<umf_test::pool_base>(providers, 1);
+    ASSERT_EQ(retBase, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolReset(basePool.get()), UMF_RESULT_ERROR_NOT_SUPPORTED);
+}
+
+TEST_F(test, batchOptionalOps) {
+    auto nullProvider = umf_test::wrapProviderUnique(nullProviderCreate());
+    umf_memory_provider_handle_t providers[] = {nullProvider.get()};
+
+    // Without the ops, the blocks are allocated and freed one by one
+    auto [retMalloc, mallocPool] =
+        umf::poolMakeUnique<umf_test::malloc_pool>(providers, 1);
+    ASSERT_EQ(retMalloc, UMF_RESULT_SUCCESS);
+
+    std::array<void *, 16> ptrs;
+    ASSERT_EQ(umfPoolMallocBatch(mallocPool.get(), 64, ptrs.size(),
+                                 ptrs.data()),
+              ptrs.size());
+    ASSERT_EQ(umfPoolFree(mallocPool.get(), ptrs[3]), UMF_RESULT_SUCCESS);
+    ptrs[3] = nullptr;
+    ASSERT_EQ(umfPoolFreeBatch(mallocPool.get(), ptrs.data(), ptrs.size()),
+              UMF_RESULT_SUCCESS);
+
+    // The first failure stops the allocation
+    auto [retBase, basePool] =
+        umf::poolMakeUnique<umf_test::pool_base>(providers, 1);
+    ASSERT_EQ(retBase, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolMallocBatch(basePool.get(), 64, ptrs.size(), ptrs.data()),
+              0);
+
+    struct pool : public umf_test::pool_base {
+        size_t malloc_batch(size_t, size_t count, void **) noexcept {
+            return count / 2;
+        }
+        umf_result_t free_batch(void **, size_t) noexcept {
+            return UMF_RESULT_ERROR_NOT_SUPPORTED;
+        }
+    };
+
+    auto [ret, batchPool] = umf::poolMakeUnique<pool>(providers, 1);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolMallocBatch(batchPool.get(), 64, ptrs.size(), ptrs.data()),
+              ptrs.size() / 2);
+    ASSERT_EQ(umfPoolFreeBatch(batchPool.get(), ptrs.data(), ptrs.size()),
+              UMF_RESULT_ERROR_NOT_SUPPORTED);
+}
+
+// Ops structure of pools built against the 0.9 headers
+struct pool_ops_0_9 {
+    uint32_t version;
+    umf_result_t (*initialize)(umf_memory_provider_handle_t *providers,
+                               size_t numProviders, void *params, void **pool);
+    void (*finalize)(void *pool);
+    void *(*malloc)(void *pool, size_t size);
+    void *(*calloc)(void *pool, size_t num, size_t size);
+    void *(*realloc)(void *pool, void *ptr, size_t size);
+    void *(*aligned_malloc)(void *pool, size_t size, size_t alignment);
+    size_t (*malloc_usable_size)(void *pool, void *ptr);
+    umf_result_t (*free)(void *pool, void *);
+    umf_result_t (*get_last_allocation_error)(void *pool);
+};
+static_assert(sizeof(pool_ops_0_9) == offsetof(umf_memory_pool_ops_t, trim));
+
+TEST_F(test, poolOpsVersion09) {
+    auto nullProvider = umf_test::wrapProviderUnique(nullProviderCreate());
+    umf_memory_provider_handle_t providers[] = {nullProvider.get()};
+
+    pool_ops_0_9 ops{};
+    ops.version = UMF_MAKE_VERSION(0, 9);
+    ops.initialize = [](umf_memory_provider_handle_t *, size_t, void *,
+                        void **pool) {
+        *pool = nullptr;
+        return UMF_RESULT_SUCCESS;
+    };
+    ops.finalize = [](void *) {};
+    ops.malloc = [](void *, size_t) -> void * { return nullptr; };
+    ops.get_last_allocation_error = [](void *) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    };
+
+    // The optional ops added since are treated as missing
+    umf_memory_pool_handle_t hPool = nullptr;
+    ASSERT_EQ(umfPoolCreate(reinterpret_cast<umf_memory_pool_ops_t *>(&ops),
+                            providers, 1, nullptr, &hPool),
+              UMF_RESULT_SUCCESS);
+    umf::pool_unique_handle_t pool(hPool, &umfPoolDestroy);
+
+    ASSERT_EQ(umfPoolTrim(hPool), UMF_RESULT_ERROR_NOT_SUPPORTED);
+    ASSERT_EQ(umfPoolReset(hPool), UMF_RESULT_ERROR_NOT_SUPPORTED);
+    void *ptr;
+    ASSERT_EQ(umfPoolMallocBatch(hPool, 64, 1, &ptr), 0);
+    ASSERT_EQ(umfPoolGetLastAllocationError(hPool),
+              UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY);
+
+    ops.version = UMF_MAKE_VERSION(1, 0);
+    ASSERT_EQ(umfPoolCreate(reinterpret_cast<umf_memory_pool_ops_t *>(&ops),
+                            providers, 1, nullptr, &hPool),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
 ////////////////// Negative test cases /////////////////
 
 TEST_F(test, memoryPoolInvalidProvidersNullptr) {
@@ -211,6 +343,33 @@ TEST_F(test, retrieveMemoryProvidersError) {
     ASSERT_EQ(ret, UMF_RESULT_ERROR_INVALID_ARGUMENT);
 }
 
+#ifdef UMF_ENABLE_POOL_TRACKING_TESTS
+TEST_F(test, poolByPtrAfterFree) {
+    static constexpr size_t allocSize = 4096;
+
+    auto [ret, pool] = umf::poolMakeUnique<umf_test::proxy_pool, 1>(
+        {umf::memoryProviderMakeUnique<umf_test::provider_malloc>().second});
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto *ptr = static_cast<char *>(umfPoolMalloc(pool.get(), allocSize));
+    ASSERT_NE(ptr, nullptr);
+
+    // Repeated lookups in the same range are served from the thread's cache
+    for (size_t i = 0; i < allocSize; i += 512) {
+        ASSERT_EQ(umfPoolByPtr(ptr + i), pool.get());
+    }
+
+    std::thread([&] { ASSERT_EQ(umfPoolByPtr(ptr), pool.get()); }).join();
+
+    // Freeing the range on one thread must invalidate it in all caches
+    std::thread([&] {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }).join();
+    ASSERT_EQ(umfPoolByPtr(ptr), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + allocSize - 1), nullptr);
+}
+#endif /* UMF_ENABLE_POOL_TRACKING_TESTS */
+
 // TODO: extend test for different functions (not only alloc)
 TEST_F(test, getLastFailedMemoryProvider) {
     static constexpr size_t allocSize = 8;
@@ -298,3 +457,91 @@ TEST_F(test, getLastFailedMemoryProvider) {
                   umfMemoryProviderGetName(umfGetLastFailedMemoryProvider())),
               "provider2");
 }
+
+#ifdef UMF_ENABLE_POOL_TRACKING_TESTS
+TEST_F(test, poolByPtrPartialFree) {
+    static constexpr size_t page = 4096;
+    static constexpr size_t allocSize = 8 * page;
+    alignas(page) static char buffer[allocSize];
+
+    // Frees and splits are no-ops, only the tracking matters here
+    struct memory_provider : public umf_test::provider_base {
+        enum umf_result_t alloc(size_t size, size_t, void **ptr) noexcept {
+            *ptr = buffer;
+            return UMF_RESULT_SUCCESS;
+        }
+        enum umf_result_t free(void *, size_t) noexcept {
+            return UMF_RESULT_SUCCESS;
+        }
+        enum umf_result_t allocation_split(void *, size_t, size_t) noexcept {
+            return UMF_RESULT_SUCCESS;
+        }
+        enum umf_result_t allocation_merge(void *, void *, size_t) noexcept {
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+
+    // Pools only see the tracking provider wrapping the upstream one
+    static umf_memory_provider_handle_t trackingProvider;
+    struct pool : public umf_test::proxy_pool {
+        umf_result_t initialize(umf_memory_provider_handle_t *providers,
+                                size_t numProviders) noexcept {
+            trackingProvider = providers[0];
+            return umf_test::proxy_pool::initialize(providers, numProviders);
+        }
+    };
+
+    auto [ret, hPool] = umf::poolMakeUnique<pool, 1>(
+        {umf::memoryProviderMakeUnique<memory_provider>().second});
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    auto *p = hPool.get();
+
+    auto *ptr = static_cast<char *>(umfPoolMalloc(p, allocSize));
+    ASSERT_EQ(ptr, buffer);
+
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(trackingProvider, ptr,
+                                               allocSize, page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(trackingProvider, ptr, page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(ptr), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + page), p);
+
+    // Tail of [page, 8 * page)
+    ASSERT_EQ(umfMemoryProviderFree(trackingProvider, ptr + 7 * page, page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(ptr + 7 * page), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + 7 * page - 1), p);
+
+    // Middle of [page, 7 * page)
+    ASSERT_EQ(umfMemoryProviderFree(trackingProvider, ptr + 3 * page, page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(ptr + 3 * page - 1), p);
+    ASSERT_EQ(umfPoolByPtr(ptr + 3 * page), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + 4 * page - 1), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + 4 * page), p);
+
+    // [page, 3 * page) and [4 * page, 7 * page) are not adjacent
+    ASSERT_EQ(umfMemoryProviderAllocationMerge(trackingProvider, ptr + page,
+                                               ptr + 4 * page, 5 * page),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(umfMemoryProviderFree(trackingProvider, ptr + 2 * page,
+                                    3 * page),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(trackingProvider, ptr + 4 * page,
+                                               3 * page, page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderAllocationMerge(trackingProvider, ptr + 4 * page,
+                                               ptr + 5 * page, 3 * page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(trackingProvider, ptr + 4 * page,
+                                    3 * page),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(ptr + 5 * page), nullptr);
+    ASSERT_EQ(umfPoolByPtr(ptr + page), p);
+
+    ASSERT_EQ(umfPoolFree(p, ptr + page), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(ptr + page), nullptr);
+}
+#endif /* UMF_ENABLE_POOL_TRACKING_TESTS */
@@ -8,6 +8,7 @@
 #include "provider.h"
 #include "provider.hpp"
 
+#include <cstddef>
 #include <string>
 #include <unordered_map>
 
@@ -66,6 +67,105 @@ TEST_F(test, memoryProviderTrace) {
     ASSERT_EQ(std::string(pName), std::string("null"));
 }
 
+TEST_F(test, allocationSplitMergeOptionalOps) {
+    struct provider : public umf_test::provider_base {
+        enum umf_result_t allocation_split(void *, size_t, size_t) noexcept {
+            return UMF_RESULT_SUCCESS;
+        }
+        enum umf_result_t allocation_merge(void *, void *, size_t) noexcept {
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+
+    auto [ret, hProvider] = umf::memoryProviderMakeUnique<provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    auto *ptr = reinterpret_cast<char *>(0x1000);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(hProvider.get(), ptr, 64, 16),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(hProvider.get(), ptr, 64, 64),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(
+        umfMemoryProviderAllocationMerge(hProvider.get(), ptr, ptr + 16, 64),
+        UMF_RESULT_SUCCESS);
+    ASSERT_EQ(
+        umfMemoryProviderAllocationMerge(hProvider.get(), ptr, ptr + 64, 64),
+        UMF_RESULT_ERROR_INVALID_ARGUMENT);
+
+    auto [retBase, hBaseProvider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_base>();
+    ASSERT_EQ(retBase, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(hBaseProvider.get(), ptr, 64, 16),
+              UMF_RESULT_ERROR_NOT_SUPPORTED);
+    ASSERT_EQ(umfMemoryProviderAllocationMerge(hBaseProvider.get(), ptr,
+                                               ptr + 16, 64),
+              UMF_RESULT_ERROR_NOT_SUPPORTED);
+}
+
+// Ops structure of providers built against the 0.9 headers
+struct provider_ops_0_9 {
+    uint32_t version;
+    umf_result_t (*initialize)(void *params, void **provider);
+    void (*finalize)(void *provider);
+    umf_result_t (*alloc)(void *provider, size_t size, size_t alignment,
+                          void **ptr);
+    umf_result_t (*free)(void *provider, void *ptr, size_t size);
+    void (*get_last_native_error)(void *provider, const char **ppMessage,
+                                  int32_t *pError);
+    umf_result_t (*get_recommended_page_size)(void *provider, size_t size,
+                                              size_t *pageSize);
+    umf_result_t (*get_min_page_size)(void *provider, void *ptr,
+                                      size_t *pageSize);
+    umf_result_t (*purge_lazy)(void *provider, void *ptr, size_t size);
+    umf_result_t (*purge_force)(void *provider, void *ptr, size_t size);
+    const char *(*get_name)(void *provider);
+    bool (*supports_device)(const char *name);
+    umf_result_t (*get_ipc_handle_size)(void *provider, size_t *size);
+    umf_result_t (*get_ipc_handle)(void *provider, const void *ptr,
+                                   size_t size, void *ipcData);
+    umf_result_t (*put_ipc_handle)(void *provider, void *ipcData);
+    umf_result_t (*open_ipc_handle)(void *provider, void *ipcData, void **ptr);
+    umf_result_t (*close_ipc_handle)(void *provider, void *ptr);
+};
+static_assert(sizeof(provider_ops_0_9) ==
+              offsetof(umf_memory_provider_ops_t, allocation_split));
+
+TEST_F(test, providerOpsVersion09) {
+    static void *closedPtr = nullptr;
+    provider_ops_0_9 ops{};
+    ops.version = UMF_MAKE_VERSION(0, 9);
+    ops.initialize = [](void *, void **provider) {
+        *provider = nullptr;
+        return UMF_RESULT_SUCCESS;
+    };
+    ops.finalize = [](void *) {};
+    ops.close_ipc_handle = [](void *, void *ptr) {
+        closedPtr = ptr;
+        return UMF_RESULT_SUCCESS;
+    };
+
+    // The fields added since are not read, close_ipc_handle is called
+    // without the size
+    umf_memory_provider_handle_t hProvider = nullptr;
+    ASSERT_EQ(umfMemoryProviderCreate(
+                  reinterpret_cast<umf_memory_provider_ops_t *>(&ops), nullptr,
+                  &hProvider),
+              UMF_RESULT_SUCCESS);
+    auto provider = umf_test::wrapProviderUnique(hProvider);
+
+    auto *ptr = reinterpret_cast<char *>(0x1000);
+    ASSERT_EQ(umfMemoryProviderCloseIPCHandle(hProvider, ptr, 64),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(closedPtr, ptr);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(hProvider, ptr, 64, 16),
+              UMF_RESULT_ERROR_NOT_SUPPORTED);
+
+    ops.version = UMF_MAKE_VERSION(1, 0);
+    ASSERT_EQ(umfMemoryProviderCreate(
+                  reinterpret_cast<umf_memory_provider_ops_t *>(&ops), nullptr,
+                  &hProvider),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
 //////////////////////////// Negative test cases
 ///////////////////////////////////
 
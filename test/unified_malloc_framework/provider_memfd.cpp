@@ -0,0 +1,408 @@
+// Copyright (C) 2023 Intel Corporation
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See LICENSE.TXT
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// This file contains tests for the memfd memory provider and UMF IPC
+
+#include "pool.hpp"
+#include "provider.hpp"
+
+#include <umf/ipc.h>
+#include <umf/providers/provider_memfd.h>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using umf_test::test;
+
+static constexpr size_t bufferSize = 1 << 20;
+
+static auto makeMemfdProvider() {
+    auto params = umfMemfdMemoryProviderParamsDefault();
+    umf_memory_provider_handle_t hProvider = nullptr;
+    EXPECT_EQ(umfMemoryProviderCreate(umfMemfdMemoryProviderOps(), &params,
+                                      &hProvider),
+              UMF_RESULT_SUCCESS);
+    return umf_test::wrapProviderUnique(hProvider);
+}
+
+// Exit status of child, run in a forked process. Failures are reported by
+// returning non-zero, gtest assertions do not reach the parent.
+static int runInChild(std::function<int()> child) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(child());
+    }
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool isFilled(const void *ptr, size_t size, unsigned char value) {
+    auto *bytes = static_cast<const unsigned char *>(ptr);
+    for (size_t i = 0; i < size; i++) {
+        if (bytes[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_F(test, memfdProviderAllocAligned) {
+    auto provider = makeMemfdProvider();
+    ASSERT_EQ(std::string(umfMemoryProviderGetName(provider.get())), "memfd");
+
+    for (size_t alignment : {0, 4096, 1 << 16, 1 << 21}) {
+        void *ptr = nullptr;
+        ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), 100, alignment, &ptr),
+                  UMF_RESULT_SUCCESS);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) %
+                      (alignment ? alignment : 1),
+                  0);
+        memset(ptr, 0xab, 100);
+        ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, 100),
+                  UMF_RESULT_SUCCESS);
+    }
+
+    int x = 0;
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), &x, 0),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
+TEST_F(test, memfdProviderPurge) {
+    auto provider = makeMemfdProvider();
+
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), bufferSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    memset(ptr, 0xab, bufferSize);
+    ASSERT_EQ(umfMemoryProviderPurgeForce(provider.get(), ptr, bufferSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_TRUE(isFilled(ptr, bufferSize, 0));
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, bufferSize),
+              UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, memfdProviderIpc) {
+    auto provider = makeMemfdProvider();
+
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), bufferSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    memset(ptr, 0xab, bufferSize);
+
+    size_t handleSize = 0;
+    ASSERT_EQ(umfMemoryProviderGetIPCHandleSize(provider.get(), &handleSize),
+              UMF_RESULT_SUCCESS);
+    std::vector<char> handle(handleSize);
+    ASSERT_EQ(umfMemoryProviderGetIPCHandle(provider.get(), ptr, bufferSize,
+                                            handle.data()),
+              UMF_RESULT_SUCCESS);
+
+    // The same memory at another address in this process
+    void *opened = nullptr;
+    ASSERT_EQ(umfMemoryProviderOpenIPCHandle(provider.get(), handle.data(),
+                                             &opened),
+              UMF_RESULT_SUCCESS);
+    ASSERT_NE(opened, ptr);
+    ASSERT_TRUE(isFilled(opened, bufferSize, 0xab));
+    memset(opened, 0xcd, bufferSize);
+    ASSERT_TRUE(isFilled(ptr, bufferSize, 0xcd));
+
+    // And in another process
+    int status = runInChild([&] {
+        auto childProvider = makeMemfdProvider();
+        void *childPtr = nullptr;
+        if (umfMemoryProviderOpenIPCHandle(childProvider.get(), handle.data(),
+                                           &childPtr) != UMF_RESULT_SUCCESS) {
+            return 1;
+        }
+        if (!isFilled(childPtr, bufferSize, 0xcd)) {
+            return 2;
+        }
+        memset(childPtr, 0xef, bufferSize);
+        return umfMemoryProviderCloseIPCHandle(childProvider.get(), childPtr,
+                                               bufferSize) == UMF_RESULT_SUCCESS
+                   ? 0
+                   : 3;
+    });
+    ASSERT_EQ(status, 0);
+    ASSERT_TRUE(isFilled(ptr, bufferSize, 0xef));
+
+    ASSERT_EQ(umfMemoryProviderPutIPCHandle(provider.get(), handle.data()),
+              UMF_RESULT_SUCCESS);
+
+    // The opened memory outlives the allocation
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, bufferSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_TRUE(isFilled(opened, bufferSize, 0xef));
+    ASSERT_EQ(
+        umfMemoryProviderCloseIPCHandle(provider.get(), opened, bufferSize),
+        UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, memfdProviderIpcStaleHandle) {
+    auto provider = makeMemfdProvider();
+
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), bufferSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    size_t handleSize = 0;
+    ASSERT_EQ(umfMemoryProviderGetIPCHandleSize(provider.get(), &handleSize),
+              UMF_RESULT_SUCCESS);
+    std::vector<char> handle(handleSize);
+    ASSERT_EQ(umfMemoryProviderGetIPCHandle(provider.get(), ptr, bufferSize,
+                                            handle.data()),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderPutIPCHandle(provider.get(), handle.data()),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, bufferSize),
+              UMF_RESULT_SUCCESS);
+
+    // Likely backed by a file with the same descriptor, which the handle of
+    // the freed allocation must not open
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), bufferSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    void *opened = nullptr;
+    ASSERT_NE(umfMemoryProviderOpenIPCHandle(provider.get(), handle.data(),
+                                             &opened),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, bufferSize),
+              UMF_RESULT_SUCCESS);
+}
+
+#ifdef UMF_ENABLE_POOL_TRACKING_TESTS
+TEST_F(test, memfdPoolIpc) {
+    auto [ret, pool] =
+        umf::poolMakeUnique<umf_test::proxy_pool, 1>({makeMemfdProvider()});
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto *ptr = static_cast<char *>(umfPoolMalloc(pool.get(), bufferSize));
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xab, bufferSize);
+
+    // The handle points into the middle of the allocation
+    static constexpr size_t offset = 4096 + 64;
+    umf_ipc_handle_t handle = nullptr;
+    size_t handleSize = 0;
+    ASSERT_EQ(umfGetIPCHandle(ptr + offset, &handle, &handleSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_NE(handle, nullptr);
+
+    int status = runInChild([&] {
+        // Received as bytes, as it would be through a pipe
+        std::vector<char> received(reinterpret_cast<char *>(handle),
+                                   reinterpret_cast<char *>(handle) +
+                                       handleSize);
+
+        auto [childRet, childPool] =
+            umf::poolMakeUnique<umf_test::proxy_pool, 1>(
+                {makeMemfdProvider()});
+        if (childRet != UMF_RESULT_SUCCESS) {
+            return 1;
+        }
+
+        void *opened = nullptr;
+        if (umfOpenIPCHandle(childPool.get(),
+                             reinterpret_cast<umf_ipc_handle_t>(
+                                 received.data()),
+                             &opened) != UMF_RESULT_SUCCESS) {
+            return 2;
+        }
+        if (!isFilled(opened, bufferSize - offset, 0xab)) {
+            return 3;
+        }
+        memset(opened, 0xcd, bufferSize - offset);
+        return umfCloseIPCHandle(opened) == UMF_RESULT_SUCCESS ? 0 : 4;
+    });
+    ASSERT_EQ(status, 0);
+    ASSERT_TRUE(isFilled(ptr, offset, 0xab));
+    ASSERT_TRUE(isFilled(ptr + offset, bufferSize - offset, 0xcd));
+
+    // Opened in this process, the memory is found by umfCloseIPCHandle
+    void *opened = nullptr;
+    ASSERT_EQ(umfOpenIPCHandle(pool.get(), handle, &opened),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolByPtr(opened), pool.get());
+    ASSERT_TRUE(isFilled(opened, bufferSize - offset, 0xcd));
+    ASSERT_EQ(umfCloseIPCHandle(opened), UMF_RESULT_SUCCESS);
+
+    ASSERT_EQ(umfPutIPCHandle(handle), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+}
+
+static std::atomic<size_t> numExported;
+static std::atomic<size_t> numOpened;
+
+// The memfd provider, counting the handles exported and opened
+static umf_memory_provider_ops_t *countingMemfdProviderOps() {
+    static umf_memory_provider_ops_t ops = [] {
+        auto memfdOps = *umfMemfdMemoryProviderOps();
+        static auto getIpcHandle = memfdOps.get_ipc_handle;
+        static auto openIpcHandle = memfdOps.open_ipc_handle;
+        memfdOps.get_ipc_handle = [](void *provider, const void *ptr,
+                                     size_t size, void *ipcData) {
+            numExported++;
+            return getIpcHandle(provider, ptr, size, ipcData);
+        };
+        memfdOps.open_ipc_handle = [](void *provider, void *ipcData,
+                                      void **ptr) {
+            numOpened++;
+            return openIpcHandle(provider, ipcData, ptr);
+        };
+        return memfdOps;
+    }();
+    return &ops;
+}
+
+static auto makeCountingMemfdPool() {
+    auto params = umfMemfdMemoryProviderParamsDefault();
+    umf_memory_provider_handle_t hProvider = nullptr;
+    EXPECT_EQ(umfMemoryProviderCreate(countingMemfdProviderOps(), &params,
+                                      &hProvider),
+              UMF_RESULT_SUCCESS);
+    return umf::poolMakeUnique<umf_test::proxy_pool, 1>(
+        {umf_test::wrapProviderUnique(hProvider)});
+}
+
+TEST_F(test, memfdPoolIpcCache) {
+    auto [ret, pool] = makeCountingMemfdPool();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    numExported = 0;
+    numOpened = 0;
+
+    auto *ptr = static_cast<char *>(umfPoolMalloc(pool.get(), bufferSize));
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xab, bufferSize);
+
+    // Exported once, also for pointers into the allocation
+    umf_ipc_handle_t handles[3];
+    size_t handleSize = 0;
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(umfGetIPCHandle(ptr + i * 64, &handles[i], &handleSize),
+                  UMF_RESULT_SUCCESS);
+    }
+    ASSERT_EQ(numExported, 1);
+
+    // Opened once, the mapping is kept after it is closed
+    void *opened[3];
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(umfOpenIPCHandle(pool.get(), handles[i], &opened[i]),
+                  UMF_RESULT_SUCCESS);
+        ASSERT_EQ(static_cast<char *>(opened[i]) - i * 64,
+                  static_cast<char *>(opened[0]));
+        ASSERT_EQ(umfCloseIPCHandle(opened[i]), UMF_RESULT_SUCCESS);
+    }
+    ASSERT_EQ(numOpened, 1);
+    ASSERT_EQ(umfCloseIPCHandle(opened[0]),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+
+    for (auto handle : handles) {
+        ASSERT_EQ(umfPutIPCHandle(handle), UMF_RESULT_SUCCESS);
+    }
+    ASSERT_EQ(umfGetIPCHandle(ptr, &handles[0], &handleSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(numExported, 1);
+    ASSERT_EQ(umfPutIPCHandle(handles[0]), UMF_RESULT_SUCCESS);
+
+    // A new allocation, possibly at the same address, is exported and
+    // opened again
+    ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+    ptr = static_cast<char *>(umfPoolMalloc(pool.get(), bufferSize));
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xcd, bufferSize);
+
+    ASSERT_EQ(umfGetIPCHandle(ptr, &handles[0], &handleSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(numExported, 2);
+    ASSERT_EQ(umfOpenIPCHandle(pool.get(), handles[0], &opened[0]),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(numOpened, 2);
+    ASSERT_TRUE(isFilled(opened[0], bufferSize, 0xcd));
+    ASSERT_EQ(umfCloseIPCHandle(opened[0]), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPutIPCHandle(handles[0]), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+
+    // Cached mappings are closed with the pool
+    auto *hPool = pool.get();
+    pool.reset();
+    ASSERT_NE(umfPoolByPtr(opened[0]), hPool);
+}
+
+TEST_F(test, memfdPoolIpcTruncatedHandle) {
+    auto [ret, pool] = makeCountingMemfdPool();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    numOpened = 0;
+
+    void *ptr = umfPoolMalloc(pool.get(), 4096);
+    ASSERT_NE(ptr, nullptr);
+    umf_ipc_handle_t handle = nullptr;
+    size_t handleSize = 0;
+    ASSERT_EQ(umfGetIPCHandle(ptr, &handle, &handleSize), UMF_RESULT_SUCCESS);
+
+    // The size, the first field of the handle, is smaller than the handle
+    // header itself
+    std::vector<char> received(reinterpret_cast<char *>(handle),
+                               reinterpret_cast<char *>(handle) + handleSize);
+    uint64_t truncatedSize = sizeof(uint64_t);
+    memcpy(received.data(), &truncatedSize, sizeof(truncatedSize));
+
+    void *opened = nullptr;
+    ASSERT_EQ(umfOpenIPCHandle(pool.get(),
+                               reinterpret_cast<umf_ipc_handle_t>(
+                                   received.data()),
+                               &opened),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(numOpened, 0);
+
+    ASSERT_EQ(umfPutIPCHandle(handle), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, memfdPoolIpcCacheEviction) {
+    auto [ret, pool] = makeCountingMemfdPool();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    numOpened = 0;
+
+    // More than the number of closed mappings which are kept
+    static constexpr size_t numBuffers = 100;
+    std::vector<void *> ptrs(numBuffers);
+    std::vector<umf_ipc_handle_t> handles(numBuffers);
+    for (size_t i = 0; i < numBuffers; i++) {
+        ptrs[i] = umfPoolMalloc(pool.get(), 4096);
+        ASSERT_NE(ptrs[i], nullptr);
+        size_t handleSize = 0;
+        ASSERT_EQ(umfGetIPCHandle(ptrs[i], &handles[i], &handleSize),
+                  UMF_RESULT_SUCCESS);
+    }
+
+    auto openAndClose = [&](size_t i) {
+        void *opened = nullptr;
+        ASSERT_EQ(umfOpenIPCHandle(pool.get(), handles[i], &opened),
+                  UMF_RESULT_SUCCESS);
+        ASSERT_EQ(umfCloseIPCHandle(opened), UMF_RESULT_SUCCESS);
+    };
+
+    for (size_t i = 0; i < numBuffers; i++) {
+        openAndClose(i);
+    }
+    ASSERT_EQ(numOpened, numBuffers);
+
+    // The least recently used mapping was closed, the most recent one not
+    openAndClose(0);
+    ASSERT_EQ(numOpened, numBuffers + 1);
+    openAndClose(numBuffers - 1);
+    ASSERT_EQ(numOpened, numBuffers + 1);
+
+    for (size_t i = 0; i < numBuffers; i++) {
+        ASSERT_EQ(umfPutIPCHandle(handles[i]), UMF_RESULT_SUCCESS);
+        ASSERT_EQ(umfFree(ptrs[i]), UMF_RESULT_SUCCESS);
+    }
+}
+#endif /* UMF_ENABLE_POOL_TRACKING_TESTS */
@@ -0,0 +1,216 @@
+// Copyright (C) 2023 Intel Corporation
+// Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+// See LICENSE.TXT
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// This file contains tests for the OS memory provider
+
+#include "provider.hpp"
+
+#include <umf/providers/provider_os_memory.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+using umf_test::test;
+
+static auto
+makeOsProvider(umf_os_memory_provider_params_t params =
+                   umfOsMemoryProviderParamsDefault()) {
+    umf_memory_provider_handle_t hProvider = nullptr;
+    auto ret =
+        umfMemoryProviderCreate(umfOsMemoryProviderOps(), &params, &hProvider);
+    return std::make_pair(ret, umf_test::wrapProviderUnique(hProvider));
+}
+
+static bool isAligned(void *ptr, size_t alignment) {
+    return (reinterpret_cast<uintptr_t>(ptr) & (alignment - 1)) == 0;
+}
+
+TEST_F(test, osProviderPageSizes) {
+    auto [ret, provider] = makeOsProvider();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    ASSERT_EQ(std::string(umfMemoryProviderGetName(provider.get())), "OS");
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = 0;
+    ASSERT_EQ(umfMemoryProviderGetMinPageSize(provider.get(), nullptr, &size),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(size, pageSize);
+    ASSERT_EQ(umfMemoryProviderGetRecommendedPageSize(provider.get(),
+                                                      1 << 30, &size),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(size, pageSize);
+}
+
+TEST_F(test, osProviderAllocAligned) {
+    static constexpr size_t sizes[] = {1, 100, 4096, 12345, 1 << 20};
+    static constexpr size_t alignments[] = {0, 8, 4096, 64 * 1024, 2 << 20};
+
+    auto [ret, provider] = makeOsProvider();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    for (auto size : sizes) {
+        for (auto alignment : alignments) {
+            void *ptr = nullptr;
+            ASSERT_EQ(
+                umfMemoryProviderAlloc(provider.get(), size, alignment, &ptr),
+                UMF_RESULT_SUCCESS);
+            ASSERT_NE(ptr, nullptr);
+            ASSERT_TRUE(isAligned(ptr, alignment ? alignment : 1));
+
+            // Memory comes zeroed from the OS
+            auto *bytes = static_cast<unsigned char *>(ptr);
+            ASSERT_EQ(bytes[0], 0);
+            ASSERT_EQ(bytes[size - 1], 0);
+            memset(ptr, 0xab, size);
+
+            ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, size),
+                      UMF_RESULT_SUCCESS);
+        }
+    }
+}
+
+TEST_F(test, osProviderInvalidArguments) {
+    auto [ret, provider] = makeOsProvider();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), 4096, 3, &ptr),
+              UMF_RESULT_ERROR_INVALID_ALIGNMENT);
+
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), 4096, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, 0),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, 4096),
+              UMF_RESULT_SUCCESS);
+
+    // Larger than the address space
+    ret = umfMemoryProviderAlloc(provider.get(), SIZE_MAX / 2, 0, &ptr);
+    ASSERT_EQ(ret, UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC);
+    ASSERT_EQ(ptr, nullptr);
+    ASSERT_EQ(umfGetLastFailedMemoryProvider(), provider.get());
+
+    const char *msg = nullptr;
+    int32_t error = 0;
+    umfMemoryProviderGetLastNativeError(provider.get(), &msg, &error);
+    ASSERT_NE(msg, nullptr);
+    ASSERT_EQ(error, ENOMEM);
+}
+
+TEST_F(test, osProviderPurge) {
+    auto [ret, provider] = makeOsProvider();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = 4 * pageSize;
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), size, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    auto *bytes = static_cast<unsigned char *>(ptr);
+
+    memset(ptr, 0xab, size);
+    ASSERT_EQ(umfMemoryProviderPurgeForce(provider.get(), ptr, size),
+              UMF_RESULT_SUCCESS);
+    for (size_t i = 0; i < size; i += pageSize / 4) {
+        ASSERT_EQ(bytes[i], 0);
+    }
+
+    // The contents are undefined until written again
+    memset(ptr, 0xab, size);
+    ASSERT_EQ(umfMemoryProviderPurgeLazy(provider.get(), ptr, size),
+              UMF_RESULT_SUCCESS);
+    memset(ptr, 0xcd, size);
+    ASSERT_EQ(bytes[size - 1], 0xcd);
+
+    ASSERT_EQ(umfMemoryProviderPurgeLazy(provider.get(), bytes + 1, pageSize),
+              UMF_RESULT_ERROR_INVALID_ALIGNMENT);
+
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, size),
+              UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, osProviderPartialFree) {
+    auto [ret, provider] = makeOsProvider();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), 4 * pageSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    auto *bytes = static_cast<char *>(ptr);
+
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(provider.get(), ptr,
+                                               4 * pageSize, 100),
+              UMF_RESULT_ERROR_INVALID_ALIGNMENT);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(provider.get(), ptr,
+                                               4 * pageSize, pageSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderAllocationSplit(provider.get(), bytes + pageSize,
+                                               3 * pageSize, pageSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), bytes + pageSize, pageSize),
+              UMF_RESULT_SUCCESS);
+
+    // The remaining pages stay accessible
+    bytes[0] = 1;
+    bytes[3 * pageSize - 1] = 1;
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, pageSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), bytes + 2 * pageSize,
+                                    2 * pageSize),
+              UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, osProviderTransparentHugePages) {
+    auto params = umfOsMemoryProviderParamsDefault();
+    params.hugePages = UMF_OS_HUGE_PAGES_TRANSPARENT;
+    auto [ret, provider] = makeOsProvider(params);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    size_t hugePageSize = 0;
+    ASSERT_EQ(umfMemoryProviderGetRecommendedPageSize(provider.get(), 1 << 30,
+                                                      &hugePageSize),
+              UMF_RESULT_SUCCESS);
+    size_t pageSize = 0;
+    ASSERT_EQ(umfMemoryProviderGetMinPageSize(provider.get(), nullptr,
+                                              &pageSize),
+              UMF_RESULT_SUCCESS);
+    ASSERT_GT(hugePageSize, pageSize);
+
+    void *ptr = nullptr;
+    ASSERT_EQ(umfMemoryProviderAlloc(provider.get(), 2 * hugePageSize, 0, &ptr),
+              UMF_RESULT_SUCCESS);
+    ASSERT_TRUE(isAligned(ptr, hugePageSize));
+    memset(ptr, 0xab, 2 * hugePageSize);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, 2 * hugePageSize),
+              UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, osProviderExplicitHugePages) {
+    auto params = umfOsMemoryProviderParamsDefault();
+    params.hugePages = UMF_OS_HUGE_PAGES_EXPLICIT;
+    auto [ret, provider] = makeOsProvider(params);
+    if (ret == UMF_RESULT_ERROR_NOT_SUPPORTED) {
+        GTEST_SKIP() << "huge pages are not supported";
+    }
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    size_t hugePageSize = 0;
+    ASSERT_EQ(umfMemoryProviderGetMinPageSize(provider.get(), nullptr,
+                                              &hugePageSize),
+              UMF_RESULT_SUCCESS);
+
+    void *ptr = nullptr;
+    ret = umfMemoryProviderAlloc(provider.get(), 100, 0, &ptr);
+    if (ret == UMF_RESULT_ERROR_MEMORY_PROVIDER_SPECIFIC) {
+        GTEST_SKIP() << "no huge pages reserved";
+    }
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    ASSERT_TRUE(isAligned(ptr, hugePageSize));
+    memset(ptr, 0xab, hugePageSize);
+    ASSERT_EQ(umfMemoryProviderFree(provider.get(), ptr, 100),
+              UMF_RESULT_SUCCESS);
+}
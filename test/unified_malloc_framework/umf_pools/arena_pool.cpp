@@ -0,0 +1,158 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include "arena_pool.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "pool.hpp"
+#include "provider.hpp"
+
+using umf_test::counting_provider;
+using umf_test::test;
+
+static usm::ArenaPool::Config poolConfig() {
+    usm::ArenaPool::Config config{};
+    config.ChunkSize = 64 * 1024;
+    config.MaxRetainedChunks = 2;
+    return config;
+}
+
+static auto makePool(usm::ArenaPool::Config config = poolConfig()) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    EXPECT_EQ(ret, UMF_RESULT_SUCCESS);
+    auto [retp, pool] = umf::poolMakeUnique<usm::ArenaPool, 1>(
+        {std::move(provider)}, config);
+    EXPECT_EQ(retp, UMF_RESULT_SUCCESS);
+    return std::move(pool);
+}
+
+TEST_F(test, arenaBumpAndReset) {
+    auto config = poolConfig();
+    auto pool = makePool(config);
+
+    // Consecutive allocations are adjacent, rounded up to the fundamental
+    // alignment
+    std::vector<char *> ptrs;
+    const size_t numAllocs = 4 * config.ChunkSize / 64;
+    for (size_t i = 0; i < numAllocs; i++) {
+        ptrs.push_back(static_cast<char *>(umfPoolMalloc(pool.get(), 60)));
+        ASSERT_NE(ptrs.back(), nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptrs.back()) %
+                      alignof(std::max_align_t),
+                  0);
+        memset(ptrs.back(), 0xab, 60);
+    }
+    EXPECT_EQ(ptrs[1] - ptrs[0], 64);
+    EXPECT_EQ(counting_provider::numAllocs, 4);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptrs[0]), UMF_RESULT_SUCCESS);
+
+    // Up to MaxRetainedChunks chunks are kept and reused
+    ASSERT_EQ(umfPoolReset(pool.get()), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes,
+              config.MaxRetainedChunks * config.ChunkSize);
+
+    for (size_t i = 0; i < numAllocs; i++) {
+        ASSERT_NE(umfPoolMalloc(pool.get(), 60), nullptr);
+    }
+    EXPECT_EQ(counting_provider::numAllocs, 6);
+
+    ASSERT_EQ(umfPoolReset(pool.get()), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolTrim(pool.get()), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+}
+
+TEST_F(test, arenaLargeAndAligned) {
+    auto config = poolConfig();
+    auto pool = makePool(config);
+
+    void *small = umfPoolMalloc(pool.get(), 64);
+    ASSERT_NE(small, nullptr);
+
+    // Too large for a chunk, allocated on its own without replacing the
+    // current chunk
+    void *large = umfPoolMalloc(pool.get(), 2 * config.ChunkSize);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(umfPoolMalloc(pool.get(), 64), static_cast<char *>(small) + 64);
+
+    for (size_t alignment : {64, 4096}) {
+        void *ptr = umfPoolAlignedMalloc(pool.get(), 64, alignment);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+    }
+
+    void *zeroed = umfPoolCalloc(pool.get(), 16, 16);
+    ASSERT_NE(zeroed, nullptr);
+    for (size_t i = 0; i < 256; i++) {
+        ASSERT_EQ(static_cast<char *>(zeroed)[i], 0);
+    }
+
+    EXPECT_EQ(umfPoolAlignedMalloc(pool.get(), 64, 3), nullptr);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+              UMF_RESULT_ERROR_INVALID_ALIGNMENT);
+    EXPECT_EQ(umfPoolRealloc(pool.get(), small, 128), nullptr);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+              UMF_RESULT_ERROR_NOT_SUPPORTED);
+
+    // Chunks of other sizes are never kept
+    ASSERT_EQ(umfPoolReset(pool.get()), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, config.ChunkSize);
+}
+
+TEST_F(test, arenaMultiThreaded) {
+    auto pool = makePool();
+
+    static constexpr int numThreads = 4;
+    static constexpr size_t numAllocs = 10000;
+    std::vector<std::vector<uint64_t *>> ptrs(numThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < numAllocs; i++) {
+                auto *ptr = static_cast<uint64_t *>(
+                    umfPoolMalloc(pool.get(), 3 * sizeof(uint64_t)));
+                ASSERT_NE(ptr, nullptr);
+                ptr[0] = ptr[1] = ptr[2] = t * numAllocs + i;
+                ptrs[t].push_back(ptr);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // No allocation overlaps another one
+    for (int t = 0; t < numThreads; t++) {
+        for (size_t i = 0; i < numAllocs; i++) {
+            auto *ptr = ptrs[t][i];
+            ASSERT_EQ(ptr[0], t * numAllocs + i);
+            ASSERT_EQ(ptr[2], t * numAllocs + i);
+        }
+    }
+    ASSERT_EQ(umfPoolReset(pool.get()), UMF_RESULT_SUCCESS);
+}
+
+#ifdef UMF_ENABLE_POOL_TRACKING_TESTS
+TEST_F(test, arenaPoolByPtr) {
+    auto pool = makePool();
+    void *ptr = umfPoolMalloc(pool.get(), 64);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolByPtr(ptr), pool.get());
+    ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolByPtr(ptr), pool.get());
+
+    ASSERT_EQ(umfPoolReset(pool.get()), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolTrim(pool.get()), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolByPtr(ptr), nullptr);
+}
+#endif
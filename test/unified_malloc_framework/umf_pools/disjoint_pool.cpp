@@ -10,10 +10,25 @@
 
 #include "disjoint_pool.hpp"
 
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <thread>
+
 #include "memoryPool.hpp"
 #include "provider.h"
 #include "provider.hpp"
 
+#ifndef _WIN32
+#include <umf/providers/provider_os_memory.h>
+#endif
+
+#ifdef __linux__
+#include <umf/ipc.h>
+#include <umf/providers/provider_memfd.h>
+#endif
+
 static usm::DisjointPool::Config poolConfig() {
     usm::DisjointPool::Config config{};
     config.SlabMinSize = 4096;
@@ -23,16 +38,19 @@ static usm::DisjointPool::Config poolConfig() {
     return config;
 }
 
-static auto makePool() {
-    auto [ret, provider] =
-        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
-    EXPECT_EQ(ret, UMF_RESULT_SUCCESS);
-    auto [retp, pool] = umf::poolMakeUnique<usm::DisjointPool, 1>(
-        {std::move(provider)}, poolConfig());
+template <typename Provider = umf_test::provider_malloc,
+          typename... Providers>
+static auto makePool(usm::DisjointPool::Config config = poolConfig()) {
+    auto [retp, pool] =
+        umf::poolMakeUnique<usm::DisjointPool, 1 + sizeof...(Providers)>(
+            {umf::memoryProviderMakeUnique<Provider>().second,
+             umf::memoryProviderMakeUnique<Providers>().second...},
+            config);
     EXPECT_EQ(retp, UMF_RESULT_SUCCESS);
     return std::move(pool);
 }
 
+using umf_test::counting_provider;
 using umf_test::test;
 
 TEST_F(test, freeErrorPropagation) {
@@ -69,9 +87,938 @@ TEST_F(test, freeErrorPropagation) {
     EXPECT_EQ(freeRet, freeReturn);
 }
 
+TEST_F(test, threadCacheHits) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.ThreadCacheSize = 8;
+
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    static constexpr size_t numIters = 100;
+    for (size_t i = 0; i < numIters; i++) {
+        void *ptr = pool.malloc(64);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+    }
+
+    // Only the first allocation has to go to the bucket.
+    auto stats = pool.getThreadCacheStats();
+    EXPECT_EQ(stats.Misses, 1);
+    EXPECT_EQ(stats.Hits, numIters - 1);
+    EXPECT_EQ(stats.Flushes, 0);
+
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < 4 * config.ThreadCacheSize; i++) {
+        ptrs.push_back(pool.malloc(64));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+    }
+
+    EXPECT_GT(pool.getThreadCacheStats().Flushes, 0);
+}
+
+TEST_F(test, allocAllPoolableSizes) {
+    for (size_t minBucketSize : {64, 100}) {
+        auto config = poolConfig();
+        config.MinBucketSize = minBucketSize;
+        auto pool = makePool(config);
+
+        for (size_t size = 1; size <= config.MaxPoolableSize; size++) {
+            void *ptr = umfPoolMalloc(pool.get(), size);
+            ASSERT_NE(ptr, nullptr);
+            std::memset(ptr, 0, size);
+            ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+        }
+    }
+}
+
+TEST_F(test, fillThenDrainSlab) {
+    // A single slab split into more chunks than fit in one bitmap word
+    auto config = poolConfig();
+    config.SlabMinSize = 64 * 1024;
+    auto pool = makePool(config);
+
+    static constexpr size_t size = 64;
+    const size_t numChunks = config.SlabMinSize / size;
+
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < numChunks; i++) {
+        ptrs.push_back(umfPoolMalloc(pool.get(), size));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+
+    // Free every third chunk, starting from the end of the slab
+    std::set<void *> freed;
+    for (size_t i = numChunks; i > 0; i -= 3) {
+        freed.insert(ptrs[i - 1]);
+        ASSERT_EQ(umfPoolFree(pool.get(), ptrs[i - 1]), UMF_RESULT_SUCCESS);
+        if (i < 3) {
+            break;
+        }
+    }
+
+    // All freed chunks are reused before any new slab is allocated
+    for (size_t i = 0; i < freed.size(); i++) {
+        void *ptr = umfPoolMalloc(pool.get(), size);
+        ASSERT_NE(freed.find(ptr), freed.end());
+        ptrs.push_back(ptr);
+    }
+
+    std::set<void *> unique(ptrs.begin(), ptrs.end());
+    ASSERT_EQ(unique.size(), numChunks);
+    for (auto ptr : unique) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, reallocInPlace) {
+    auto config = poolConfig();
+    auto pool = makePool(config);
+
+    auto *ptr = static_cast<char *>(umfPoolMalloc(pool.get(), 100));
+    ASSERT_NE(ptr, nullptr);
+    std::memset(ptr, 0xab, 100);
+
+    // Still fits the 128 bytes bucket
+    EXPECT_EQ(umfPoolRealloc(pool.get(), ptr, 128), ptr);
+
+    // Served from a smaller bucket
+    auto *small = static_cast<char *>(umfPoolRealloc(pool.get(), ptr, 16));
+    ASSERT_NE(small, nullptr);
+    EXPECT_NE(small, ptr);
+    for (size_t i = 0; i < 16; i++) {
+        ASSERT_EQ(small[i], static_cast<char>(0xab));
+    }
+
+    // Bypasses the buckets
+    const size_t largeSize = 2 * config.MaxPoolableSize;
+    auto *large =
+        static_cast<char *>(umfPoolRealloc(pool.get(), small, largeSize));
+    ASSERT_NE(large, nullptr);
+    for (size_t i = 0; i < 16; i++) {
+        ASSERT_EQ(large[i], static_cast<char>(0xab));
+    }
+    std::memset(large, 0, largeSize);
+    EXPECT_EQ(umfPoolRealloc(pool.get(), large, largeSize - 1), large);
+
+    EXPECT_EQ(umfPoolFree(pool.get(), large), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, callocZeroedProvider) {
+    struct memory_provider : public umf_test::provider_base {
+        enum umf_result_t alloc(size_t size, size_t, void **ptr) noexcept {
+            *ptr = ::calloc(1, size);
+            return UMF_RESULT_SUCCESS;
+        }
+        enum umf_result_t free(void *ptr, size_t) noexcept {
+            ::free(ptr);
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+
+    auto config = poolConfig();
+    config.ZeroedProviderMemory = true;
+    auto pool = makePool<memory_provider>(config);
+
+    // Chunks and slabs which were used before must be cleared again
+    for (size_t size : {64, 4096, 2 * 4096}) {
+        for (int i = 0; i < 2; i++) {
+            auto *ptr = static_cast<char *>(umfPoolCalloc(pool.get(), 1, size));
+            ASSERT_NE(ptr, nullptr);
+            for (size_t j = 0; j < size; j++) {
+                ASSERT_EQ(ptr[j], 0);
+            }
+            std::memset(ptr, 0xab, size);
+            ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+        }
+    }
+}
+
+TEST_F(test, usableSizeAndSizedFree) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Served from the 96 bytes bucket
+    void *ptr = pool.malloc(70);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(pool.malloc_usable_size(ptr), 96);
+    EXPECT_EQ(pool.free_sized(ptr, 70), UMF_RESULT_SUCCESS);
+
+    // Served from a full slab
+    ptr = pool.malloc(config.SlabMinSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(pool.malloc_usable_size(ptr), config.SlabMinSize);
+    EXPECT_EQ(pool.free_sized(ptr, config.SlabMinSize), UMF_RESULT_SUCCESS);
+
+    // Bypasses the buckets
+    const size_t largeSize = 2 * config.MaxPoolableSize;
+    ptr = pool.malloc(largeSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(pool.malloc_usable_size(ptr), largeSize);
+    EXPECT_EQ(pool.free_sized(ptr, largeSize), UMF_RESULT_SUCCESS);
+
+    EXPECT_EQ(pool.malloc_usable_size(nullptr), 0);
+}
+
+TEST_F(test, largeAlignmentFootprint) {
+    static size_t allocatedBytes = 0;
+    struct memory_provider : public umf_test::provider_malloc {
+        enum umf_result_t alloc(size_t size, size_t align,
+                                void **ptr) noexcept {
+            allocatedBytes += size;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+        enum umf_result_t get_min_page_size(void *,
+                                            size_t *pageSize) noexcept {
+            *pageSize = 4096;
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+
+    auto config = poolConfig();
+    config.SlabMinSize = 64 * 1024;
+    config.MaxPoolableSize = 1024 * 1024;
+    auto pool = makePool<memory_provider>(config);
+
+    // Each allocation takes exactly one slab of its own size
+    static constexpr size_t alignment = 64 * 1024;
+    static constexpr size_t numAllocs = 4;
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < numAllocs; i++) {
+        ptrs.push_back(umfPoolAlignedMalloc(pool.get(), alignment, alignment));
+        ASSERT_NE(ptrs.back(), nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptrs.back()) % alignment, 0);
+    }
+    EXPECT_EQ(allocatedBytes, numAllocs * alignment);
+
+    // Smaller allocations share a slab, all chunks are aligned
+    for (size_t i = 0; i < numAllocs; i++) {
+        ptrs.push_back(umfPoolAlignedMalloc(pool.get(), 100, 8192));
+        ASSERT_NE(ptrs.back(), nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptrs.back()) % 8192, 0);
+    }
+    EXPECT_EQ(allocatedBytes, numAllocs * alignment + config.SlabMinSize);
+
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, trimPooledSlabs) {
+    counting_provider::resetCounters();
+    auto config = poolConfig();
+    config.MaxPoolableSize = 64 * 1024;
+    config.ThreadCacheSize = 8;
+    auto pool = makePool<counting_provider>(config);
+
+    std::vector<void *> ptrs;
+    for (size_t size : {64, 1024, 8192, 64 * 1024}) {
+        for (size_t i = 0; i < config.Capacity; i++) {
+            ptrs.push_back(umfPoolMalloc(pool.get(), size));
+            ASSERT_NE(ptrs.back(), nullptr);
+        }
+    }
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+    EXPECT_GT(counting_provider::allocatedBytes, 0);
+
+    ASSERT_EQ(umfPoolTrim(pool.get()), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+
+    // The pool is still usable afterwards
+    void *ptr = umfPoolMalloc(pool.get(), 64);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, batchAllocFree) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.ThreadCacheSize = 8;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Chunks of a single bucket
+    static constexpr size_t count = 1000;
+    std::vector<void *> ptrs(count);
+    ASSERT_EQ(pool.malloc_batch(64, count, ptrs.data()), count);
+    EXPECT_EQ(std::set<void *>(ptrs.begin(), ptrs.end()).size(), count);
+    for (auto ptr : ptrs) {
+        memset(ptr, 0xab, 64);
+    }
+    const size_t chunksPerSlab = config.SlabMinSize / 64;
+    EXPECT_EQ(counting_provider::allocatedBytes,
+              (count + chunksPerSlab - 1) / chunksPerSlab * config.SlabMinSize);
+
+    // Full slabs and allocations bypassing the buckets
+    void *slabs[2];
+    ASSERT_EQ(pool.malloc_batch(config.SlabMinSize, 2, slabs), 2);
+    void *large[2];
+    ASSERT_EQ(pool.malloc_batch(2 * config.MaxPoolableSize, 2, large), 2);
+
+    auto stats = pool.getStats();
+    ASSERT_EQ(stats.Buckets.size(), 2);
+    EXPECT_EQ(stats.Buckets[0].AllocCount, count);
+    EXPECT_EQ(stats.Buckets[1].AllocCount, 2);
+    EXPECT_EQ(stats.AllocCount, count + 4);
+
+    // Allocations of any size and NULL elements may be mixed
+    void *kept = ptrs[1];
+    ptrs[1] = nullptr;
+    ptrs.insert(ptrs.begin() + 10, slabs[0]);
+    ptrs.insert(ptrs.begin() + 20, large[0]);
+    ptrs.insert(ptrs.end(), {slabs[1], large[1]});
+    ASSERT_EQ(pool.free_batch(ptrs.data(), ptrs.size()), UMF_RESULT_SUCCESS);
+
+    stats = pool.getStats();
+    EXPECT_EQ(stats.Buckets[0].FreeCount, count - 1);
+    EXPECT_EQ(stats.Buckets[0].ChunksInUse, 1);
+    EXPECT_EQ(stats.Buckets[1].FreeCount, 2);
+    EXPECT_EQ(stats.FreeCount, count + 3);
+
+    EXPECT_EQ(pool.malloc_batch(0, count, ptrs.data()), 0);
+    ASSERT_EQ(pool.free(kept), UMF_RESULT_SUCCESS);
+}
+
+// Provider failing once the given number of allocations were made
+struct limited_provider : public umf_test::provider_malloc {
+    static inline std::atomic<size_t> allocsLeft{0};
+
+    enum umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+        if (!allocsLeft) {
+            return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        --allocsLeft;
+        return provider_malloc::alloc(size, align, ptr);
+    }
+};
+
+TEST_F(test, batchAllocFailure) {
+    auto pool = makePool<limited_provider>();
+
+    // The allocations made before the failure are returned
+    for (size_t size : {size_t{64}, 2 * poolConfig().MaxPoolableSize}) {
+        limited_provider::allocsLeft = 2;
+        const size_t perSlab = size < poolConfig().SlabMinSize
+                                   ? poolConfig().SlabMinSize / size
+                                   : 1;
+        std::vector<void *> ptrs(4 * perSlab);
+        size_t allocated =
+            umfPoolMallocBatch(pool.get(), size, ptrs.size(), ptrs.data());
+        EXPECT_EQ(allocated, 2 * perSlab);
+        EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+                  UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY);
+        ASSERT_EQ(umfPoolFreeBatch(pool.get(), ptrs.data(), allocated),
+                  UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, purgeThreadDecay) {
+    counting_provider::resetCounters();
+    auto config = poolConfig();
+    config.PurgeDecayMs = 10;
+    config.PurgeThread = true;
+    auto pool = makePool<counting_provider>(config);
+
+    // A burst of allocations followed by an idle phase
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < config.Capacity; i++) {
+        ptrs.push_back(umfPoolMalloc(pool.get(), config.SlabMinSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+
+    for (int i = 0; i < 1000 && counting_provider::allocatedBytes; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+    EXPECT_EQ(counting_provider::purgedBytes,
+              config.Capacity * config.SlabMinSize);
+}
+
+TEST_F(test, poolStats) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.ThreadCacheSize = 8;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    auto stats = pool.getStats();
+    EXPECT_TRUE(stats.Buckets.empty());
+    EXPECT_EQ(stats.ResidentBytes, 0);
+
+    // Allocations of a thread which exits are still accounted for
+    std::thread([&pool] {
+        for (int i = 0; i < 4; i++) {
+            void *ptr = pool.malloc(64);
+            ASSERT_NE(ptr, nullptr);
+            ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+        }
+    }).join();
+
+    void *small = pool.malloc(64);
+    ASSERT_NE(small, nullptr);
+    const size_t largeSize = 2 * config.MaxPoolableSize;
+    void *large = pool.malloc(largeSize);
+    ASSERT_NE(large, nullptr);
+
+    stats = pool.getStats();
+    ASSERT_EQ(stats.Buckets.size(), 1);
+    EXPECT_EQ(stats.Buckets[0].Size, 64);
+    EXPECT_EQ(stats.Buckets[0].AllocCount, 5);
+    EXPECT_EQ(stats.Buckets[0].FreeCount, 4);
+    EXPECT_EQ(stats.AllocCount, 6);
+    EXPECT_EQ(stats.FreeCount, 4);
+    EXPECT_EQ(stats.ResidentBytes, config.SlabMinSize + largeSize);
+    EXPECT_GE(stats.InUseBytes, 64 + largeSize);
+    EXPECT_LE(stats.InUseBytes, stats.ResidentBytes);
+    EXPECT_GT(stats.Fragmentation, 0);
+    EXPECT_LT(stats.Fragmentation, 1);
+
+    ASSERT_EQ(pool.free(large), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(pool.free(small), UMF_RESULT_SUCCESS);
+
+    stats = pool.getStats();
+    EXPECT_EQ(stats.AllocCount, stats.FreeCount);
+    EXPECT_EQ(stats.ResidentBytes, config.SlabMinSize);
+    EXPECT_EQ(stats.PeakResidentBytes, config.SlabMinSize + largeSize);
+}
+
+TEST_F(test, shardedCrossThreadFree) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.NumShards = 4;
+    config.ThreadCacheSize = 8;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Memory allocated by the threads of some shards is freed by the threads
+    // of others, and has to go back to the shards which own it.
+    constexpr size_t numThreads = 8;
+    constexpr size_t numAllocs = 256;
+    std::vector<std::vector<void *>> ptrs(numThreads);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; i++) {
+        threads.emplace_back([&, i] {
+            for (size_t j = 0; j < numAllocs; j++) {
+                ptrs[i].push_back(pool.malloc(64 << (j % 4)));
+                ASSERT_NE(ptrs[i].back(), nullptr);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    for (size_t i = 0; i < numThreads; i++) {
+        threads.emplace_back([&, i] {
+            for (auto ptr : ptrs[(i + 1) % numThreads]) {
+                ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.AllocCount, numThreads * numAllocs);
+    EXPECT_EQ(stats.FreeCount, numThreads * numAllocs);
+    EXPECT_EQ(stats.InUseBytes, 0);
+}
+
+TEST_F(test, prewarmSlabs) {
+    for (bool async : {false, true}) {
+        counting_provider::resetCounters();
+        auto [ret, provider] =
+            umf::memoryProviderMakeUnique<counting_provider>();
+        ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+        auto config = poolConfig();
+        config.PrewarmSlabs = 2;
+        config.PrewarmSize = 14 * config.SlabMinSize;
+        config.PrewarmAsync = async;
+        umf_memory_provider_handle_t hProvider = provider.get();
+        usm::DisjointPool pool;
+        ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+        // Chunked buckets only pool a single slab, so the byte budget is
+        // reached while adding a second slab to the larger buckets
+        for (int i = 0; i < 1000 && counting_provider::allocatedBytes <
+                                        config.PrewarmSize;
+             i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_EQ(counting_provider::allocatedBytes, config.PrewarmSize);
+
+        // The first allocations of the smallest sizes do not reach the
+        // provider
+        for (size_t size = 64; size <= config.SlabMinSize; size *= 2) {
+            void *ptr = pool.malloc(size);
+            ASSERT_NE(ptr, nullptr);
+            ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+        }
+        EXPECT_EQ(counting_provider::allocatedBytes, config.PrewarmSize);
+
+        auto stats = pool.getStats();
+        EXPECT_EQ(stats.AllocPoolCount, stats.AllocCount);
+    }
+}
+
+TEST_F(test, largeExtentCache) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    const size_t largeSize = 16 * config.MaxPoolableSize;
+    config.MaxLargeCacheSize = 4 * largeSize;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Freed memory is reused
+    void *ptr = pool.malloc(2 * largeSize);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(pool.malloc(2 * largeSize), ptr);
+    ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+
+    // Split to serve smaller allocations, which are merged again when freed
+    auto *first = static_cast<char *>(pool.malloc(largeSize));
+    auto *second = static_cast<char *>(pool.malloc(largeSize));
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(static_cast<size_t>(std::abs(second - first)), largeSize);
+    EXPECT_EQ(counting_provider::allocatedBytes, 2 * largeSize);
+    ASSERT_EQ(pool.free(second), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(pool.free(first), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(pool.malloc(2 * largeSize), ptr);
+    ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.AllocPoolCount, 4);
+    EXPECT_EQ(stats.PooledBytes, 2 * largeSize);
+
+    // The least recently freed memory is returned beyond the limit
+    std::vector<void *> ptrs;
+    for (int i = 0; i < 8; i++) {
+        ptrs.push_back(pool.malloc(largeSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    for (auto p : ptrs) {
+        ASSERT_EQ(pool.free(p), UMF_RESULT_SUCCESS);
+    }
+    EXPECT_LE(counting_provider::allocatedBytes, config.MaxLargeCacheSize);
+    EXPECT_EQ(pool.getStats().PooledBytes, counting_provider::allocatedBytes);
+
+    ASSERT_EQ(pool.trim(), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+}
+
+TEST_F(test, largeExtentCacheLimit) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    const size_t largeSize = 16 * config.MaxPoolableSize;
+    config.MaxLargeCacheSize = 4 * largeSize;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Much larger free memory is not split for a small allocation
+    void *big = pool.malloc(4 * largeSize);
+    ASSERT_NE(big, nullptr);
+    ASSERT_EQ(pool.free(big), UMF_RESULT_SUCCESS);
+    void *small = pool.malloc(largeSize);
+    ASSERT_NE(small, nullptr);
+    EXPECT_EQ(counting_provider::allocatedBytes, 5 * largeSize);
+
+    // The least recently freed memory is returned beyond the limit
+    ASSERT_EQ(pool.free(small), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, largeSize);
+
+    // Free parts of memory still in use do not count towards the limit
+    void *half = pool.malloc(largeSize / 2);
+    EXPECT_EQ(half, small);
+    big = pool.malloc(4 * largeSize);
+    ASSERT_NE(big, nullptr);
+    ASSERT_EQ(pool.free(big), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, 5 * largeSize);
+    EXPECT_EQ(pool.getStats().PooledBytes, 4 * largeSize + largeSize / 2);
+
+    ASSERT_EQ(pool.free(half), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, largeSize);
+
+    ASSERT_EQ(pool.trim(), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+}
+
+TEST_F(test, deferredFree) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.DeferredFree = true;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // One thread allocates while the other one frees the same chunks
+    constexpr size_t numAllocs = 16 * 1024;
+    std::mutex lock;
+    std::vector<void *> queue;
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+        std::vector<void *> ptrs;
+        for (bool last = false; !last; ptrs.clear()) {
+            // Everything is queued once done is set
+            last = done;
+            {
+                std::lock_guard<std::mutex> lg(lock);
+                ptrs.swap(queue);
+            }
+            for (auto ptr : ptrs) {
+                ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+            }
+        }
+    });
+    for (size_t i = 0; i < numAllocs; i++) {
+        void *ptr = pool.malloc(64 << (i % 4));
+        ASSERT_NE(ptr, nullptr);
+        std::lock_guard<std::mutex> lg(lock);
+        queue.push_back(ptr);
+    }
+    done = true;
+    consumer.join();
+
+    // The frees are applied by the next allocation from the bucket
+    void *ptr = pool.malloc(64);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+
+    ASSERT_EQ(pool.trim(), UMF_RESULT_SUCCESS);
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.AllocCount, numAllocs + 1);
+    EXPECT_EQ(stats.FreeCount, numAllocs + 1);
+    EXPECT_EQ(stats.InUseBytes, 0);
+    EXPECT_EQ(counting_provider::allocatedBytes, 0);
+}
+
+TEST_F(test, deferredFreeStress) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    auto config = poolConfig();
+    config.DeferredFree = true;
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    // Several threads free chunks of the same slabs while the owner keeps
+    // applying the deferred frees. trim() only applies the frees which are
+    // queued and frees nothing itself, so a free lost in the race would not
+    // be recovered by the final one.
+    constexpr size_t numThreads = 4;
+    constexpr size_t numAllocs = 1024;
+    for (int round = 0; round < 100; round++) {
+        std::vector<void *> ptrs(numAllocs);
+        for (auto &ptr : ptrs) {
+            ptr = pool.malloc(64);
+            ASSERT_NE(ptr, nullptr);
+        }
+
+        std::atomic<size_t> running = numThreads;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < numThreads; t++) {
+            threads.emplace_back([&, t] {
+                for (size_t i = t; i < numAllocs; i += numThreads) {
+                    ASSERT_EQ(pool.free(ptrs[i]), UMF_RESULT_SUCCESS);
+                }
+                --running;
+            });
+        }
+        while (running) {
+            ASSERT_EQ(pool.trim(), UMF_RESULT_SUCCESS);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        ASSERT_EQ(pool.trim(), UMF_RESULT_SUCCESS);
+        auto stats = pool.getStats();
+        ASSERT_EQ(stats.FreeCount, stats.AllocCount);
+        ASSERT_EQ(stats.InUseBytes, 0);
+        ASSERT_EQ(counting_provider::allocatedBytes, 0);
+    }
+}
+
+// One of several providers of a pool, counting the allocations made from it
+template <int N> struct numbered_provider : public umf_test::provider_malloc {
+    static inline std::atomic<size_t> numAllocs{0};
+    static inline std::atomic<bool> outOfMemory{false};
+
+    enum umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+        if (outOfMemory) {
+            return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        ++numAllocs;
+        return provider_malloc::alloc(size, align, ptr);
+    }
+};
+
+// Slabs allocated from each of two providers with the given policy, by
+// allocating count buffers of each size
+static std::pair<size_t, size_t>
+allocFromTwoProviders(usm::DisjointPoolConfig config,
+                      std::initializer_list<size_t> sizes, size_t count) {
+    numbered_provider<0>::numAllocs = 0;
+    numbered_provider<1>::numAllocs = 0;
+    auto pool = makePool<numbered_provider<0>, numbered_provider<1>>(config);
+
+    std::vector<void *> ptrs;
+    for (size_t size : sizes) {
+        for (size_t i = 0; i < count; i++) {
+            ptrs.push_back(umfPoolMalloc(pool.get(), size));
+            EXPECT_NE(ptrs.back(), nullptr);
+        }
+    }
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+    return {numbered_provider<0>::numAllocs, numbered_provider<1>::numAllocs};
+}
+
+TEST_F(test, multiProviderPolicies) {
+    auto config = poolConfig();
+    const size_t largeSize = 4 * config.MaxPoolableSize;
+
+    // Slabs and large allocations alternate between the providers
+    config.ProviderPolicy = usm::DisjointPoolProviderPolicy::Stripe;
+    auto [striped0, striped1] = allocFromTwoProviders(
+        config, {config.SlabMinSize, largeSize}, config.Capacity);
+    EXPECT_EQ(striped0, config.Capacity);
+    EXPECT_EQ(striped1, config.Capacity);
+
+    // The second provider is used only when the first one fails
+    config.ProviderPolicy = usm::DisjointPoolProviderPolicy::Fallback;
+    auto [preferred0, preferred1] = allocFromTwoProviders(
+        config, {64, config.SlabMinSize, largeSize}, config.Capacity);
+    EXPECT_EQ(preferred0, 2 * config.Capacity + 1);
+    EXPECT_EQ(preferred1, 0);
+
+    numbered_provider<0>::outOfMemory = true;
+    auto [fallback0, fallback1] = allocFromTwoProviders(
+        config, {64, config.SlabMinSize, largeSize}, config.Capacity);
+    numbered_provider<0>::outOfMemory = false;
+    EXPECT_EQ(fallback0, 0);
+    EXPECT_EQ(fallback1, 2 * config.Capacity + 1);
+
+    // Chunks up to 256 bytes from the first provider, the rest from the
+    // second one
+    config.ProviderPolicy = usm::DisjointPoolProviderPolicy::SizeRouted;
+    config.ProviderSizeLimits = {256};
+    auto [small0, small1] = allocFromTwoProviders(config, {64, 256}, 1);
+    EXPECT_EQ(small0, 2);
+    EXPECT_EQ(small1, 0);
+    auto [routed0, routed1] =
+        allocFromTwoProviders(config, {512, largeSize}, 1);
+    EXPECT_EQ(routed0, 0);
+    EXPECT_EQ(routed1, 2);
+}
+
+TEST_F(test, multiProviderInvalidArgs) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    umf_memory_provider_handle_t providers[] = {provider.get(), nullptr};
+    usm::DisjointPool pool;
+    EXPECT_EQ(pool.initialize(providers, 0, poolConfig()),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    EXPECT_EQ(pool.initialize(providers, 2, poolConfig()),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
+#if defined(UMF_ENABLE_POOL_TRACKING_TESTS) && defined(__linux__)
+static umf::provider_unique_handle_t makeMemfdProvider() {
+    auto params = umfMemfdMemoryProviderParamsDefault();
+    umf_memory_provider_handle_t hProvider = nullptr;
+    EXPECT_EQ(umfMemoryProviderCreate(umfMemfdMemoryProviderOps(), &params,
+                                      &hProvider),
+              UMF_RESULT_SUCCESS);
+    return umf_test::wrapProviderUnique(hProvider);
+}
+
+TEST_F(test, multiProviderIpc) {
+    auto config = poolConfig();
+    config.ProviderPolicy = usm::DisjointPoolProviderPolicy::Stripe;
+    auto [ret, pool] = umf::poolMakeUnique<usm::DisjointPool, 2>(
+        {makeMemfdProvider(), makeMemfdProvider()}, config);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+
+    // Slabs of the first and of the second provider
+    void *ptrs[2];
+    for (int i = 0; i < 2; i++) {
+        ptrs[i] = umfPoolMalloc(pool.get(), config.SlabMinSize);
+        ASSERT_NE(ptrs[i], nullptr);
+        ASSERT_EQ(umfPoolByPtr(ptrs[i]), pool.get());
+        memset(ptrs[i], i + 1, config.SlabMinSize);
+    }
+
+    // Handles are opened with the provider of the same index, which only
+    // supports IPC for the second one in this pool
+    auto [otherRet, otherPool] = umf::poolMakeUnique<usm::DisjointPool, 2>(
+        {umf::memoryProviderMakeUnique<umf_test::provider_malloc>().second,
+         makeMemfdProvider()},
+        config);
+    ASSERT_EQ(otherRet, UMF_RESULT_SUCCESS);
+
+    for (int i = 0; i < 2; i++) {
+        umf_ipc_handle_t handle = nullptr;
+        size_t handleSize = 0;
+        ASSERT_EQ(umfGetIPCHandle(ptrs[i], &handle, &handleSize),
+                  UMF_RESULT_SUCCESS);
+
+        void *opened = nullptr;
+        ASSERT_EQ(umfOpenIPCHandle(pool.get(), handle, &opened),
+                  UMF_RESULT_SUCCESS);
+        EXPECT_EQ(umfPoolByPtr(opened), pool.get());
+        EXPECT_EQ(*static_cast<char *>(opened), i + 1);
+        ASSERT_EQ(umfCloseIPCHandle(opened), UMF_RESULT_SUCCESS);
+
+        EXPECT_EQ(umfOpenIPCHandle(otherPool.get(), handle, &opened),
+                  i ? UMF_RESULT_SUCCESS : UMF_RESULT_ERROR_NOT_SUPPORTED);
+        if (i) {
+            EXPECT_EQ(umfPoolByPtr(opened), otherPool.get());
+            EXPECT_EQ(*static_cast<char *>(opened), i + 1);
+            ASSERT_EQ(umfCloseIPCHandle(opened), UMF_RESULT_SUCCESS);
+        }
+
+        ASSERT_EQ(umfPutIPCHandle(handle), UMF_RESULT_SUCCESS);
+    }
+
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+#endif
+
+// Two rounds of allocating a skewed mix of sizes and freeing it all
+static void runSkewedTrace(usm::DisjointPool &pool) {
+    for (int round = 0; round < 2; round++) {
+        std::vector<void *> ptrs;
+        for (size_t i = 0; i < 4096; i++) {
+            ptrs.push_back(pool.malloc(i % 8 ? 200 : 70));
+            ASSERT_NE(ptrs.back(), nullptr);
+        }
+        for (auto ptr : ptrs) {
+            ASSERT_EQ(pool.free(ptr), UMF_RESULT_SUCCESS);
+        }
+    }
+}
+
+TEST_F(test, tunedSizeClasses) {
+    auto [ret, provider] =
+        umf::memoryProviderMakeUnique<umf_test::provider_malloc>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    umf_memory_provider_handle_t hProvider = provider.get();
+
+    auto config = poolConfig();
+    config.SizeHistogramAllocs = 1024;
+    usm::DisjointPool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+    runSkewedTrace(pool);
+    auto stats = pool.getStats();
+
+    // 200 and 70 byte allocations no longer go to the 256 and 96 byte
+    // buckets. The 256 byte bucket had to allocate its slabs twice.
+    auto tuned = pool.getTunedConfig();
+    ASSERT_EQ(tuned.ExtraBucketSizes, (std::vector<size_t>{224, 80}));
+    ASSERT_EQ(tuned.BucketCapacities.count(256), 1);
+    ASSERT_EQ(tuned.BucketCapacities[224], tuned.BucketCapacities[256]);
+
+    usm::DisjointPool tunedPool;
+    ASSERT_EQ(tunedPool.initialize(&hProvider, 1, tuned), UMF_RESULT_SUCCESS);
+    runSkewedTrace(tunedPool);
+    auto tunedStats = tunedPool.getStats();
+
+    EXPECT_LT(tunedStats.PeakResidentBytes, stats.PeakResidentBytes);
+    EXPECT_GT(tunedStats.AllocPoolCount, stats.AllocPoolCount);
+}
+
 INSTANTIATE_TEST_SUITE_P(disjointPoolTests, umfPoolTest,
-                         ::testing::Values(makePool));
+                         ::testing::Values(
+                             [] { return makePool(); },
+                             [] {
+                                 auto config = poolConfig();
+                                 config.ThreadCacheSize = 8;
+                                 return makePool(config);
+                             },
+                             [] {
+                                 auto config = poolConfig();
+                                 config.NumShards = 4;
+                                 config.ThreadCacheSize = 8;
+                                 return makePool(config);
+                             },
+                             [] {
+                                 auto config = poolConfig();
+                                 config.DeferredFree = true;
+                                 return makePool(config);
+                             }));
+
+#ifndef _WIN32
+static auto makeOsMemoryPool() {
+    auto params = umfOsMemoryProviderParamsDefault();
+    umf_memory_provider_handle_t hProvider = nullptr;
+    EXPECT_EQ(
+        umfMemoryProviderCreate(umfOsMemoryProviderOps(), &params, &hProvider),
+        UMF_RESULT_SUCCESS);
+    auto config = poolConfig();
+    config.ZeroedProviderMemory = true;
+    auto [retp, pool] = umf::poolMakeUnique<usm::DisjointPool, 1>(
+        {umf_test::wrapProviderUnique(hProvider)}, config);
+    EXPECT_EQ(retp, UMF_RESULT_SUCCESS);
+    return std::move(pool);
+}
+
+INSTANTIATE_TEST_SUITE_P(disjointOsMemoryPoolTests, umfPoolTest,
+                         ::testing::Values(makeOsMemoryPool));
+#endif
 
 GTEST_ALLOW_UNINSTANTIATED_PARAMETERIZED_TEST(umfMultiPoolTest);
 INSTANTIATE_TEST_SUITE_P(disjointMultiPoolTests, umfMultiPoolTest,
-                         ::testing::Values(makePool));
+                         ::testing::Values([] { return makePool(); }));
@@ -150,6 +150,50 @@ TEST_F(disjointPoolConfigTests,
               32 * 1024 * 1024);
 }
 
+TEST_F(disjointPoolConfigTests, disjointPoolConfigStringPrewarmSizeTest) {
+    // PrewarmSize is the optional fourth limit, applied to all memory types
+    // if none is given
+    std::string config = "1;32M;1M,4,64k,256k;device:2m,4,64k,1M";
+    auto allConfigs = usm::parseDisjointPoolConfig(config);
+
+    ASSERT_EQ(allConfigs.Configs[usm::DisjointPoolMemType::Host].PrewarmSize,
+              256 * 1024);
+    ASSERT_EQ(allConfigs.Configs[usm::DisjointPoolMemType::Device].PrewarmSize,
+              1 * 1024 * 1024);
+    ASSERT_EQ(allConfigs.Configs[usm::DisjointPoolMemType::Shared].PrewarmSize,
+              256 * 1024);
+    ASSERT_EQ(allConfigs.Configs[usm::DisjointPoolMemType::SharedReadOnly]
+                  .PrewarmSize,
+              256 * 1024);
+
+    // Not prewarmed by default
+    allConfigs = usm::parseDisjointPoolConfig("1;32M;host:1M,4,64k");
+    ASSERT_EQ(allConfigs.Configs[usm::DisjointPoolMemType::Host].PrewarmSize,
+              0);
+}
+
+TEST_F(disjointPoolConfigTests, disjointPoolSizeClassesTest) {
+    usm::DisjointPoolConfig config;
+    config.ExtraBucketSizes = {224, 80};
+    config.BucketCapacities = {{224, 16}, {1024, 8}};
+
+    auto sizeClasses = usm::formatDisjointPoolSizeClasses(config);
+    ASSERT_EQ(sizeClasses, "80,224:16,1024:8");
+
+    usm::DisjointPoolConfig parsed;
+    ASSERT_TRUE(usm::parseDisjointPoolSizeClasses(sizeClasses, parsed));
+    ASSERT_EQ(usm::formatDisjointPoolSizeClasses(parsed), sizeClasses);
+    ASSERT_EQ(parsed.BucketCapacities, config.BucketCapacities);
+
+    ASSERT_FALSE(usm::parseDisjointPoolSizeClasses("80,2k", parsed));
+    ASSERT_FALSE(usm::parseDisjointPoolSizeClasses("80:", parsed));
+    ASSERT_FALSE(usm::parseDisjointPoolSizeClasses("99999999999999999999:1",
+                                                   parsed));
+    ASSERT_FALSE(usm::parseDisjointPoolSizeClasses("80:99999999999999999999",
+                                                   parsed));
+    ASSERT_EQ(usm::formatDisjointPoolSizeClasses(parsed), sizeClasses);
+}
+
 // TODO: fix config parsing
 // TEST_P(disjointPoolConfigTests, disjointPoolConfigInvalid) {
 //     std::string config = GetParam();
@@ -0,0 +1,173 @@
+/*
+ *
+ * Copyright (C) 2023 Intel Corporation
+ *
+ * Part of the Unified-Runtime Project, under the Apache License v2.0 with LLVM Exceptions.
+ * See LICENSE.TXT
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include "fixed_size_pool.hpp"
+
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "pool.hpp"
+#include "provider.hpp"
+
+using umf_test::counting_provider;
+using umf_test::test;
+
+struct node {
+    node *next = nullptr;
+    uint64_t key = 0;
+    uint32_t flags = 0;
+};
+
+static auto makePool(usm::FixedSizePool::Config config) {
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    EXPECT_EQ(ret, UMF_RESULT_SUCCESS);
+    auto [retp, pool] = umf::poolMakeUnique<usm::FixedSizePool, 1>(
+        {std::move(provider)}, config);
+    EXPECT_EQ(retp, UMF_RESULT_SUCCESS);
+    return std::move(pool);
+}
+
+TEST_F(test, fixedSizeAllocFree) {
+    auto config = usm::FixedSizePool::Config::forType<node>();
+    auto pool = makePool(config);
+
+    // Objects are rounded up to the alignment
+    void *ptr = umfPoolMalloc(pool.get(), sizeof(node));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolMallocUsableSize(pool.get(), ptr), 24);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignof(node), 0);
+
+    // The last freed object is reused first
+    ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolMalloc(pool.get(), 8), ptr);
+    EXPECT_EQ(umfPoolRealloc(pool.get(), ptr, sizeof(node)), ptr);
+
+    EXPECT_EQ(umfPoolMalloc(pool.get(), sizeof(node) + 1), nullptr);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    EXPECT_EQ(umfPoolAlignedMalloc(pool.get(), 8, 64), nullptr);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+              UMF_RESULT_ERROR_INVALID_ALIGNMENT);
+
+    auto *zeroed = static_cast<char *>(umfPoolCalloc(pool.get(), 1, 24));
+    ASSERT_NE(zeroed, nullptr);
+    for (int i = 0; i < 24; i++) {
+        ASSERT_EQ(zeroed[i], 0);
+    }
+
+    ASSERT_EQ(umfPoolFree(pool.get(), zeroed), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    ASSERT_EQ(umfPoolFree(pool.get(), nullptr), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, fixedSizeBatch) {
+    auto config = usm::FixedSizePool::Config::forType<node>();
+    config.SlabSize = 4096;
+    counting_provider::resetCounters();
+    auto [ret, provider] = umf::memoryProviderMakeUnique<counting_provider>();
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    umf_memory_provider_handle_t hProvider = provider.get();
+    usm::FixedSizePool pool;
+    ASSERT_EQ(pool.initialize(&hProvider, 1, config), UMF_RESULT_SUCCESS);
+
+    static constexpr size_t count = 1000;
+    std::vector<void *> ptrs(count);
+    ASSERT_EQ(pool.malloc_batch(sizeof(node), count, ptrs.data()), count);
+    std::set<void *> unique(ptrs.begin(), ptrs.end());
+    EXPECT_EQ(unique.size(), count);
+    for (auto ptr : ptrs) {
+        memset(ptr, 0xab, sizeof(node));
+    }
+    const size_t numSlabs = counting_provider::numAllocs;
+    EXPECT_EQ(numSlabs, (count + 4096 / 24 - 1) / (4096 / 24));
+
+    // Freed objects are reused without allocating from the provider
+    ASSERT_EQ(pool.free_batch(ptrs.data(), count), UMF_RESULT_SUCCESS);
+    std::vector<void *> again(count);
+    ASSERT_EQ(pool.malloc_batch(sizeof(node), count, again.data()), count);
+    EXPECT_EQ(std::set<void *>(again.begin(), again.end()), unique);
+    EXPECT_EQ(counting_provider::numAllocs, numSlabs);
+
+    EXPECT_EQ(pool.malloc_batch(sizeof(node) + 1, 1, ptrs.data()), 0);
+    ASSERT_EQ(pool.free_batch(again.data(), count), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, fixedSizeCrossThread) {
+    auto config = usm::FixedSizePool::Config::forType<node>();
+    config.SlabSize = 4096;
+    auto pool = makePool(config);
+
+    // Objects allocated by one thread and freed by others, which return
+    // them to the shared list when they exit
+    static constexpr size_t count = 10000;
+    std::vector<void *> ptrs(count);
+    for (auto &ptr : ptrs) {
+        ptr = umfPoolMalloc(pool.get(), sizeof(node));
+        ASSERT_NE(ptr, nullptr);
+    }
+    const size_t numSlabs = counting_provider::numAllocs;
+
+    static constexpr size_t numThreads = 4;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < count; i += numThreads) {
+                umfPoolFree(pool.get(), ptrs[i]);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto &ptr : ptrs) {
+        ptr = umfPoolMalloc(pool.get(), sizeof(node));
+        ASSERT_NE(ptr, nullptr);
+    }
+    EXPECT_EQ(counting_provider::numAllocs, numSlabs);
+    for (auto ptr : ptrs) {
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+// Object counting live instances, whose constructor may throw
+struct object {
+    static inline int numLive = 0;
+    explicit object(int value) : value(value) {
+        if (value < 0) {
+            throw std::invalid_argument("negative value");
+        }
+        ++numLive;
+    }
+    ~object() { --numLive; }
+    int value;
+};
+
+TEST_F(test, objectPoolHelper) {
+    auto pool = makePool(usm::FixedSizePool::Config::forType<object>());
+    umf::object_pool<object> objects(pool.get());
+
+    auto *obj = objects.create(42);
+    ASSERT_NE(obj, nullptr);
+    EXPECT_EQ(obj->value, 42);
+    EXPECT_EQ(object::numLive, 1);
+    objects.destroy(obj);
+    EXPECT_EQ(object::numLive, 0);
+    objects.destroy(nullptr);
+
+    // The memory is returned if the constructor throws
+    EXPECT_THROW(objects.create(-1), std::invalid_argument);
+    EXPECT_EQ(objects.create(1), obj);
+    objects.destroy(obj);
+}